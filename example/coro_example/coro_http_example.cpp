@@ -1,4 +1,5 @@
 #include "Task.hpp"
+#include "async_generator.hpp"
 #include "coro_http/coro_http_reader.h"
 #include "coro_http/coro_http_writer.h"
 #include "coro_sys_socket.h"
@@ -6,15 +7,34 @@
 #include "http/http_response.hpp"
 #include "http/http_status_code.h"
 #include "http/methods.h"
+#include "scheduler.hpp"
+#include <cstdlib>
+#include <fcntl.h>
 #include <iostream>
 #include <memory>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
 
 using namespace CNetUtils;
 
+// The /stream body, produced a batch of lines at a time while it is written
+AsyncGenerator<std::string> stream_lines(int count) {
+	std::string batch;
+	for (int i = 0; i < count; ++i) {
+		batch += std::format("line {}\n", i);
+		if (batch.size() >= 1024)
+			co_yield std::exchange(batch, std::string {});
+	}
+	if (!batch.empty())
+		co_yield std::move(batch);
+}
+
 // High-level connection handler. Accepts a socket and services multiple requests if keep-alive.
 Task<void> handle_connection(
     std::shared_ptr<CNetUtils::CoroClientSocket> sock,
-    CNetUtils::http::ServerConfig&& cfg) {
+    CNetUtils::http::ServerConfig cfg) {
 	CNetUtils::http::ServerConfig config = std::move(cfg);
 
 	auto make_response = [&](http::Request& req, CNetUtils::http::HttpStatus status, std::string body, bool chunked = false) {
@@ -42,11 +62,36 @@ Task<void> handle_connection(
 			if (req.method == CNetUtils::http::HttpMethod::GET) {
 				if (req.path == "/" || req.path == "/index") {
 					resp = make_response(req, CNetUtils::http::HttpStatus::OK, "Hello from coroutine HTTP server!\n");
+				} else if (req.path == "/stats") {
+					resp = make_response(req, CNetUtils::http::HttpStatus::OK, Scheduler::stats_all().to_string());
+				} else if (req.path == "/trace") {
+					// load it in ui.perfetto.dev, recorded once CNETUTILS_TRACE is set
+					resp = make_response(req, CNetUtils::http::HttpStatus::OK, TraceRecorder::to_chrome_json(), true);
+					resp.headers.set("content-type", "application/json");
+				} else if (const char* file = std::getenv("CNETUTILS_STATIC_FILE"); file && req.path == "/file") {
+					// sent by the kernel from the page cache, never read in here
+					int file_fd = ::open(file, O_RDONLY | O_CLOEXEC);
+					struct stat st {};
+					if (file_fd < 0 || ::fstat(file_fd, &st) != 0) {
+						if (file_fd >= 0)
+							::close(file_fd);
+						resp = make_response(req, CNetUtils::http::HttpStatus::NotFound, "No such file\n");
+					} else {
+						resp = make_response(req, CNetUtils::http::HttpStatus::OK, "");
+						resp.headers.set("content-type", "application/octet-stream");
+						bool sent = co_await writer.write_file(resp, file_fd, 0, (size_t)st.st_size);
+						::close(file_fd);
+						if (!sent || !req.isKeepAlive)
+							break;
+						continue;
+					}
 				} else if (req.path == "/stream") {
-					std::string big;
-					for (int i = 0; i < 1000; ++i)
-						big += std::format("line {}\n", i);
-					resp = make_response(req, CNetUtils::http::HttpStatus::OK, std::move(big), true);
+					resp = make_response(req, CNetUtils::http::HttpStatus::OK, "", true);
+					if (!co_await writer.write_stream(resp, stream_lines(1000)))
+						break;
+					if (!req.isKeepAlive)
+						break;
+					continue;
 				} else {
 					resp = make_response(req, CNetUtils::http::HttpStatus::NotFound,
 					                     std::format("Path {} not found\n", req.path));
@@ -81,8 +126,16 @@ Task<void> handle_client(std::shared_ptr<CNetUtils::CoroClientSocket> socket) {
 int main() {
 	CNetUtils::netport_t port = 7000;
 	auto server_addr = CNetUtils::ServerAddress { port };
+	// a local sidecar skips the TCP loopback, e.g. CNETUTILS_UNIX_SOCKET=@coro-http
+	if (const char* path = std::getenv("CNETUTILS_UNIX_SOCKET"))
+		server_addr = CNetUtils::ServerAddress::unix_socket(path);
 	auto server = std::make_shared<CNetUtils::CoroServerSocket>(server_addr);
-	server->run_server(handle_client);
+	if (std::getenv("CNETUTILS_TRACE"))
+		TraceRecorder::enable();
+	// a storm waits in the backlog instead of taking the loops down
+	server->set_connection_limit(10000);
+	// one event loop per core, the kernel balances the connections
+	server->run_server(handle_client, std::thread::hardware_concurrency());
 	server->close();
 	return 0;
 }
\ No newline at end of file
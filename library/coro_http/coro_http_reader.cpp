@@ -3,7 +3,9 @@
 #include "http/http_defines.h"
 #include "http/http_exceptions.h"
 #include "http/http_request.h"
+#include <algorithm>
 #include <format>
+#include <utility>
 
 namespace CNetUtils::coro_http {
 Task<bool> HttpReader::read_until_double_crlf() {
@@ -20,43 +22,57 @@ Task<bool> HttpReader::read_until_double_crlf() {
 	}
 }
 
-Task<void> HttpReader::read_exact(std::string& dest, size_t need) {
-	while (dest.size() < need) {
-		size_t want = std::min(cfg_.read_block, need - dest.size());
-		char buf[MAX_TEMP_READ_BUFFER];
-		ssize_t n = co_await sock_->async_read(buf, want);
-		if (n <= 0)
-			throw http::HttpReaderBodyError("unexpected EOF while reading body");
-		dest.append(buf, (size_t)n);
-		if (dest.size() > cfg_.max_body_bytes)
-			throw http::HttpReaderBodyError("body too large");
+Task<bool> HttpReader::read_more() {
+	char buf[MAX_TEMP_READ_BUFFER];
+	ssize_t n = co_await sock_->async_read(buf, cfg_.read_block);
+	if (n <= 0)
+		co_return false;
+	accum_.append(buf, (size_t)n);
+	co_return true;
+}
+
+static std::optional<size_t> content_length_of(const http::Request& req) {
+	auto body_content_length = req.headers.get("content-length");
+	if (!body_content_length.has_value())
+		return std::nullopt;
+	try {
+		return std::stoull(*body_content_length);
+	} catch (...) {
+		throw http::HttpReaderBodyError("invalid content-length");
 	}
 }
 
-Task<std::string> HttpReader::decode_chunked_body(std::string& prefix) {
-	// resets and prepare sessions
-	std::string out;
-	std::string buffer = std::move(prefix);
-	prefix.clear();
+static bool is_chunked(const http::Request& req) {
+	auto transfer_encoding = req.headers.get("transfer-encoding");
+	return transfer_encoding.has_value()
+	    && CNetUtils::to_lower_copy(*transfer_encoding) == "chunked";
+}
 
-	auto read_more = [&](auto&& self) -> Task<void> {
-		char tmp[4096];
-		ssize_t n = co_await sock_->async_read(tmp, cfg_.read_block);
-		if (n <= 0)
-			throw http::HttpReaderBodyError("unexpected EOF in chunked body");
-		buffer.append(tmp, (size_t)n);
-		co_return;
-	};
+AsyncGenerator<std::string> HttpReader::stream_sized(size_t length) {
+	while (length > 0) {
+		if (accum_.empty() && !co_await read_more())
+			throw http::HttpReaderBodyError("unexpected EOF while reading body");
+		size_t take = std::min({ length, accum_.size(), cfg_.read_block });
+		std::string piece = accum_.substr(0, take);
+		accum_.erase(0, take);
+		length -= take;
+		co_yield std::move(piece);
+	}
+}
 
+AsyncGenerator<std::string> HttpReader::stream_chunked() {
 	while (true) {
 		// ensure we have a full chunk-size line
-		auto pos = buffer.find(http::TERMINATE);
+		auto pos = accum_.find(http::TERMINATE);
 		while (pos == std::string::npos) {
-			co_await read_more(read_more); // Await for more...
-			pos = buffer.find(http::TERMINATE); // adjust the positions
+			if (accum_.size() > cfg_.max_header_bytes)
+				throw http::HttpChunkError("chunk size line too long");
+			if (!co_await read_more())
+				throw http::HttpReaderBodyError("unexpected EOF in chunked body");
+			pos = accum_.find(http::TERMINATE);
 		}
 
-		std::string szline = buffer.substr(0, pos);
+		std::string szline = accum_.substr(0, pos);
 		// remove chunk extensions if present: take until ';'
 		auto semi = szline.find(';');
 		if (semi != std::string::npos)
@@ -70,36 +86,48 @@ Task<std::string> HttpReader::decode_chunked_body(std::string& prefix) {
 			throw http::HttpChunkError("invalid chunk size");
 		}
 
-		buffer.erase(0, pos + 2); // remove size line + CRLF
-
-		if (chunk_size == 0) {
-			// final chunk. consume trailing CRLF after last chunk (could be followed by trailers, but we ignore)
-			// ensure we have at least "\r\n"
-			while (buffer.size() < 2)
-				co_await read_more(read_more);
-			if (buffer.rfind("\r\n", 0) == 0) {
-				buffer.erase(0, 2);
-			} else if (buffer.size() >= 2) {
-				buffer.erase(0, 2);
-			}
-			break; // done
+		accum_.erase(0, pos + 2); // remove size line + CRLF
+		bool last = chunk_size == 0;
+
+		// the data goes out as it comes, not once the whole chunk is in
+		while (chunk_size > 0) {
+			if (accum_.empty() && !co_await read_more())
+				throw http::HttpReaderBodyError("unexpected EOF in chunked body");
+			size_t take = std::min({ chunk_size, accum_.size(), cfg_.read_block });
+			std::string piece = accum_.substr(0, take);
+			accum_.erase(0, take);
+			chunk_size -= take;
+			co_yield std::move(piece);
 		}
 
-		// ensure we have chunk_size + CRLF
-		while (buffer.size() < chunk_size + 2) {
-			co_await read_more(read_more);
+		// the CRLF after the data, or after the last chunk (trailers are not supported)
+		while (accum_.size() < 2) {
+			if (!co_await read_more())
+				throw http::HttpReaderBodyError("unexpected EOF in chunked body");
 		}
-
-		out.append(buffer.data(), chunk_size);
-		// remove chunk data + trailing CRLF
-		buffer.erase(0, chunk_size + 2);
-		if (out.size() > cfg_.max_body_bytes)
-			throw http::HttpChunkError("chunked body too large");
+		accum_.erase(0, 2);
+		if (last)
+			co_return; // done
 	}
-	co_return out; // Decode down
 }
 
-Task<std::optional<http::Request>> HttpReader::read_request() {
+AsyncGenerator<std::string> HttpReader::stream_prefix() {
+	// No body or use connection: close to signal EOF for body.
+	// For simplicity: GET/HEAD assumed no body. Others: read until close (dangerous) -> we avoid.
+	if (!accum_.empty())
+		co_yield std::exchange(accum_, std::string {});
+}
+
+AsyncGenerator<std::string> HttpReader::body_stream(const http::Request& req) {
+	// the headers are looked at now, the generator keeps no reference to req
+	if (auto content_len = content_length_of(req))
+		return stream_sized(*content_len);
+	if (is_chunked(req))
+		return stream_chunked();
+	return stream_prefix();
+}
+
+Task<std::optional<http::Request>> HttpReader::read_request_head() {
 	bool ok = co_await read_until_double_crlf();
 	if (!ok)
 		co_return std::nullopt; // Not a valid!
@@ -108,10 +136,8 @@ Task<std::optional<http::Request>> HttpReader::read_request() {
 	if (header_end == std::string::npos)
 		co_return std::nullopt; // malformed
 
-	std::string header_block = accum_.substr(0, header_end);
-	std::string after = accum_.substr(header_end + 4); // might contain body prefix
-
-	http::Request req { header_block };
+	http::Request req { accum_.substr(0, header_end) };
+	accum_.erase(0, header_end + 4); // might contain body prefix
 
 	if (req.path.size() > cfg_.max_start_line)
 		throw http::HttpRequestPathError(
@@ -119,39 +145,24 @@ Task<std::optional<http::Request>> HttpReader::read_request() {
 		        "request path too long, Get: {} > {}",
 		        req.path.size(), cfg_.max_start_line));
 
-	// Determine body strategy
-	auto body_content_length = req.headers.get("content-length");
-	auto transfer_encoding = req.headers.get("transfer-encoding");
-
-	if (body_content_length.has_value()) {
-		// parse the content length
-		size_t content_len = 0;
-		try {
-			content_len = std::stoull(*body_content_length);
-		} catch (...) {
-			throw http::HttpReaderBodyError("invalid content-length");
-		}
-
-		if (content_len > cfg_.max_body_bytes)
-			throw http::HttpReaderBodyError("content-length exceeds max_body_bytes");
-
-		req.body = std::move(after);
+	co_return req;
+}
 
-		if (req.body.size() < content_len) {
-			co_await read_exact(req.body, content_len);
-		}
-		if (req.body.size() > content_len)
-			req.body.resize(content_len);
-
-	} else if (
-	    transfer_encoding.has_value()
-	    && CNetUtils::to_lower_copy(*transfer_encoding) == "chunked") {
-		// decode chunked using `after` as prefix
-		req.body = co_await decode_chunked_body(after);
-	} else {
-		// No body or use connection: close to signal EOF for body.
-		// For simplicity: GET/HEAD assumed no body. Others: read until close (dangerous) -> we avoid.
-		req.body = std::move(after);
+Task<std::optional<http::Request>> HttpReader::read_request() {
+	auto head = co_await read_request_head();
+	if (!head.has_value())
+		co_return std::nullopt;
+
+	http::Request req = std::move(*head);
+	auto content_len = content_length_of(req);
+	if (content_len.has_value() && *content_len > cfg_.max_body_bytes)
+		throw http::HttpReaderBodyError("content-length exceeds max_body_bytes");
+
+	auto body = body_stream(req);
+	while (auto piece = co_await body.next()) {
+		req.body += *piece;
+		if (req.body.size() > cfg_.max_body_bytes)
+			throw http::HttpChunkError("chunked body too large");
 	}
 
 	co_return req;
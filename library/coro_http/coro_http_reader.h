@@ -1,4 +1,5 @@
 #include "Task.hpp"
+#include "async_generator.hpp"
 #include "bytes_helper.hpp"
 #include "coro_sys_socket.h"
 #include "http/http_request.h"
@@ -25,15 +26,46 @@ namespace coro_http {
 
 		Task<std::optional<http::Request>> read_request();
 
+		/**
+		 * @brief read the request line and the headers only, the body is
+		 *        left to body_stream(), so a big upload is never held whole
+		 *
+		 * @return Task<std::optional<http::Request>> with an empty body
+		 */
+		Task<std::optional<http::Request>> read_request_head();
+
+		/**
+		 * @brief the body of the request read by read_request_head(),
+		 *        piece by piece (content-length or chunked), at most
+		 *        read_block bytes a piece. max_body_bytes is left to the
+		 *        consumer. Throws HttpReaderBodyError / HttpChunkError from
+		 *        next() on a broken body. The reader must outlive it
+		 *
+		 * @exception HttpReaderBodyError: invalid content-length
+		 *
+		 * @param req
+		 * @return AsyncGenerator<std::string>
+		 */
+		AsyncGenerator<std::string> body_stream(const http::Request& req);
+
 	private:
 		std::shared_ptr<CNetUtils::CoroClientSocket> sock_;
 		http::ServerConfig cfg_;
-		std::string accum_;
+		std::string accum_; // read but not parsed yet
 
 	private:
 		Task<bool> read_until_double_crlf();
-		Task<void> read_exact(std::string& dest, size_t need);
-		Task<std::string> decode_chunked_body(std::string& prefix);
+
+		/**
+		 * @brief read once more into accum_
+		 *
+		 * @return Task<bool> false if the peer closed
+		 */
+		Task<bool> read_more();
+
+		AsyncGenerator<std::string> stream_sized(size_t length);
+		AsyncGenerator<std::string> stream_chunked();
+		AsyncGenerator<std::string> stream_prefix();
 	};
 
 }
@@ -1,47 +1,153 @@
 #include "coro_http_writer.h"
 #include "http/http_defines.h"
 #include "http/http_response.hpp"
+#include <charconv>
+#include <memory>
+#include <cstring>
+#include <sys/uio.h>
 namespace CNetUtils::coro_http {
 
+namespace {
+	constexpr const char* LAST_CHUNK = "0\r\n\r\n";
+	constexpr const int CHUNKS_PER_WRITE = 16; // 3 iovecs each
+
+	// the status line and headers, the body is written from where it is
+	http::Response head_of(const http::Response& resp) {
+		http::Response r;
+		r.version = resp.version;
+		r.status = resp.status;
+		r.headers = resp.headers;
+		r.use_chunked = resp.use_chunked;
+		return r;
+	}
+
+	CNETUTILS_FORCEINLINE iovec span_of(const void* data, size_t size) noexcept {
+		return { const_cast<void*>(data), size };
+	}
+
+	// "<hex size>\r\n" into line, its length
+	size_t chunk_line(char (&line)[24], size_t size) noexcept {
+		char* end = std::to_chars(line, line + sizeof(line) - 2, size, 16).ptr;
+		std::memcpy(end, http::TERMINATE, 2);
+		return (size_t)(end - line) + 2;
+	}
+
+	std::string nonchunked_head(const http::Response& resp) {
+		http::Response r = head_of(resp);
+		if (!r.headers.has("content-length"))
+			r.headers.set("content-length", std::to_string(resp.body.size()));
+		if (!r.headers.has("connection"))
+			r.headers.set("connection", "close");
+		return r.format_header();
+	}
+
+	// what the kernel may read after a zero-copy write returned
+	struct PinnedResponse {
+		http::Response resp;
+		std::string head;
+	};
+}
+
 Task<void> HttpWriter::write_nonchunked(const http::Response& resp) {
-	http::Response r = resp;
-	if (!r.headers.has("content-length"))
-		r.headers.set("content-length", std::to_string(r.body.size()));
-	if (!r.headers.has("connection"))
-		r.headers.set("connection", "close");
-	std::string out = r.format_header() + r.body;
+	std::string head = nonchunked_head(resp);
+
+	// one syscall, the body is not copied behind the headers
+	iovec iov[2] = { span_of(head.data(), head.size()), span_of(resp.body.data(), resp.body.size()) };
+	co_await sock_->async_writev(iov, 2);
+}
+
+Task<void> HttpWriter::write_chunked(const http::Response& resp) {
+	http::Response r = head_of(resp);
+	r.use_chunked = true;
+	r.headers.erase("content-length");
+	r.headers.set("transfer-encoding", "chunked");
+	r.headers.set("connection", "keep-alive");
+	std::string head = r.format_header();
 
+	// the head, then CHUNKS_PER_WRITE chunks per writev, the last chunk
+	// goes with the final batch
+	const std::string& body = resp.body;
+	char lines[CHUNKS_PER_WRITE][24];
+	iovec iov[1 + 3 * CHUNKS_PER_WRITE + 1];
+	int count = 0;
+	iov[count++] = span_of(head.data(), head.size());
+	size_t pos = 0;
+	while (true) {
+		for (int c = 0; c < CHUNKS_PER_WRITE && pos < body.size(); c++) {
+			size_t chunk = std::min(cfg_.read_block, body.size() - pos);
+			iov[count++] = span_of(lines[c], chunk_line(lines[c], chunk));
+			iov[count++] = span_of(body.data() + pos, chunk);
+			iov[count++] = span_of(http::TERMINATE, 2);
+			pos += chunk;
+		}
+		const bool last = pos >= body.size();
+		if (last)
+			iov[count++] = span_of(LAST_CHUNK, 5);
+		if (co_await sock_->async_writev(iov, count) < 0 || last)
+			co_return;
+		count = 0;
+	}
+}
+
+Task<bool> HttpWriter::write_all(const char* data, size_t size) {
 	size_t sent = 0;
-	while (sent < out.size()) {
-		ssize_t n = co_await sock_->async_write(out.data() + sent, out.size() - sent);
+	while (sent < size) {
+		ssize_t n = co_await sock_->async_write(data + sent, size - sent);
 		if (n <= 0)
-			break;
+			co_return false;
 		sent += (size_t)n;
 	}
+	co_return true;
 }
 
-Task<void> HttpWriter::write_chunked(const http::Response& resp) {
-	http::Response r = resp;
+Task<bool> HttpWriter::write_stream(const http::Response& head, AsyncGenerator<std::string> body) {
+	http::Response r = head_of(head);
+	r.use_chunked = true;
 	r.headers.erase("content-length");
 	r.headers.set("transfer-encoding", "chunked");
-	r.headers.set("connection", "keep-alive");
+	if (!r.headers.has("connection"))
+		r.headers.set("connection", "keep-alive");
 
-	std::string head = r.format_header();
-	ssize_t sent = co_await sock_->async_write(head.data(), head.size());
-	if (sent <= 0)
-		co_return;
+	std::string out = r.format_header();
+	if (!co_await write_all(out.data(), out.size()))
+		co_return false;
 
-	size_t pos = 0;
-	while (pos < r.body.size()) {
-		size_t chunk = std::min(cfg_.read_block, r.body.size() - pos);
-		std::string chunk_hdr = std::format("{:x}{}", chunk, http::TERMINATE);
-		co_await sock_->async_write(chunk_hdr.data(), chunk_hdr.size());
-		co_await sock_->async_write(r.body.data() + pos, chunk);
-		co_await sock_->async_write(http::TERMINATE, 2);
-		pos += chunk;
+	while (true) {
+		std::optional<std::string> piece;
+		try {
+			piece = co_await body.next();
+		} catch (const std::exception&) {
+			co_return false;
+		}
+		if (!piece.has_value())
+			break;
+		if (piece->empty())
+			continue; // an empty chunk would end the body
+		char line[24];
+		iovec iov[3] = {
+			span_of(line, chunk_line(line, piece->size())),
+			span_of(piece->data(), piece->size()),
+			span_of(http::TERMINATE, 2),
+		};
+		if (co_await sock_->async_writev(iov, 3) < 0)
+			co_return false;
 	}
 
-	co_await sock_->async_write("0\r\n\r\n", 5);
+	co_return co_await write_all(LAST_CHUNK, 5);
+}
+
+Task<bool> HttpWriter::write_file(const http::Response& head, int file_fd, off_t offset, size_t length) {
+	http::Response r = head_of(head);
+	r.use_chunked = false;
+	r.headers.erase("transfer-encoding");
+	r.headers.set("content-length", std::to_string(length));
+	if (!r.headers.has("connection"))
+		r.headers.set("connection", "keep-alive");
+
+	std::string out = r.format_header();
+	if (!co_await write_all(out.data(), out.size()))
+		co_return false;
+	co_return co_await sock_->async_sendfile(file_fd, offset, length) == (ssize_t)length;
 }
 
 Task<void> HttpWriter::write_response(const http::Response& resp) {
@@ -52,4 +158,19 @@ Task<void> HttpWriter::write_response(const http::Response& resp) {
 	}
 }
 
+Task<void> HttpWriter::write_response(http::Response&& resp) {
+	if (resp.use_chunked || !cfg_.zerocopy_threshold || resp.body.size() < cfg_.zerocopy_threshold) {
+		co_await write_response(resp);
+		co_return;
+	}
+	auto pinned = std::make_shared<PinnedResponse>();
+	pinned->head = nonchunked_head(resp);
+	pinned->resp = std::move(resp);
+	iovec iov[2] = {
+		span_of(pinned->head.data(), pinned->head.size()),
+		span_of(pinned->resp.body.data(), pinned->resp.body.size()),
+	};
+	co_await sock_->async_writev_zerocopy(std::move(pinned), iov, 2);
+}
+
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "Task.hpp"
+#include "async_generator.hpp"
 #include "coro_sys_socket.h"
 #include "http/http_response.hpp"
 #include "http/http_server_config.h"
@@ -12,10 +13,48 @@ namespace coro_http {
 		    std::shared_ptr<CNetUtils::CoroClientSocket> sock,
 		    const http::ServerConfig& cfg)
 		    : sock_(std::move(sock))
-		    , cfg_(cfg) { }
+		    , cfg_(cfg) {
+			if (cfg_.zerocopy_threshold)
+				sock_->set_zerocopy(cfg_.zerocopy_threshold);
+		}
 
 		Task<void> write_response(const http::Response& resp);
 
+		/**
+		 * @brief Like write_response, the response is handed over: a non
+		 *        chunked body of at least zerocopy_threshold is sent
+		 *        MSG_ZEROCOPY, and kept by the socket until the kernel let
+		 *        its pages go
+		 *
+		 * @param resp
+		 * @return Task<void>
+		 */
+		Task<void> write_response(http::Response&& resp);
+
+		/**
+		 * @brief Write head, then each piece of body as one chunk as soon as
+		 *        it is produced, so the body is never held whole
+		 *
+		 * @param head the status and headers, its body is ignored
+		 * @param body
+		 * @return Task<bool> false if the write failed or body threw, the
+		 *         response is cut then and the connection should be closed
+		 */
+		Task<bool> write_stream(const http::Response& head, AsyncGenerator<std::string> body);
+
+		/**
+		 * @brief Write head, then length bytes of a file as the body with
+		 *        sendfile, the file is never read into memory
+		 *
+		 * @param head the status and headers, its body is ignored
+		 * @param file_fd a regular file, kept open by the caller
+		 * @param offset
+		 * @param length the content-length
+		 * @return Task<bool> false if the write failed or the file was
+		 *         shorter, the connection should be closed then
+		 */
+		Task<bool> write_file(const http::Response& head, int file_fd, off_t offset, size_t length);
+
 	private:
 		std::shared_ptr<CNetUtils::CoroClientSocket> sock_;
 		const http::ServerConfig& cfg_;
@@ -35,6 +74,8 @@ namespace coro_http {
 		 * @return Task<void>
 		 */
 		Task<void> write_chunked(const http::Response& resp);
+
+		Task<bool> write_all(const char* data, size_t size);
 	};
 
 }
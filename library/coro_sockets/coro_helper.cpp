@@ -13,10 +13,18 @@ namespace {
 		    : fd(f)
 		    , events(e) { }
 		bool await_ready() { return false; }
-		void await_suspend(std::coroutine_handle<> h) {
-			IOEventManager::instance().add_waiter(fd, events, h);
+		bool await_suspend(std::coroutine_handle<> h) {
+			if (!IOEventManager::instance().add_waiter(fd, events, h))
+				return false;
+			frame = h.address();
+			TraceRecorder::record(TraceRecord::Kind::IoWaitBegin, frame, fd);
+			return true;
 		}
-		void await_resume() { }
+		void await_resume() {
+			if (frame)
+				TraceRecorder::record(TraceRecord::Kind::IoWaitEnd, frame, fd);
+		}
+		const void* frame { nullptr }; // set once parked, for the trace
 	};
 
 	WaitForEvent await_io_event(std::shared_ptr<Socket> socket, IOEventManager::Event events) {
@@ -32,6 +40,8 @@ namespace {
 		while (true) {
 			auto client_socket = server_socket->accept();
 			if (client_socket) {
+				// resets the slot left by a closed socket of the same fd
+				IOEventManager::instance().register_fd(client_socket->internal());
 				co_return client_socket;
 			}
 			co_await await_io_event(server_socket,
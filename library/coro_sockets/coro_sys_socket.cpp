@@ -2,73 +2,734 @@
 #include "IOEventMonitor.h"
 #include "socket_exception.hpp"
 #include "sys_socket.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <mutex>
 #include <netinet/in.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 namespace CNetUtils {
 
 namespace {
 	using Event = IOEventManager::Event;
-	struct WaitForEvent {
+
+	/**
+	 * @brief wait for the readiness of fd, a cancelled token withdraws the waiter
+	 *
+	 */
+	struct WaitForEvent : CancellableWait {
 		int fd;
 		Event events;
-		WaitForEvent(int f, Event e)
+		IOEventManager*& registered_in;
+		WaitForEvent(int f, Event e, IOEventManager*& registered_in)
 		    : fd(f)
-		    , events(e) { }
+		    , events(e)
+		    , registered_in(registered_in) { }
+		bool await_ready() { return false; }
+
+		template <typename Promise>
+		bool await_suspend(std::coroutine_handle<Promise> h) {
+			if (watch(token_of(h), &WaitForEvent::withdraw))
+				return false;
+			auto& manager = IOEventManager::instance();
+			// a stolen coroutine waits in the epoll of its new thread
+			if (registered_in != &manager) {
+				manager.register_fd(fd);
+				registered_in = &manager;
+			}
+			if (!manager.add_waiter(fd, events, waker(h))) {
+				unwatch();
+				return false;
+			}
+			frame = h.address();
+			TraceRecorder::record(TraceRecord::Kind::IoWaitBegin, frame, fd);
+			return true;
+		}
+
+		/**
+		 * @brief 0 if ready, else ECANCELED / ETIMEDOUT
+		 */
+		int await_resume() {
+			if (frame)
+				TraceRecorder::record(TraceRecord::Kind::IoWaitEnd, frame, fd);
+			unwatch();
+			return cancel_error();
+		}
+
+		const void* frame { nullptr }; // set once parked, for the trace
+
+		static void withdraw(CancellableWait& wait) {
+			auto& self = static_cast<WaitForEvent&>(wait);
+			if (auto h = IOEventManager::instance().remove_waiter(self.fd, self.events))
+				Scheduler::wake(h);
+		}
+	};
+
+	WaitForEvent await_io_event(socket_raw_t socket_fd, IOEventManager*& registered_in,
+	                            IOEventManager::Event events) {
+		return { socket_fd, events, registered_in };
+	}
+
+	// await_io_event as a Task, for with_timeout
+	Task<int> io_event(socket_raw_t socket_fd, IOEventManager*& registered_in, IOEventManager::Event events) {
+		co_return co_await await_io_event(socket_fd, registered_in, events);
+	}
+
+	/**
+	 * @brief submit an io_uring operation and resume on its completion,
+	 *        a cancelled token asks the kernel to cancel the operation
+	 *
+	 * @tparam Submit void(UringOperation&)
+	 */
+	template <typename Submit>
+	struct AwaitCompletion : CancellableWait {
+		int fd;
+		Submit submit;
+		UringOperation op {};
+
+		AwaitCompletion(int fd, Submit submit)
+		    : fd(fd)
+		    , submit(std::move(submit)) { }
+
+		bool await_ready() { return false; }
+
+		template <typename Promise>
+		bool await_suspend(std::coroutine_handle<Promise> h) {
+			if (watch(token_of(h), &AwaitCompletion::withdraw)) {
+				op.result = -cancel_error();
+				return false;
+			}
+			op.handle = waker(h);
+			submit(op);
+			TraceRecorder::record(TraceRecord::Kind::IoWaitBegin, h.address(), fd);
+			return true;
+		}
+
+		// the cqe res, -ETIMEDOUT for the operations cut by a timeout
+		int await_resume() {
+			if (op.handle)
+				TraceRecorder::record(TraceRecord::Kind::IoWaitEnd, unpin(op.handle).address(), fd);
+			unwatch();
+			if (op.result == -ECANCELED && cancel_error())
+				return -cancel_error();
+			return op.result;
+		}
+
+		// the operation lives in this frame, so wait for its cqe anyway
+		static void withdraw(CancellableWait& wait) {
+			IOEventManager::instance().submit_cancel(static_cast<AwaitCompletion&>(wait).op);
+		}
+	};
+
+	template <typename Submit>
+	AwaitCompletion<Submit> await_completion(int fd, Submit submit) {
+		return AwaitCompletion<Submit>(fd, std::move(submit));
+	}
+
+	/**
+	 * @brief counts the connections of one listener being served, the
+	 *        accept loop waits here while there are too many. The handlers
+	 *        may leave from another loop when they are stolen
+	 *
+	 */
+	struct ConnectionGate {
+		ConnectionGate(std::size_t max, std::size_t low)
+		    : max(max)
+		    , low(low) { }
+
+		const std::size_t max;
+		const std::size_t low;
+		std::atomic<std::size_t> active { 0 };
+		std::mutex lock;
+		std::coroutine_handle<> waiter;
+		Scheduler* loop { nullptr };
+
+		CNETUTILS_FORCEINLINE bool full() const noexcept {
+			return active.load(std::memory_order_acquire) >= max;
+		}
+
+		CNETUTILS_FORCEINLINE std::size_t room() const noexcept {
+			std::size_t now = active.load(std::memory_order_acquire);
+			return now >= max ? 0 : max - now;
+		}
+
+		CNETUTILS_FORCEINLINE void enter() noexcept { active.fetch_add(1, std::memory_order_acq_rel); }
+
+		void leave() noexcept {
+			if (active.fetch_sub(1, std::memory_order_acq_rel) - 1 > low)
+				return;
+			std::unique_lock guard { lock };
+			if (!waiter)
+				return;
+			auto h = std::exchange(waiter, nullptr);
+			Scheduler* owner = std::exchange(loop, nullptr);
+			guard.unlock();
+			Scheduler::resume_on(*owner, h);
+			owner->release();
+		}
+
+		/**
+		 * @brief co_await drained(): until the served ones drop to low
+		 *
+		 */
+		struct Drained {
+			ConnectionGate& gate;
+
+			bool await_ready() noexcept { return gate.active.load(std::memory_order_acquire) <= gate.low; }
+			bool await_suspend(std::coroutine_handle<> h) {
+				std::lock_guard guard { gate.lock };
+				if (gate.active.load(std::memory_order_acquire) <= gate.low)
+					return false;
+				gate.waiter = h;
+				gate.loop = &Scheduler::instance();
+				// the handlers may all be stolen, keep the loop in run()
+				gate.loop->hold();
+				return true;
+			}
+			void await_resume() noexcept { }
+		};
+
+		Drained drained() noexcept { return { *this }; }
+	};
+
+	Task<void> serve_admitted(CoroServerSocket::async_client_comming_callback_t callback,
+	                          std::shared_ptr<CoroClientSocket> socket,
+	                          std::shared_ptr<ConnectionGate> gate) {
+		co_await callback(std::move(socket));
+		gate->leave();
+	}
+
+	/**
+	 * @brief walks an iovec array being written: each sendmsg takes a
+	 *        window of what is left, starting mid-iovec after a partial
+	 *        write. The caller's array is left untouched
+	 *
+	 */
+	struct IovCursor {
+		static constexpr const int WINDOW = 64; // iovecs per sendmsg
+
+		const iovec* iov;
+		int count;
+		int index { 0 };
+		std::size_t offset { 0 }; // already written of iov[index]
+		iovec window[WINDOW];
+		msghdr msg {};
+
+		IovCursor(const iovec* iov, int count)
+		    : iov(iov)
+		    , count(count) {
+			skip_written();
+		}
+
+		CNETUTILS_FORCEINLINE bool done() const noexcept { return index >= count; }
+
+		// what the next sendmsg writes
+		msghdr* next() noexcept {
+			int n = 0;
+			for (int i = index; i < count && n < WINDOW; i++) {
+				if (iov[i].iov_len > 0)
+					window[n++] = iov[i];
+			}
+			// skip_written() left iov[index] non empty, it comes first
+			window[0].iov_base = static_cast<char*>(window[0].iov_base) + offset;
+			window[0].iov_len -= offset;
+			msg = {};
+			msg.msg_iov = window;
+			msg.msg_iovlen = (std::size_t)n;
+			return &msg;
+		}
+
+		void advance(std::size_t written) noexcept {
+			while (written > 0 && index < count) {
+				std::size_t left = iov[index].iov_len - offset;
+				if (written < left) {
+					offset += written;
+					return;
+				}
+				written -= left;
+				index++;
+				offset = 0;
+			}
+			skip_written();
+		}
+
+	private:
+		void skip_written() noexcept {
+			while (index < count && iov[index].iov_len == offset) {
+				index++;
+				offset = 0;
+			}
+		}
+	};
+
+	// a non blocking look at a fd we do not own the registration of
+	bool fd_ready(int fd, short events) noexcept {
+		pollfd probe { fd, events, 0 };
+		return ::poll(&probe, 1, 0) > 0 && (probe.revents & (events | POLLERR | POLLHUP));
+	}
+
+	/**
+	 * @brief the registration of a pipe in the loop, only for the
+	 *        splice, so its slot does not linger once the pipe is closed
+	 *
+	 */
+	struct PipeRegistration {
+		int fd;
+		IOEventManager* registered_in { nullptr };
+
+		~PipeRegistration() {
+			if (registered_in == &IOEventManager::instance())
+				registered_in->deregister_fd(fd);
+		}
+	};
+
+	// how long to wait when the kernel is short of memory or fds
+	static constexpr const auto ACCEPT_BACKOFF = std::chrono::milliseconds(10);
+}
+
+/**
+ * @brief   SpareFd keeps one fd reserved for the listener: when the fd table
+ *          is full (EMFILE), it is given up to accept the pending connection
+ *          and close it right away, so the connection leaves the backlog
+ *          instead of failing the accept loop, and it is reserved again
+ *
+ */
+struct CoroServerSocket::SpareFd {
+	enum class Recovery {
+		Retry, // the connection is lost, go on
+		Backoff, // the kernel is short of resources, wait a bit
+		Broken // the listener itself is gone
+	};
+
+	int fd { ::open("/dev/null", O_RDONLY | O_CLOEXEC) };
+
+	SpareFd() = default;
+	~SpareFd() {
+		if (fd >= 0)
+			::close(fd);
+	}
+
+	Recovery recover(int err, socket_raw_t listen_fd) noexcept {
+		switch (err) {
+		case EMFILE:
+		case ENFILE:
+			return shed(listen_fd) ? Recovery::Retry : Recovery::Backoff;
+		case ENOBUFS:
+		case ENOMEM:
+			return Recovery::Backoff;
+		case EBADF:
+		case ENOTSOCK:
+		case EINVAL:
+		case EOPNOTSUPP:
+		case EFAULT:
+			return Recovery::Broken;
+		default:
+			// ECONNABORTED, EPROTO, EPERM...: about that connection only
+			return Recovery::Retry;
+		}
+	}
+
+private:
+	bool shed(socket_raw_t listen_fd) noexcept {
+		if (fd < 0) {
+			fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+			return false; // nothing to give up this time
+		}
+		::close(fd);
+		int refused = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+		if (refused >= 0)
+			::close(refused);
+		fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+		return refused >= 0;
+	}
+
+	SpareFd(const SpareFd&) = delete;
+	SpareFd& operator=(const SpareFd&) = delete;
+};
+
+/**
+ * @brief   UringAcceptQueue keeps one accept armed in the ring for a
+ *          listener, the accepted fds (or -errno) queue here until the
+ *          accept loop takes them. It is locked because a stolen accept
+ *          loop may wait on it from another worker.
+ *
+ */
+struct UringAcceptQueue : UringOperation {
+	explicit UringAcceptQueue(socket_raw_t listen_fd)
+	    : listen_fd(listen_fd) {
+		on_complete = &UringAcceptQueue::on_accept;
+	}
+
+	socket_raw_t listen_fd;
+	std::mutex lock;
+	std::deque<int> results;
+	std::coroutine_handle<> waiter;
+	IOEventManager* armed_in { nullptr };
+	bool multishot { true };
+	bool orphaned { false }; // the server is gone, free on the last CQE
+
+	// lock held
+	void arm(IOEventManager& manager) {
+		manager.submit_accept(listen_fd, multishot, *this);
+		armed_in = &manager;
+	}
+
+	static void on_accept(UringOperation& op, int res, std::uint32_t flags,
+	                      UringOperation::handles_t& out_handles) {
+		auto& self = static_cast<UringAcceptQueue&>(op);
+		const bool finished = !(flags & IORING_CQE_F_MORE);
+		std::unique_lock guard { self.lock };
+		if (finished)
+			self.armed_in = nullptr;
+
+		if (self.orphaned) {
+			if (res >= 0)
+				::close(res);
+			if (finished) {
+				guard.unlock();
+				delete &self;
+			}
+			return;
+		}
+
+		if (res == -EINVAL && self.multishot) {
+			// the kernel knows no multishot accept, go on one by one
+			self.multishot = false;
+		} else if (res != -ECANCELED) {
+			self.results.push_back(res);
+		}
+
+		if (!self.waiter)
+			return;
+		if (!self.results.empty()) {
+			out_handles.push_back(self.waiter);
+			self.waiter = nullptr;
+		} else if (!self.armed_in) {
+			self.arm(IOEventManager::instance());
+		}
+	}
+
+	/**
+	 * @brief the next accepted fd, or -errno
+	 *
+	 */
+	struct NextResult {
+		UringAcceptQueue& queue;
+		int result { 0 };
+		bool taken { false };
+
+		// lock held
+		bool take() {
+			if (queue.results.empty())
+				return false;
+			result = queue.results.front();
+			queue.results.pop_front();
+			taken = true;
+			return true;
+		}
+
 		bool await_ready() { return false; }
-		void await_suspend(std::coroutine_handle<> h) {
-			IOEventManager::instance().add_waiter(fd, events, h);
+		bool await_suspend(std::coroutine_handle<> h) {
+			std::lock_guard guard { queue.lock };
+			if (take())
+				return false;
+			queue.waiter = h;
+			if (!queue.armed_in)
+				queue.arm(IOEventManager::instance());
+			return true;
+		}
+		int await_resume() {
+			if (!taken) {
+				std::lock_guard guard { queue.lock };
+				take();
+			}
+			return result;
 		}
-		void await_resume() { }
 	};
 
-	WaitForEvent await_io_event(std::shared_ptr<Socket> socket, IOEventManager::Event events) {
-		return { socket->internal(), events };
+	NextResult next() { return { *this }; }
+
+	/**
+	 * @brief take what is queued already, without suspending
+	 *
+	 */
+	void drain(std::vector<int>& out, std::size_t max) {
+		std::lock_guard guard { lock };
+		while (out.size() < max && !results.empty()) {
+			out.push_back(results.front());
+			results.pop_front();
+		}
+	}
+};
+
+void CoroServerSocket::AcceptQueueDeleter::operator()(UringAcceptQueue* queue) const noexcept {
+	std::unique_lock guard { queue->lock };
+	for (int fd : queue->results) {
+		if (fd >= 0)
+			::close(fd);
 	}
+	queue->results.clear();
+	queue->waiter = nullptr;
 
-	WaitForEvent await_io_event(socket_raw_t socket_fd, IOEventManager::Event events) {
-		return { socket_fd, events };
+	// still armed in this thread's ring, let the cancellation CQE free it.
+	// A ring of another thread is torn down with its thread already
+	if (queue->armed_in && queue->armed_in == &IOEventManager::instance()) {
+		try {
+			queue->armed_in->submit_cancel(*queue);
+			queue->orphaned = true;
+			return;
+		} catch (...) {
+			// the ring is full, nothing better than leaking it to the kernel
+			queue->orphaned = true;
+			return;
+		}
 	}
+	guard.unlock();
+	delete queue;
 }
 
-std::shared_ptr<CoroClientSocket> CoroServerSocket::accept() const {
+int CoroServerSocket::accept(sockaddr_storage& peer, socklen_t& peer_len) const {
 	if (!is_valid())
-		throw SocketException("Invalid Socket Handle");
+		return -EBADF;
+
+	peer_len = sizeof(peer);
+	int fd = ::accept4(socket_fd, reinterpret_cast<sockaddr*>(&peer),
+	                   &peer_len, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	return fd >= 0 ? fd : -errno;
+}
+
+void CoroServerSocket::set_connection_limit(std::size_t max, std::size_t resume_below) noexcept {
+	max_connections = max;
+	this->resume_below = resume_below > 0 && resume_below < max ? resume_below : max * 3 / 4;
+}
+
+std::pair<std::shared_ptr<CoroClientSocket>, std::shared_ptr<CoroClientSocket>>
+CoroClientSocket::memory_pair(std::size_t buffer_size) {
+	auto [one, other] = MemoryStream::make_pair(buffer_size);
+	auto first = std::make_shared<CoroClientSocket>(INVALID_FD);
+	auto second = std::make_shared<CoroClientSocket>(INVALID_FD);
+	first->memory = std::move(one);
+	second->memory = std::move(other);
+	return { std::move(first), std::move(second) };
+}
 
-	sockaddr_in cli {};
-	socklen_t cli_len = sizeof(cli);
+Task<std::shared_ptr<CoroClientSocket>> CoroClientSocket::async_connect(const FullAddress& peer) {
+	sockaddr_storage addr {};
+	socklen_t addr_len = peer.to_sockaddr(addr);
+	if (addr_len == 0) {
+		errno = EINVAL;
+		co_return nullptr;
+	}
+	int fd = ::socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		co_return nullptr;
 
-	int fd = ::accept4(socket_fd, reinterpret_cast<sockaddr*>(&cli),
-	                   &cli_len, SOCK_CLOEXEC | SOCK_NONBLOCK);
-	if (fd < 0) {
-		if (errno == EAGAIN || errno == EWOULDBLOCK)
-			return nullptr;
-		throw AcceptError("Error in Accept!");
+	auto socket = std::make_shared<CoroClientSocket>(fd);
+	int err = 0;
+	if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), addr_len) != 0) {
+		err = errno;
+		if (err == EINPROGRESS) {
+			// writable once connected or refused, SO_ERROR tells which
+			err = co_await await_io_event(fd, socket->registered_in, IOEventManager::Event::MONITOR_WRITE);
+			socklen_t err_len = sizeof(err);
+			if (!err && ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) != 0)
+				err = errno;
+		}
+	}
+	if (err) {
+		socket->close();
+		errno = err;
+		co_return nullptr;
 	}
+	co_return socket;
+}
 
-	auto result = std::make_shared<CoroClientSocket>(fd);
-	result->set_internal_data(&cli);
-	return result;
+void CoroClientSocket::close() {
+	if (memory)
+		memory->close();
+	// only the own thread's slot can be cleared, another thread resets
+	// its stale slot when the fd number is registered again
+	if (is_valid() && registered_in == &IOEventManager::instance())
+		registered_in->deregister_fd(internal());
+	registered_in = nullptr;
+	// the kernel still sends from the pages it did not report: the peer
+	// sees the end of the stream, the fd stays open for the completions
+	if (!zerocopy.holds.empty() && is_valid())
+		zerocopy.reap(internal());
+	if (!zerocopy.holds.empty() && is_valid()) {
+		::shutdown(internal(), SHUT_WR);
+		Scheduler::spawn(__linger_zerocopy(internal(), std::move(zerocopy)));
+		socket_fd = INVALID_FD;
+	}
+	zerocopy = {};
+	ClientSocket::close();
 }
 
-Task<std::shared_ptr<CoroClientSocket>> CoroServerSocket::__async_accept() {
-	while (true) {
-		auto client_socket = this->accept();
-		if (client_socket) {
-			co_return client_socket;
+Task<void> CoroClientSocket::__linger_zerocopy(socket_raw_t fd, ZerocopyState state) {
+	IOEventManager* registered_in { nullptr };
+	const auto give_up = LoopClock::now() + ZEROCOPY_LINGER;
+	while (!state.holds.empty()) {
+		// the error queue raises EPOLLERR, which wakes the reader
+		auto left = std::chrono::duration_cast<std::chrono::milliseconds>(give_up - LoopClock::now());
+		if (left.count() <= 0)
+			break;
+		auto woken = co_await with_timeout(io_event(fd, registered_in, IOEventManager::Event::MONITOR_READ), left);
+		if (!woken)
+			break;
+		state.reap(fd);
+	}
+	if (registered_in == &IOEventManager::instance())
+		registered_in->deregister_fd(fd);
+	if (!state.holds.empty()) {
+		// reset: the kernel drops the unsent data, the pages with it
+		::linger abort { 1, 0 };
+		::setsockopt(fd, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+	}
+	::close(fd);
+}
+
+Task<bool> CoroServerSocket::__accept_batch(
+    std::vector<std::shared_ptr<CoroClientSocket>>& out, std::size_t max, SpareFd& spare) {
+	using Recovery = SpareFd::Recovery;
+	auto& manager = IOEventManager::instance();
+
+	if (manager.uring_enabled()) {
+		if (!accept_queue)
+			accept_queue.reset(new UringAcceptQueue(socket_fd));
+		std::vector<int> results;
+		accept_queue->drain(results, max);
+		if (results.empty()) {
+			results.push_back(co_await accept_queue->next());
+			accept_queue->drain(results, max); // queued meanwhile
+		}
+		bool broken = false;
+		bool backoff = false;
+		for (int res : results) {
+			if (res >= 0 && !broken) {
+				// the peer address is fetched lazily by dump_self()
+				out.push_back(std::make_shared<CoroClientSocket>(res));
+			} else if (res >= 0) {
+				::close(res);
+			} else {
+				Recovery recovery = spare.recover(-res, socket_fd);
+				broken |= recovery == Recovery::Broken;
+				backoff |= recovery == Recovery::Backoff;
+			}
 		}
-		co_await await_io_event(socket_fd, IOEventManager::Event::MONITOR_READ);
+		if (backoff && !broken)
+			co_await sleep(ACCEPT_BACKOFF);
+		co_return !broken || !out.empty();
+	}
+
+	while (out.size() < max) {
+		sockaddr_storage peer {};
+		socklen_t peer_len = 0;
+		int res = accept(peer, peer_len);
+		if (res >= 0) {
+			auto client = std::make_shared<CoroClientSocket>(res);
+			client->set_peer(peer, peer_len);
+			// once for the whole connection, the waits only fill the slots
+			manager.register_fd(res);
+			client->registered_in = &manager;
+			out.push_back(std::move(client));
+			continue;
+		}
+		if (res == -EAGAIN || res == -EWOULDBLOCK) {
+			// drained, the batch goes out before we wait again
+			if (!out.empty())
+				break;
+			if (co_await await_io_event(socket_fd, registered_in, IOEventManager::Event::MONITOR_READ))
+				co_return false; // cancelled
+			continue;
+		}
+		switch (spare.recover(-res, socket_fd)) {
+		case Recovery::Retry:
+			break;
+		case Recovery::Backoff:
+			if (!out.empty())
+				co_return true;
+			co_await sleep(ACCEPT_BACKOFF);
+			break;
+		case Recovery::Broken:
+			co_return !out.empty();
+		}
+	}
+	co_return true;
+}
+
+void CoroServerSocket::__pause_accept() noexcept {
+	auto& manager = IOEventManager::instance();
+	if (accept_queue) {
+		std::lock_guard guard { accept_queue->lock };
+		if (accept_queue->armed_in == &manager) {
+			try {
+				manager.submit_cancel(*accept_queue);
+			} catch (...) {
+				// the ring is full, the connections keep queuing meanwhile
+			}
+		}
+		return;
+	}
+	// out of the epoll set, the next wait registers it again
+	if (registered_in == &manager) {
+		manager.unwatch_fd(socket_fd);
+		registered_in = nullptr;
 	}
 }
 
 Task<ssize_t> CoroClientSocket::async_read(void* buffer, size_t buffer_size) {
+	if (memory)
+		co_return co_await memory->async_read(buffer, buffer_size);
+
+	if (IOEventManager::instance().uring_enabled()) {
+		const socket_raw_t fd = internal();
+		while (true) {
+			// the ring does not report EPOLLERR, the zero-copy completions are taken here
+			if (!zerocopy.holds.empty())
+				zerocopy.reap(fd);
+			int res = co_await await_completion(fd, [&](UringOperation& op) {
+				IOEventManager::instance().submit_recv(fd, buffer, buffer_size, op);
+			});
+			if (res >= 0)
+				co_return res;
+			if (res == -EINTR)
+				continue;
+			if (res == -EAGAIN) {
+				// older kernels hand O_NONBLOCK back to us
+				if (int err = co_await await_io_event(fd, registered_in, IOEventManager::Event::MONITOR_READ)) {
+					errno = err;
+					co_return -1;
+				}
+				continue;
+			}
+			errno = -res;
+			co_return -1;
+		}
+	}
+
 	while (true) {
 		ssize_t n = ClientSocket::read(buffer, buffer_size);
 		if (n >= 0) {
 			co_return n;
 		} else {
 			if (errno == EAGAIN || errno == EWOULDBLOCK) {
-				co_await await_io_event(internal(),
-				                        IOEventManager::Event::MONITOR_READ);
+				// woken by EPOLLERR maybe: the zero-copy completions queued
+				if (!zerocopy.holds.empty())
+					zerocopy.reap(internal());
+				if (int err = co_await await_io_event(internal(), registered_in,
+				                                      IOEventManager::Event::MONITOR_READ)) {
+					errno = err; // timed out or cancelled
+					co_return -1;
+				}
 				continue;
 			} else {
 				co_return -1;
@@ -78,7 +739,36 @@ Task<ssize_t> CoroClientSocket::async_read(void* buffer, size_t buffer_size) {
 }
 
 Task<ssize_t> CoroClientSocket::async_write(const void* buffer, size_t buffer_size) {
+	if (memory)
+		co_return co_await memory->async_write(buffer, buffer_size);
+
 	size_t sent = 0;
+	if (IOEventManager::instance().uring_enabled()) {
+		const socket_raw_t fd = internal();
+		while (sent < buffer_size) {
+			int res = co_await await_completion(fd, [&](UringOperation& op) {
+				IOEventManager::instance().submit_send(
+				    fd, (const char*)buffer + sent, buffer_size - sent, op);
+			});
+			if (res > 0) {
+				sent += (size_t)res;
+				continue;
+			}
+			if (res == -EINTR)
+				continue;
+			if (res == -EAGAIN) {
+				if (int err = co_await await_io_event(fd, registered_in, IOEventManager::Event::MONITOR_WRITE)) {
+					errno = err;
+					co_return -1;
+				}
+				continue;
+			}
+			errno = res == 0 ? EPIPE : -res;
+			co_return -1;
+		}
+		co_return buffer_size;
+	}
+
 	while (sent < buffer_size) {
 		ssize_t n = ClientSocket::write((const char*)buffer + sent, buffer_size - sent);
 
@@ -88,8 +778,11 @@ Task<ssize_t> CoroClientSocket::async_write(const void* buffer, size_t buffer_si
 		}
 		if (n <= 0) {
 			if (errno == EAGAIN || errno == EWOULDBLOCK) {
-				co_await await_io_event(internal(),
-				                        IOEventManager::Event::MONITOR_WRITE);
+				if (int err = co_await await_io_event(internal(), registered_in,
+				                                      IOEventManager::Event::MONITOR_WRITE)) {
+					errno = err; // timed out or cancelled
+					co_return -1;
+				}
 				continue;
 			} else {
 				co_return -1; // quit
@@ -99,11 +792,361 @@ Task<ssize_t> CoroClientSocket::async_write(const void* buffer, size_t buffer_si
 	co_return buffer_size;
 }
 
+Task<ssize_t> CoroClientSocket::async_readv(const iovec* iov, int iovcnt) {
+	if (memory) {
+		// a short read is fine, fill the first buffer
+		for (int i = 0; i < iovcnt; i++) {
+			if (iov[i].iov_len > 0)
+				co_return co_await memory->async_read(iov[i].iov_base, iov[i].iov_len);
+		}
+		co_return 0;
+	}
+
+	msghdr msg {};
+	msg.msg_iov = const_cast<iovec*>(iov);
+	msg.msg_iovlen = (std::size_t)iovcnt;
+
+	if (IOEventManager::instance().uring_enabled()) {
+		const socket_raw_t fd = internal();
+		while (true) {
+			// the ring does not report EPOLLERR, the zero-copy completions are taken here
+			if (!zerocopy.holds.empty())
+				zerocopy.reap(fd);
+			int res = co_await await_completion(fd, [&](UringOperation& op) {
+				IOEventManager::instance().submit_recvmsg(fd, &msg, op);
+			});
+			if (res >= 0)
+				co_return res;
+			if (res == -EINTR)
+				continue;
+			if (res == -EAGAIN) {
+				if (int err = co_await await_io_event(fd, registered_in, IOEventManager::Event::MONITOR_READ)) {
+					errno = err;
+					co_return -1;
+				}
+				continue;
+			}
+			errno = -res;
+			co_return -1;
+		}
+	}
+
+	while (true) {
+		ssize_t n = ::recvmsg(internal(), &msg, 0);
+		if (n >= 0)
+			co_return n;
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			co_return -1;
+		if (!zerocopy.holds.empty())
+			zerocopy.reap(internal());
+		if (int err = co_await await_io_event(internal(), registered_in,
+		                                      IOEventManager::Event::MONITOR_READ)) {
+			errno = err; // timed out or cancelled
+			co_return -1;
+		}
+	}
+}
+
+Task<ssize_t> CoroClientSocket::async_writev(const iovec* iov, int iovcnt) {
+	std::size_t total = 0;
+	for (int i = 0; i < iovcnt; i++)
+		total += iov[i].iov_len;
+
+	if (memory) {
+		for (int i = 0; i < iovcnt; i++) {
+			if (iov[i].iov_len > 0 && co_await memory->async_write(iov[i].iov_base, iov[i].iov_len) < 0)
+				co_return -1;
+		}
+		co_return total;
+	}
+
+	IovCursor cursor { iov, iovcnt };
+	if (IOEventManager::instance().uring_enabled()) {
+		const socket_raw_t fd = internal();
+		while (!cursor.done()) {
+			msghdr* msg = cursor.next();
+			int res = co_await await_completion(fd, [&](UringOperation& op) {
+				IOEventManager::instance().submit_sendmsg(fd, msg, op);
+			});
+			if (res > 0) {
+				cursor.advance((std::size_t)res);
+				continue;
+			}
+			if (res == -EINTR)
+				continue;
+			if (res == -EAGAIN) {
+				if (int err = co_await await_io_event(fd, registered_in, IOEventManager::Event::MONITOR_WRITE)) {
+					errno = err;
+					co_return -1;
+				}
+				continue;
+			}
+			errno = res == 0 ? EPIPE : -res;
+			co_return -1;
+		}
+		co_return total;
+	}
+
+	while (!cursor.done()) {
+		ssize_t n = ::sendmsg(internal(), cursor.next(), MSG_NOSIGNAL);
+		if (n > 0) {
+			cursor.advance((std::size_t)n);
+			continue;
+		}
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			if (int err = co_await await_io_event(internal(), registered_in,
+			                                      IOEventManager::Event::MONITOR_WRITE)) {
+				errno = err; // timed out or cancelled
+				co_return -1;
+			}
+			continue;
+		}
+		co_return -1; // quit
+	}
+	co_return total;
+}
+
+bool CoroClientSocket::set_zerocopy(std::size_t threshold) noexcept {
+	if (threshold && !zerocopy_enabled) {
+		int on = 1;
+		if (memory || ::setsockopt(internal(), SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) != 0)
+			return false;
+		zerocopy_enabled = true;
+	}
+	zerocopy_threshold = threshold;
+	return true;
+}
+
+bool CoroClientSocket::ZerocopyState::reap(socket_raw_t fd) noexcept {
+	bool reaped = false;
+	while (true) {
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err)) * 2];
+		msghdr msg {};
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+			if (errno == EINTR)
+				continue;
+			return reaped; // EAGAIN: nothing queued
+		}
+		for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+			    && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+				continue;
+			const auto* err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+			if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY || err->ee_errno != 0)
+				continue;
+			// the sends ee_info..ee_data are done, the kernel merges the ranges
+			std::uint32_t count = err->ee_data - err->ee_info + 1;
+			done += count;
+			if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				copied += count;
+			reaped = true;
+		}
+		// the counters wrap, compared as a distance
+		while (!holds.empty() && (std::int32_t)(done - holds.front().until) >= 0)
+			holds.pop_front();
+	}
+}
+
+Task<ssize_t> CoroClientSocket::async_write_zerocopy(std::shared_ptr<const void> owner, const void* buffer,
+                                                      size_t buffer_size) {
+	const iovec whole { const_cast<void*>(buffer), buffer_size };
+	co_return co_await async_writev_zerocopy(std::move(owner), &whole, 1);
+}
+
+Task<ssize_t> CoroClientSocket::async_writev_zerocopy(std::shared_ptr<const void> owner, const iovec* iov,
+                                                       int iovcnt) {
+	std::size_t total = 0;
+	for (int i = 0; i < iovcnt; i++)
+		total += iov[i].iov_len;
+	if (!zerocopy_threshold || total < zerocopy_threshold)
+		co_return co_await async_writev(iov, iovcnt);
+
+	// readiness and syscalls on both backends, the error queue is not in the ring
+	if (!zerocopy.holds.empty())
+		zerocopy.reap(internal());
+	IovCursor cursor { iov, iovcnt };
+	const std::uint32_t sent_before = zerocopy.sent;
+	int flags = MSG_ZEROCOPY | MSG_NOSIGNAL;
+	ssize_t result = (ssize_t)total;
+	while (!cursor.done()) {
+		ssize_t n = ::sendmsg(internal(), cursor.next(), flags);
+		if (n > 0) {
+			if (flags & MSG_ZEROCOPY)
+				zerocopy.sent++;
+			cursor.advance((std::size_t)n);
+			continue;
+		}
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+			// over optmem_max with the sends in flight: wait for some of
+			// them to complete, or copy the rest if none is in flight
+			if (zerocopy.reap(internal()))
+				continue;
+			if (zerocopy.done == zerocopy.sent) {
+				flags &= ~MSG_ZEROCOPY;
+				continue;
+			}
+		} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			zerocopy.reap(internal()); // keep the error queue short
+		} else {
+			result = -1; // quit, what was sent already stays pinned
+			break;
+		}
+		// the error queue raises EPOLLERR, which wakes the writer too
+		if (int err = co_await await_io_event(internal(), registered_in,
+		                                      IOEventManager::Event::MONITOR_WRITE)) {
+			errno = err; // timed out or cancelled
+			result = -1;
+			break;
+		}
+	}
+
+	// the pages are read by the kernel after we return, owner goes with them
+	if (zerocopy.sent != sent_before) {
+		const int saved = errno;
+		zerocopy.holds.push_back({ zerocopy.sent, std::move(owner) });
+		zerocopy.reap(internal());
+		errno = saved;
+	}
+	co_return result;
+}
+
+Task<ssize_t> CoroClientSocket::async_sendfile(int file_fd, off_t offset, size_t length) {
+	if (memory) {
+		// no kernel below, copy through a buffer
+		char buffer[16 * 1024];
+		size_t sent = 0;
+		while (sent < length) {
+			ssize_t n = ::pread(file_fd, buffer, std::min(sizeof(buffer), length - sent), offset + (off_t)sent);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				co_return -1;
+			if (n == 0 || co_await memory->async_write(buffer, (size_t)n) < 0)
+				break;
+			sent += (size_t)n;
+		}
+		co_return sent;
+	}
+
+	size_t sent = 0;
+	while (sent < length) {
+		off_t at = offset + (off_t)sent;
+		ssize_t n = ::sendfile(internal(), file_fd, &at, length - sent);
+		if (n > 0) {
+			sent += (size_t)n;
+			continue;
+		}
+		if (n == 0)
+			break; // the file is shorter
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			co_return -1;
+		if (int err = co_await await_io_event(internal(), registered_in,
+		                                      IOEventManager::Event::MONITOR_WRITE)) {
+			errno = err; // timed out or cancelled
+			co_return -1;
+		}
+	}
+	co_return sent;
+}
+
+Task<ssize_t> CoroClientSocket::async_splice_to(int pipe_fd, size_t length) {
+	if (memory) {
+		errno = EINVAL; // nothing to splice from
+		co_return -1;
+	}
+
+	PipeRegistration pipe { pipe_fd };
+	while (true) {
+		ssize_t n = ::splice(internal(), nullptr, pipe_fd, nullptr, length, SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
+		if (n >= 0)
+			co_return n;
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			co_return -1;
+		// either side may be the one not ready
+		int err = fd_ready(pipe_fd, POLLOUT)
+		    ? co_await await_io_event(internal(), registered_in, IOEventManager::Event::MONITOR_READ)
+		    : co_await await_io_event(pipe_fd, pipe.registered_in, IOEventManager::Event::MONITOR_WRITE);
+		if (err) {
+			errno = err; // timed out or cancelled
+			co_return -1;
+		}
+	}
+}
+
+Task<ssize_t> CoroClientSocket::async_splice_from(int pipe_fd, size_t length) {
+	if (memory) {
+		errno = EINVAL; // nothing to splice to
+		co_return -1;
+	}
+
+	PipeRegistration pipe { pipe_fd };
+	size_t moved = 0;
+	while (moved < length) {
+		ssize_t n = ::splice(pipe_fd, nullptr, internal(), nullptr, length - moved,
+		                     SPLICE_F_NONBLOCK | SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (n > 0) {
+			moved += (size_t)n;
+			continue;
+		}
+		if (n == 0)
+			break; // the write end is closed
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			co_return -1;
+		int err = fd_ready(pipe_fd, POLLIN)
+		    ? co_await await_io_event(internal(), registered_in, IOEventManager::Event::MONITOR_WRITE)
+		    : co_await await_io_event(pipe_fd, pipe.registered_in, IOEventManager::Event::MONITOR_READ);
+		if (err) {
+			errno = err; // timed out or cancelled
+			co_return -1;
+		}
+	}
+	co_return moved;
+}
+
 Task<void> CoroServerSocket::__accept_loop(
     async_client_comming_callback_t callback) {
+	SpareFd spare;
+	std::shared_ptr<ConnectionGate> gate;
+	if (max_connections > 0)
+		gate = std::make_shared<ConnectionGate>(max_connections, resume_below);
+
+	std::vector<std::shared_ptr<CoroClientSocket>> batch;
+	batch.reserve(ACCEPT_BATCH);
 	while (true) {
-		auto client_socket = co_await __async_accept();
-		Scheduler::instance().spawn(callback(client_socket));
+		if (gate && gate->full()) {
+			// the newcomers wait in the backlog meanwhile
+			__pause_accept();
+			co_await gate->drained();
+			continue;
+		}
+
+		std::size_t room = gate ? std::min(ACCEPT_BATCH, gate->room()) : ACCEPT_BATCH;
+		bool listening = co_await __accept_batch(batch, room, spare);
+		for (auto& client : batch) {
+			if (gate) {
+				gate->enter();
+				Scheduler::spawn(serve_admitted(callback, std::move(client), gate));
+			} else {
+				Scheduler::spawn(callback(std::move(client)));
+			}
+		}
+		batch.clear();
+		if (!listening)
+			co_return;
 	}
 }
 
@@ -113,4 +1156,45 @@ void CoroServerSocket::run_server(async_client_comming_callback_t callback) {
 	    std::move(__accept_loop(callback)));
 	Scheduler::run();
 }
+
+void CoroServerSocket::run_server(
+    async_client_comming_callback_t callback, std::size_t workers, ExecutorMode mode) {
+	if (workers <= 1) {
+		run_server(callback);
+		return;
+	}
+
+	// setup all the listeners here, so the bind errors comes to the caller
+	ServerSocket::listen(Sync::ASync, true);
+	std::vector<CoroServerSocket> shards;
+	shards.reserve(workers - 1);
+	for (std::size_t i = 1; i < workers; i++) {
+		shards.emplace_back(dump_address());
+		shards.back().set_connection_limit(max_connections, resume_below);
+		// no SO_REUSEPORT for a path, the loops share the one listener
+		if (dump_address().family == AddressFamily::Unix)
+			shards.back().ServerSocket::listen_on(*this);
+		else
+			shards.back().ServerSocket::listen(Sync::ASync, true);
+	}
+
+	// each thread picks its own thread local Scheduler and IOEventManager
+	WorkStealingGroup group { workers };
+	const bool stealing = mode == ExecutorMode::WorkStealing;
+	std::vector<std::jthread> threads;
+	threads.reserve(shards.size());
+	for (auto& shard : shards) {
+		threads.emplace_back([&shard, &group, stealing, callback]() {
+			if (stealing)
+				Scheduler::join_group(group);
+			Scheduler::spawn(shard.__accept_loop(callback));
+			Scheduler::run();
+		});
+	}
+
+	if (stealing)
+		Scheduler::join_group(group);
+	Scheduler::spawn(__accept_loop(callback));
+	Scheduler::run();
+}
 }
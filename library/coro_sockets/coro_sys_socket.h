@@ -1,25 +1,187 @@
 #pragma once
 #include "Task.hpp"
+#include "memory_stream.hpp"
 #include "socket_address.h"
 #include "sys_socket.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <sys/uio.h>
+#include <vector>
+
+class IOEventManager;
 
 namespace CNetUtils {
+struct UringAcceptQueue;
+
 class CoroClientSocket : private ClientSocket {
 public:
 	friend class CoroServerSocket;
 	CoroClientSocket(const socket_raw_t fd)
 	    : ClientSocket(fd) { }
-	~CoroClientSocket() = default;
+	~CoroClientSocket() { close(); }
 	CoroClientSocket(CoroClientSocket&&) = default;
 	CoroClientSocket& operator=(CoroClientSocket&& socket) = default;
 	Task<ssize_t> async_read(void* buffer, size_t buffer_size);
 	Task<ssize_t> async_write(const void* buffer, size_t buffer_size);
 
-	void close() { Socket::close(); }
+	/**
+	 * @brief read into the buffers in order, one syscall (recvmsg)
+	 *
+	 * @param iov must stay valid until done
+	 * @param iovcnt
+	 * @return ssize_t like async_read, the bytes spread over iov
+	 */
+	Task<ssize_t> async_readv(const iovec* iov, int iovcnt);
+
+	/**
+	 * @brief write all the buffers as one stream (sendmsg), a partial
+	 *        write goes on from the middle of its iovec. Headers and body
+	 *        go out together without being copied into one buffer
+	 *
+	 * @param iov must stay valid until done, it is not modified
+	 * @param iovcnt
+	 * @return ssize_t the total size, -1 with errno
+	 */
+	Task<ssize_t> async_writev(const iovec* iov, int iovcnt);
+
+	/**
+	 * @brief send length bytes of a file from offset, the kernel copies
+	 *        them from the page cache (sendfile), nothing passes through
+	 *        user space. Suspends while the socket is full
+	 *
+	 * @param file_fd a regular file, its own offset is not moved
+	 * @param offset
+	 * @param length
+	 * @return ssize_t the bytes sent, short if the file ended first,
+	 *         -1 with errno
+	 */
+	Task<ssize_t> async_sendfile(int file_fd, off_t offset, size_t length);
+
+	/**
+	 * @brief move what the socket received into a pipe (splice), like
+	 *        async_read: up to length, suspends while there is nothing
+	 *        or the pipe is full
+	 *
+	 * @param pipe_fd the write end, O_NONBLOCK
+	 * @param length
+	 * @return ssize_t the bytes moved, 0 once the peer closed, -1 with errno
+	 */
+	Task<ssize_t> async_splice_to(int pipe_fd, size_t length);
+
+	/**
+	 * @brief move length bytes from a pipe to the socket (splice), like
+	 *        async_write: suspends while the pipe is empty or the socket
+	 *        is full
+	 *
+	 * @param pipe_fd the read end, O_NONBLOCK
+	 * @param length
+	 * @return ssize_t the bytes moved, short if the pipe was closed,
+	 *         -1 with errno
+	 */
+	Task<ssize_t> async_splice_from(int pipe_fd, size_t length);
+
+	/**
+	 * @brief send the async_write(v)_zerocopy of at least threshold bytes
+	 *        with MSG_ZEROCOPY: the kernel pins the pages instead of copying
+	 *        them. Below some tens of KB the pinning and the notification
+	 *        cost more than the copy. async_write(v) always copy
+	 *
+	 * @param threshold 0 turns it off
+	 * @return bool false if the socket cannot (no SO_ZEROCOPY, memory or
+	 *         Unix sockets), the writes copy as before
+	 */
+	bool set_zerocopy(std::size_t threshold) noexcept;
+
+	/**
+	 * @brief async_writev handing the buffers over: it returns once they
+	 *        are queued, and owner is kept until the kernel reports their
+	 *        pages released, seen on a later write or read, or past close.
+	 *        Copied as async_writev below the zero-copy threshold, owner is
+	 *        let go then
+	 *
+	 * @param owner keeps the buffers of iov alive, it must not change them
+	 * @param iov
+	 * @param iovcnt
+	 * @return ssize_t the bytes queued, -1 with errno
+	 */
+	Task<ssize_t> async_writev_zerocopy(std::shared_ptr<const void> owner, const iovec* iov, int iovcnt);
+	Task<ssize_t> async_write_zerocopy(std::shared_ptr<const void> owner, const void* buffer, size_t buffer_size);
+
+	/**
+	 * @brief the zero-copy sends the kernel copied anyway (loopback, or a
+	 *        device without scatter-gather), where it gains nothing
+	 *
+	 */
+	std::uint32_t zerocopy_copied() const noexcept { return zerocopy.copied; }
+
+	void close() override;
+
+	/**
+	 * @brief two sockets connected in memory (MemoryStream), no fd behind
+	 *        them: the HTTP reader / writer and the handlers run unchanged,
+	 *        without the kernel. See Scheduler::simulate for the timeouts
+	 *
+	 * @param buffer_size the bytes in flight per direction
+	 */
+	static std::pair<std::shared_ptr<CoroClientSocket>, std::shared_ptr<CoroClientSocket>>
+	memory_pair(std::size_t buffer_size = MemoryStream::DEFAULT_BUFFER);
+
+	/**
+	 * @brief connect to peer, IPv4, IPv6 or Unix, suspends while the
+	 *        connection is in progress
+	 *
+	 * @param peer read before the first suspension only
+	 * @return Task<std::shared_ptr<CoroClientSocket>> nullptr with errno
+	 *         if it failed, ETIMEDOUT / ECANCELED too
+	 */
+	static Task<std::shared_ptr<CoroClientSocket>> async_connect(const FullAddress& peer);
 
 	FullAddress dump_self() const { return ClientSocket::dump_self(); }
 
 private:
+	IOEventManager* registered_in { nullptr }; // whose epoll holds the fd
+	std::shared_ptr<MemoryStream> memory; // set for the memory_pair ones
+	std::size_t zerocopy_threshold { 0 };
+	bool zerocopy_enabled { false }; // SO_ZEROCOPY set on the fd
+
+	/**
+	 * @brief the MSG_ZEROCOPY sends, and the owners of their buffers
+	 *        until the kernel reports the pages released
+	 *
+	 */
+	struct ZerocopyState {
+		struct Hold {
+			std::uint32_t until; // released once this many sends are done
+			std::shared_ptr<const void> owner;
+		};
+
+		std::uint32_t sent { 0 }; // the kernel numbers the sends from 0
+		std::uint32_t done { 0 };
+		std::uint32_t copied { 0 };
+		std::deque<Hold> holds; // in the order they were sent
+
+		/**
+		 * @brief take the completions queued on the error queue of fd,
+		 *        and let the owners they cover go
+		 *
+		 * @return bool false if there was none
+		 */
+		bool reap(socket_raw_t fd) noexcept;
+	};
+	ZerocopyState zerocopy;
+
+	/**
+	 * @brief keep the fd of a closed socket open until the kernel reported
+	 *        the sends still in flight, their owners with it. A peer taking
+	 *        longer than ZEROCOPY_LINGER is reset, the kernel drops the
+	 *        unsent pages then
+	 *
+	 */
+	static Task<void> __linger_zerocopy(socket_raw_t fd, ZerocopyState state);
+	static constexpr const auto ZEROCOPY_LINGER = std::chrono::seconds(30);
+
 	CoroClientSocket(const CoroClientSocket&) = delete;
 	CoroClientSocket& operator=(const CoroClientSocket&) = delete;
 };
@@ -35,8 +197,36 @@ public:
 	CoroServerSocket(ServerAddress&& addr)
 	    : ServerSocket(std::move(addr)) { }
 
+	static constexpr const std::size_t ACCEPT_BATCH = 64; // accepted per wakeup at most
+
 	void run_server(async_client_comming_callback_t callback);
 
+	/**
+	 * @brief serve at most max connections at once per event loop: beyond
+	 *        it the listener is taken off the loop, the new connections
+	 *        wait in the backlog, and accepting resumes once the served
+	 *        ones drop to resume_below. Call it before run_server
+	 *
+	 * @param max 0 lifts the limit
+	 * @param resume_below the low watermark, 0 means 3/4 of max
+	 */
+	void set_connection_limit(std::size_t max, std::size_t resume_below = 0) noexcept;
+
+	/**
+	 * @brief run the server on `workers` event loops, each worker is a thread
+	 *        with its own Scheduler, epoll instance and SO_REUSEPORT listener,
+	 *        the kernel spreads the incoming connections among them.
+	 *        The calling thread serves as the first worker.
+	 * @exception BindError/ListenError: any of the listeners failed to setup
+	 *
+	 * @param callback
+	 * @param workers how many event loops to run, 0 or 1 means single loop
+	 * @param mode WorkStealing lets the idle loops take the ready coroutines
+	 *        of the busy ones, useful when a few connections are heavy
+	 */
+	void run_server(async_client_comming_callback_t callback, std::size_t workers,
+	                ExecutorMode mode = ExecutorMode::ThreadPerCore);
+
 	CNETUTILS_FORCEINLINE ServerAddress
 	dump_address() const noexcept { return ServerSocket::dump_address(); }
 
@@ -44,8 +234,44 @@ public:
 	void close() { Socket::close(); }
 
 private:
-	std::shared_ptr<CoroClientSocket> accept() const;
-	Task<std::shared_ptr<CoroClientSocket>> __async_accept();
+	struct SpareFd;
+
+	/**
+	 * @brief the multishot accept may still be armed in the ring,
+	 *        the queue is released once the kernel drops it
+	 *
+	 */
+	struct AcceptQueueDeleter {
+		void operator()(UringAcceptQueue* queue) const noexcept;
+	};
+	std::unique_ptr<UringAcceptQueue, AcceptQueueDeleter> accept_queue;
+	IOEventManager* registered_in { nullptr }; // whose epoll holds the fd
+	std::size_t max_connections { 0 };
+	std::size_t resume_below { 0 };
+
+	/**
+	 * @brief accept4 once
+	 *
+	 * @return int the fd, or -errno
+	 */
+	int accept(sockaddr_storage& peer, socklen_t& peer_len) const;
+
+	/**
+	 * @brief accept up to max connections, what is pending right now,
+	 *        suspends only while nothing is
+	 *
+	 * @return Task<bool> false once the listener is broken
+	 */
+	Task<bool> __accept_batch(std::vector<std::shared_ptr<CoroClientSocket>>& out,
+	                          std::size_t max, SpareFd& spare);
+
+	/**
+	 * @brief stop the kernel from waking us for the listener: the pending
+	 *        multishot accept is cancelled, or the fd leaves the epoll set.
+	 *        The next wait arms it again
+	 *
+	 */
+	void __pause_accept() noexcept;
 	Task<void> __accept_loop(async_client_comming_callback_t callback);
 
 	CoroServerSocket() = delete;
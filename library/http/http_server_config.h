@@ -18,6 +18,7 @@ namespace http {
 		size_t max_body_bytes = 16_MB; // max body size we'll accept in-memory
 		size_t read_block = 4096;
 		bool default_keep_alive_http11 = true; // HTTP/1.1 default
+		size_t zerocopy_threshold = 0; // moved responses from this body size are sent MSG_ZEROCOPY, 0 never
 
 	private:
 		friend class ServerConfigBuilder;
@@ -83,6 +84,20 @@ namespace http {
 			return *this;
 		}
 
+		/**
+		 * @brief Sets the body size from which the kernel sends the pages
+		 *        without copying them (MSG_ZEROCOPY), 0 turns it off. The
+		 *        kernel reads them after the write returned, so the buffer
+		 *        must stay alive and unchanged until it reports them
+		 *        released: only the responses moved into
+		 *        HttpWriter::write_response, which keeps them until then,
+		 *        are sent this way. Worth it from about 64KB, on a real NIC only
+		 */
+		ServerConfigBuilder& setZerocopyThreshold(size_t threshold) {
+			config_.zerocopy_threshold = threshold;
+			return *this;
+		}
+
 		/**
 		 * @brief Builds and returns the final ServerConfig object.
 		 * @return ServerConfig The configured instance.
@@ -1,10 +1,131 @@
 #include "socket_address.h"
+#include <arpa/inet.h>
+#include <cstddef>
+#include <cstring>
 #include <format>
+#include <netinet/in.h>
+#include <sys/un.h>
+
+namespace {
+using CNetUtils::AddressFamily;
+using CNetUtils::netport_t;
+
+socklen_t fill_inet(sockaddr_storage& out, AddressFamily family, const std::string& host, netport_t port) {
+	out = {};
+	if (family == AddressFamily::IPv6) {
+		auto& addr = reinterpret_cast<sockaddr_in6&>(out);
+		addr.sin6_family = AF_INET6;
+		addr.sin6_port = htons(port);
+		addr.sin6_addr = in6addr_any;
+		if (!host.empty() && ::inet_pton(AF_INET6, host.c_str(), &addr.sin6_addr) != 1)
+			return 0;
+		return sizeof(addr);
+	}
+	auto& addr = reinterpret_cast<sockaddr_in&>(out);
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = INADDR_ANY;
+	if (!host.empty() && ::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+		return 0;
+	return sizeof(addr);
+}
+
+socklen_t fill_unix(sockaddr_storage& out, const std::string& path) {
+	out = {};
+	auto& addr = reinterpret_cast<sockaddr_un&>(out);
+	addr.sun_family = AF_UNIX;
+	if (path.empty() || path.size() >= sizeof(addr.sun_path))
+		return 0;
+	std::memcpy(addr.sun_path, path.data(), path.size());
+	if (path[0] == '@') {
+		// abstract: the name is not nul terminated, the length tells its end
+		addr.sun_path[0] = '\0';
+		return (socklen_t)(offsetof(sockaddr_un, sun_path) + path.size());
+	}
+	return (socklen_t)(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+}
+}
+
+CNetUtils::ServerAddress CNetUtils::ServerAddress::ipv6(netport_t port, std::string host, bool dual_stack) {
+	ServerAddress addr { port };
+	addr.family = AddressFamily::IPv6;
+	addr.host = std::move(host);
+	addr.dual_stack = dual_stack;
+	return addr;
+}
+
+CNetUtils::ServerAddress CNetUtils::ServerAddress::unix_socket(std::string path) {
+	ServerAddress addr { 0 };
+	addr.family = AddressFamily::Unix;
+	addr.host = std::move(path);
+	return addr;
+}
 
 std::string CNetUtils::ServerAddress::dump_self() const {
-	return std::format("[localhost: {}]", port);
+	switch (family) {
+	case AddressFamily::Unix:
+		return std::format("[unix: {}]", host);
+	case AddressFamily::IPv6:
+		return std::format("[[{}]: {}]", host.empty() ? "::" : host, port);
+	default:
+		return std::format("[{}: {}]", host.empty() ? "localhost" : host, port);
+	}
+}
+
+socklen_t CNetUtils::ServerAddress::to_sockaddr(sockaddr_storage& out) const {
+	if (family == AddressFamily::Unix)
+		return fill_unix(out, host);
+	return fill_inet(out, family, host, port);
+}
+
+CNetUtils::FullAddress CNetUtils::FullAddress::unix_socket(std::string path) {
+	FullAddress addr { std::move(path), 0 };
+	addr.family = AddressFamily::Unix;
+	return addr;
+}
+
+CNetUtils::FullAddress CNetUtils::FullAddress::from_sockaddr(const sockaddr_storage& addr, socklen_t len) {
+	char ip[INET6_ADDRSTRLEN] {};
+	switch (addr.ss_family) {
+	case AF_INET6: {
+		auto& in6 = reinterpret_cast<const sockaddr_in6&>(addr);
+		::inet_ntop(AF_INET6, &in6.sin6_addr, ip, sizeof(ip));
+		return { ip, ntohs(in6.sin6_port) };
+	}
+	case AF_UNIX: {
+		// the connecting side is mostly unnamed
+		auto& un = reinterpret_cast<const sockaddr_un&>(addr);
+		std::size_t size = len > offsetof(sockaddr_un, sun_path) ? len - offsetof(sockaddr_un, sun_path) : 0;
+		std::string path { un.sun_path, size };
+		if (!path.empty() && path[0] == '\0')
+			path[0] = '@';
+		else if (auto end = path.find('\0'); end != std::string::npos)
+			path.resize(end);
+		return unix_socket(std::move(path));
+	}
+	default: {
+		auto& in = reinterpret_cast<const sockaddr_in&>(addr);
+		::inet_ntop(AF_INET, &in.sin_addr, ip, sizeof(ip));
+		return { ip, ntohs(in.sin_port) };
+	}
+	}
 }
 
 std::string CNetUtils::FullAddress::dump_self() const {
-	return std::format("[{}: {}]", address, port);
-}
\ No newline at end of file
+	switch (family) {
+	case AddressFamily::Unix:
+		return std::format("[unix: {}]", address);
+	case AddressFamily::IPv6:
+		return std::format("[[{}]: {}]", address, port);
+	default:
+		return std::format("[{}: {}]", address, port);
+	}
+}
+
+socklen_t CNetUtils::FullAddress::to_sockaddr(sockaddr_storage& out) const {
+	if (family == AddressFamily::Unix)
+		return fill_unix(out, address);
+	if (address.empty())
+		return 0; // no "any" peer
+	return fill_inet(out, family, address, port);
+}
@@ -1,30 +1,90 @@
 #pragma once
 #include <string>
+#include <sys/socket.h>
 namespace CNetUtils {
 using netport_t = unsigned short;
 
+enum class AddressFamily {
+	IPv4,
+	IPv6,
+	Unix // stream sockets on a path, or in the abstract namespace
+};
+
 struct SocketAddress {
 	virtual ~SocketAddress() = default;
 	virtual std::string dump_self() const = 0;
+
+	/**
+	 * @brief fill the sockaddr for bind() / connect()
+	 *
+	 * @param out
+	 * @return socklen_t the length used, 0 if the address does not parse
+	 */
+	virtual socklen_t to_sockaddr(sockaddr_storage& out) const = 0;
 };
 
 struct ServerAddress : public SocketAddress {
 	netport_t port;
+	AddressFamily family { AddressFamily::IPv4 };
+	std::string host; // the address to bind, empty for any. The path for Unix
+	bool dual_stack { true }; // IPv6 only: accept the IPv4 clients too
+
+	// any IPv4 address
 	ServerAddress(const netport_t port)
 	    : port(port) { }
+
+	/**
+	 * @brief listen on IPv6, host empty means [::]. With dual_stack the
+	 *        IPv4 clients come in as ::ffff:a.b.c.d
+	 *
+	 */
+	static ServerAddress ipv6(netport_t port, std::string host = "", bool dual_stack = true);
+
+	/**
+	 * @brief listen on a Unix stream socket, a leading '@' puts it in the
+	 *        abstract namespace (no file, gone with the process)
+	 *
+	 */
+	static ServerAddress unix_socket(std::string path);
+
 	std::string dump_self() const override;
+	socklen_t to_sockaddr(sockaddr_storage& out) const override;
 };
 
 struct FullAddress : public SocketAddress {
 	std::string address;
 	netport_t port;
+	AddressFamily family { AddressFamily::IPv4 };
+
+	// the family follows ip, IPv6 if it has a ':'
 	FullAddress(const std::string& ip, netport_t port)
 	    : address(ip)
-	    , port(port) { }
+	    , port(port)
+	    , family(family_of(address)) { }
 	FullAddress(std::string&& ip, netport_t port)
 	    : address(std::move(ip))
-	    , port(port) { }
+	    , port(port)
+	    , family(family_of(address)) { }
+
+	/**
+	 * @brief a Unix stream socket, a leading '@' for the abstract namespace
+	 *
+	 */
+	static FullAddress unix_socket(std::string path);
+
+	/**
+	 * @brief from what accept() / getpeername() gave
+	 *
+	 */
+	static FullAddress from_sockaddr(const sockaddr_storage& addr, socklen_t len);
+
 	std::string dump_self() const override;
+	socklen_t to_sockaddr(sockaddr_storage& out) const override;
+
+private:
+	static AddressFamily family_of(const std::string& ip) noexcept {
+		return ip.find(':') != std::string::npos ? AddressFamily::IPv6 : AddressFamily::IPv4;
+	}
 };
 
 }
@@ -1,9 +1,12 @@
 #include "sys_socket.h"
 #include "socket_exception.hpp"
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <memory>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 namespace CNetUtils {
@@ -68,22 +71,25 @@ ClientSocket::~ClientSocket() {
 }
 
 void ClientSocket::close() {
-	auto cli_addr = reinterpret_cast<sockaddr_in*>(client_handle);
-	delete cli_addr;
+	peer_len = 0;
 	Socket::close();
 }
 
-void ClientSocket::set_internal_data(void* datas) {
-	client_handle = new sockaddr_in(*reinterpret_cast<sockaddr_in*>(datas));
+void ClientSocket::set_peer(const sockaddr_storage& addr, socklen_t len) noexcept {
+	peer = addr;
+	peer_len = len;
 } // set the internal datas
 
 FullAddress ClientSocket::dump_self() const {
-	char ip[INET_ADDRSTRLEN];
+	if (peer_len > 0)
+		return FullAddress::from_sockaddr(peer, peer_len);
 
-	auto cli_addr = reinterpret_cast<sockaddr_in*>(client_handle);
-	inet_ntop(AF_INET, &cli_addr->sin_addr, ip, sizeof(ip));
-
-	return { ip, ntohs(cli_addr->sin_port) };
+	// the sockets accepted by io_uring come without the peer address
+	sockaddr_storage fetched {};
+	socklen_t fetched_len = sizeof(fetched);
+	if (::getpeername(socket_fd, reinterpret_cast<sockaddr*>(&fetched), &fetched_len) != 0)
+		throw SocketException("getpeername failed", errno);
+	return FullAddress::from_sockaddr(fetched, fetched_len);
 }
 
 /* ------------------- ServerSocket --------------------- */
@@ -108,39 +114,87 @@ ServerSocket::ServerSocket(ServerSocket&& socket)
 	socket.socket_fd = INVALID_FD;
 }
 
-void ServerSocket::listen(Sync isSync) {
+void ServerSocket::listen(Sync isSync, bool reuse_port) {
 	int flags = SOCK_CLOEXEC | SOCK_STREAM;
 	if (isSync == Sync::ASync) {
 		flags |= SOCK_NONBLOCK;
 	}
-	int listen_fd = ::socket(AF_INET, flags, 0);
+	sockaddr_storage addr {};
+	socklen_t addr_len = server_addr.to_sockaddr(addr);
+	if (addr_len == 0)
+		throw BindError("Can not bind the socket!", EINVAL);
+
+	int listen_fd = ::socket(addr.ss_family, flags, 0);
 	if (listen_fd < 0)
 		throw CreateError("Create failed!", errno);
 
 	int opt = 1;
-	if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
-		throw SocketException("setsockopt(SO_REUSEADDR) failed");
+	if (server_addr.family == AddressFamily::Unix) {
+		// a socket file left by a previous run, never any other file
+		struct stat st {};
+		const std::string& path = server_addr.host;
+		if (path[0] != '@' && ::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+			::unlink(path.c_str());
+	} else {
+		if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+			::close(listen_fd);
+			throw SocketException("setsockopt(SO_REUSEADDR) failed");
+		}
+
+		if (reuse_port
+		    && setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+			::close(listen_fd);
+			throw SocketException("setsockopt(SO_REUSEPORT) failed", errno);
+		}
+	}
 
-	sockaddr_in addr {};
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons(server_addr.port);
-	addr.sin_addr.s_addr = INADDR_ANY;
+	if (server_addr.family == AddressFamily::IPv6) {
+		int v6only = server_addr.dual_stack ? 0 : 1;
+		if (setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) < 0) {
+			::close(listen_fd);
+			throw SocketException("setsockopt(IPV6_V6ONLY) failed", errno);
+		}
+	}
 
-	if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
-		throw BindError("Can not bind the socket!", errno);
+	if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), addr_len) != 0) {
+		int err = errno;
+		::close(listen_fd);
+		throw BindError("Can not bind the socket!", err);
+	}
 
-	if (::listen(listen_fd, SOMAXCONN) != 0)
-		throw ListenError("Can not listen", errno);
+	if (::listen(listen_fd, SOMAXCONN) != 0) {
+		int err = errno;
+		::close(listen_fd);
+		throw ListenError("Can not listen", err);
+	}
+
+	if (server_addr.family != AddressFamily::Unix && server_addr.port == 0) {
+		// an ephemeral port: keep the one the kernel picked, so the
+		// SO_REUSEPORT siblings bind that same port
+		socklen_t bound_len = sizeof(addr);
+		if (::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &bound_len) == 0)
+			server_addr.port = ntohs(addr.ss_family == AF_INET6
+			                             ? reinterpret_cast<sockaddr_in6&>(addr).sin6_port
+			                             : reinterpret_cast<sockaddr_in&>(addr).sin_port);
+	}
 
 	this->isSync = isSync;
 	socket_fd = listen_fd;
 }
 
+void ServerSocket::listen_on(const ServerSocket& listening) {
+	int listen_fd = ::fcntl(listening.socket_fd, F_DUPFD_CLOEXEC, 0);
+	if (listen_fd < 0)
+		throw CreateError("Create failed!", errno);
+	this->isSync = listening.isSync;
+	socket_fd = listen_fd;
+}
+
 std::shared_ptr<ClientSocket> ServerSocket::accept(Sync isSync) const {
 	if (!is_valid())
 		throw SocketException("Invalid Socket Handle");
 
-	sockaddr_in cli {};
+	sockaddr_storage cli {};
 	socklen_t cli_len = sizeof(cli);
 
 	int flags = SOCK_CLOEXEC;
@@ -157,7 +211,7 @@ std::shared_ptr<ClientSocket> ServerSocket::accept(Sync isSync) const {
 	}
 
 	auto result = std::make_shared<ClientSocket>(fd);
-	result->set_internal_data(&cli);
+	result->set_peer(cli, cli_len);
 	result->isSync = isSync;
 	return result;
 }
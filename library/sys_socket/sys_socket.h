@@ -71,13 +71,19 @@ public:
 
 	Sync sync() const { return isSync; }
 
+	/**
+	 * @brief the peer address
+	 * @exception SocketException: getpeername failed
+	 *
+	 */
 	FullAddress dump_self() const;
 	void close() override;
 
 private:
 	Sync isSync;
-	void* client_handle { nullptr };
-	void set_internal_data(void* datas); // set the internal datas
+	sockaddr_storage peer {}; // as accept() gave it, any family
+	socklen_t peer_len { 0 }; // 0: not known, fetched by dump_self()
+	void set_peer(const sockaddr_storage& addr, socklen_t len) noexcept; // set the internal datas
 
 private:
 	ClientSocket(const ClientSocket& client) = delete;
@@ -106,8 +112,23 @@ public:
 	 * @exception CreateException: failed to setup a socket
 	 * @exception BindError: failed to bind a socket
 	 * @exception ListenError: failed to listen a socket
+	 *
+	 * @param isSync
+	 * @param reuse_port set SO_REUSEPORT, so several listeners can bind the
+	 *        same port and the kernel spreads the connections among them.
+	 *        Ignored for the Unix sockets, see listen_on()
+	 *        With the port 0 the kernel picks one, dump_address() tells it
+	 */
+	void listen(Sync isSync = Sync::ASync, bool reuse_port = false);
+
+	/**
+	 * @brief listen on the socket of a listening server (a dup of its fd),
+	 *        for the addresses SO_REUSEPORT can not share, the Unix ones
+	 * @exception CreateException: failed to dup the socket
+	 *
+	 * @param listening
 	 */
-	void listen(Sync isSync = Sync::ASync);
+	void listen_on(const ServerSocket& listening);
 
 	/**
 	 * @brief accept sync a socket passively
@@ -0,0 +1,26 @@
+#pragma once
+
+/**
+ * @brief ThreadLocalInstance hands out one instance per thread, so
+ *        every worker thread owns a private copy (its own event loop)
+ *
+ * @tparam ThreadLocalInstanceType
+ */
+template <typename ThreadLocalInstanceType>
+class ThreadLocalInstance {
+public:
+	static ThreadLocalInstanceType& instance() {
+		static thread_local ThreadLocalInstanceType instance;
+		return instance;
+	}
+
+protected:
+	ThreadLocalInstance() = default;
+	virtual ~ThreadLocalInstance() = default;
+
+private:
+	ThreadLocalInstance(const ThreadLocalInstance&) = delete;
+	ThreadLocalInstance& operator=(const ThreadLocalInstance&) = delete;
+	ThreadLocalInstance(ThreadLocalInstance&&) = delete;
+	ThreadLocalInstance& operator=(ThreadLocalInstance&&) = delete;
+};
@@ -1,40 +1,156 @@
 #include "IOEventMonitor.h"
 #include "IOEvent_Exception.hpp"
+#include <atomic>
 #include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <string_view>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
+namespace {
+using Backend = IOEventManager::Backend;
+
+constexpr const int NO_BACKEND_OVERRIDE = -1;
+std::atomic<int> backend_override { NO_BACKEND_OVERRIDE };
+std::atomic<bool> multishot_refused { false };
+
+Backend environment_backend() noexcept {
+	if (const char* env = std::getenv("CNETUTILS_IO_BACKEND")) {
+		std::string_view name { env };
+		if (name == "io_uring")
+			return Backend::IoUring;
+		if (name == "epoll")
+			return Backend::Epoll;
+	}
+#ifdef CNETUTILS_DEFAULT_IO_URING
+	return Backend::IoUring;
+#else
+	return Backend::Epoll;
+#endif
+}
+}
+
+void IOEventManager::prefer_backend(Backend backend) noexcept {
+	backend_override.store((int)backend, std::memory_order_relaxed);
+}
+
+void IOEventManager::refuse_multishot_accept(bool refuse) noexcept {
+	multishot_refused.store(refuse, std::memory_order_relaxed);
+}
+
+IOEventManager::Backend IOEventManager::preferred_backend() noexcept {
+	int backend = backend_override.load(std::memory_order_relaxed);
+	if (backend != NO_BACKEND_OVERRIDE)
+		return (Backend)backend;
+	static const Backend from_environment = environment_backend();
+	return from_environment;
+}
+
 IOEventManager::IOEventManager() {
 	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
 	if (epoll_fd < 0) {
 		throw EpollCreateError("epoll_create1 failed", errno);
 	}
+
+	// level triggered, it stays readable until the poll reads it
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wake_fd < 0) {
+		int err = errno;
+		close(epoll_fd);
+		throw EpollCreateError("eventfd failed", err);
+	}
+	epoll_event wake_ev {};
+	wake_ev.events = EPOLLIN;
+	wake_ev.data.fd = wake_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &wake_ev) != 0) {
+		int err = errno;
+		close(wake_fd);
+		close(epoll_fd);
+		throw EpollCtlError("epoll_ctl ADD eventfd failed", err);
+	}
+
+	// the sleepers' deadline, so the poll itself never rounds to milliseconds
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer_fd < 0) {
+		int err = errno;
+		close(wake_fd);
+		close(epoll_fd);
+		throw EpollCreateError("timerfd_create failed", err);
+	}
+	epoll_event timer_ev {};
+	timer_ev.events = EPOLLIN;
+	timer_ev.data.fd = timer_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer_ev) != 0) {
+		int err = errno;
+		close(timer_fd);
+		close(wake_fd);
+		close(epoll_fd);
+		throw EpollCtlError("epoll_ctl ADD timerfd failed", err);
+	}
+
+#ifdef CNETUTILS_IO_URING
+	if (preferred_backend() == Backend::IoUring) {
+		try {
+			ring = std::make_unique<IOUring>(RING_ENTRIES);
+		} catch (const IOUringError&) {
+			// seccomp'd containers and old kernels, stay on epoll
+			ring.reset();
+		}
+	}
+	if (ring) {
+		// level triggered, the ring fd stays readable while CQEs are pending
+		epoll_event ev {};
+		ev.events = EPOLLIN;
+		ev.data.fd = ring->fd();
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ring->fd(), &ev) != 0) {
+			int err = errno;
+			close(timer_fd);
+			close(wake_fd);
+			close(epoll_fd);
+			throw EpollCtlError("epoll_ctl ADD io_uring fd failed", err);
+		}
+	}
+#endif
 }
 
 IOEventManager::~IOEventManager() {
+	if (timer_fd >= 0)
+		close(timer_fd);
+	if (wake_fd >= 0)
+		close(wake_fd);
 	if (epoll_fd >= 0)
 		close(epoll_fd);
 }
 
-void IOEventManager::add_waiter(int fd, Event events, std::coroutine_handle<> h) {
+void IOEventManager::notify() noexcept {
+	// EAGAIN means the counter is saturated, the poll wakes up anyway
+	eventfd_write(wake_fd, 1);
+}
+
+void IOEventManager::arm_timer(std::chrono::steady_clock::time_point deadline) noexcept {
+	if (deadline == timer_deadline)
+		return;
+	// steady_clock is CLOCK_MONOTONIC, so the deadline is armed as is
+	auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch());
+	itimerspec spec {};
+	spec.it_value.tv_sec = (time_t)(since_epoch.count() / 1'000'000'000);
+	spec.it_value.tv_nsec = (long)(since_epoch.count() % 1'000'000'000);
+	if (spec.it_value.tv_sec <= 0 && spec.it_value.tv_nsec <= 0)
+		spec.it_value.tv_nsec = 1; // all zero would disarm it
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr) == 0)
+		timer_deadline = deadline;
+}
+
+void IOEventManager::register_fd(int fd) {
 	if (fd < 0) {
-		throw InvalidFDException("Attempted to add waiter for invalid FD");
-	}
-	uint32_t __adapt = 0;
-	switch (events) {
-	case Event::MONITOR_READ:
-		__adapt = EPOLLIN;
-		break;
-	case Event::MONITOR_WRITE:
-		__adapt = EPOLLOUT;
-		break;
-	default:
-		throw EpollUnsupportiveEvent("Unsupported operations");
+		throw InvalidFDException("Attempted to register invalid FD");
 	}
-
-	uint32_t new_events = __adapt | EPOLLET;
 	epoll_event ev {};
-	ev.events = new_events;
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
 	ev.data.fd = fd;
 
 	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
@@ -47,37 +163,274 @@ void IOEventManager::add_waiter(int fd, Event events, std::coroutine_handle<> h)
 		}
 	}
 
-	table[fd] = Waiter { new_events, h };
+	FdSlot& slot = table[fd];
+	if (slot.reader)
+		waiting_count--;
+	if (slot.writer)
+		waiting_count--;
+	slot = FdSlot {};
+	slot.registered = true;
 }
 
-void IOEventManager::remove_waiter(int fd) {
-	auto it = table.find(fd);
-	if (it == table.end())
+void IOEventManager::deregister_fd(int fd) noexcept {
+	FdSlot* slot = table.find(fd);
+	if (!slot)
 		return;
+	if (slot->reader)
+		waiting_count--;
+	if (slot->writer)
+		waiting_count--;
+	*slot = FdSlot {};
+}
+
+void IOEventManager::unwatch_fd(int fd) noexcept {
+	// ENOENT once it was taken out already, nothing left to do then
 	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
-	table.erase(it);
+	deregister_fd(fd);
+}
+
+bool IOEventManager::add_waiter(int fd, Event events, std::coroutine_handle<> h) {
+	if (fd < 0) {
+		throw InvalidFDException("Attempted to add waiter for invalid FD");
+	}
+	if (events != Event::MONITOR_READ && events != Event::MONITOR_WRITE) {
+		throw EpollUnsupportiveEvent("Unsupported operations");
+	}
+
+	FdSlot* found = table.find(fd);
+	if (!found || !found->registered) {
+		register_fd(fd);
+		found = table.find(fd);
+	}
+
+	FdSlot& slot = *found;
+	const bool reading = events == Event::MONITOR_READ;
+	bool& ready = reading ? slot.read_ready : slot.write_ready;
+	if (ready) {
+		ready = false;
+		return false;
+	}
+
+	std::coroutine_handle<>& waiter = reading ? slot.reader : slot.writer;
+	if (!waiter)
+		waiting_count++;
+	waiter = h;
+	return true;
+}
+
+void IOEventManager::remove_waiter(int fd) {
+	FdSlot* slot = table.find(fd);
+	if (!slot)
+		return;
+	if (slot->reader)
+		waiting_count--;
+	if (slot->writer)
+		waiting_count--;
+	slot->reader = nullptr;
+	slot->writer = nullptr;
+}
+
+std::coroutine_handle<> IOEventManager::remove_waiter(int fd, Event events) {
+	FdSlot* slot = table.find(fd);
+	if (!slot)
+		return nullptr;
+	std::coroutine_handle<>& waiter = events == Event::MONITOR_READ ? slot->reader : slot->writer;
+	std::coroutine_handle<> removed = waiter;
+	if (removed)
+		waiting_count--;
+	waiter = nullptr;
+	return removed;
+}
+
+#ifdef CNETUTILS_IO_URING
+io_uring_sqe* IOEventManager::acquire_sqe() {
+	if (!ring)
+		throw IOUringError("io_uring backend is not enabled");
+	io_uring_sqe* sqe = ring->get_sqe();
+	if (!sqe) {
+		// the queue is full, flush it to the kernel and try once more
+		ring->submit();
+		sqe = ring->get_sqe();
+		if (!sqe)
+			throw IOUringError("io_uring submission queue is full", EBUSY);
+	}
+	return sqe;
+}
+
+void IOEventManager::submit_recv(socket_raw_t fd, void* buffer, std::size_t size, UringOperation& op) {
+	io_uring_sqe* sqe = acquire_sqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<std::uint64_t>(buffer);
+	sqe->len = (std::uint32_t)size;
+	sqe->user_data = reinterpret_cast<std::uint64_t>(&op);
+	inflight_operations++;
+}
+
+void IOEventManager::submit_send(socket_raw_t fd, const void* buffer, std::size_t size, UringOperation& op) {
+	io_uring_sqe* sqe = acquire_sqe();
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<std::uint64_t>(buffer);
+	sqe->len = (std::uint32_t)size;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = reinterpret_cast<std::uint64_t>(&op);
+	inflight_operations++;
+}
+
+void IOEventManager::submit_recvmsg(socket_raw_t fd, msghdr* msg, UringOperation& op) {
+	io_uring_sqe* sqe = acquire_sqe();
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<std::uint64_t>(msg);
+	sqe->len = 1;
+	sqe->user_data = reinterpret_cast<std::uint64_t>(&op);
+	inflight_operations++;
+}
+
+void IOEventManager::submit_sendmsg(socket_raw_t fd, const msghdr* msg, UringOperation& op) {
+	io_uring_sqe* sqe = acquire_sqe();
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<std::uint64_t>(msg);
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = reinterpret_cast<std::uint64_t>(&op);
+	inflight_operations++;
+}
+
+void IOEventManager::submit_accept(socket_raw_t fd, bool multishot, UringOperation& op) {
+	io_uring_sqe* sqe = acquire_sqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = fd;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	if (multishot) {
+		sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+		// a flag no kernel knows, rejected with -EINVAL like the multishot before 5.19
+		if (multishot_refused.load(std::memory_order_relaxed))
+			sqe->ioprio |= 1u << 15;
+	}
+	sqe->user_data = reinterpret_cast<std::uint64_t>(&op);
+	inflight_operations++;
+}
+
+void IOEventManager::submit_cancel(UringOperation& op) {
+	io_uring_sqe* sqe = acquire_sqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = reinterpret_cast<std::uint64_t>(&op);
+	sqe->user_data = 0; // the cancel result itself is not interesting
+}
+
+unsigned IOEventManager::reap_completions(std::vector<std::coroutine_handle<>>& out_handles) {
+	return ring->reap([&](const io_uring_cqe& cqe) {
+		if (cqe.user_data == 0)
+			return;
+		auto op = reinterpret_cast<UringOperation*>(cqe.user_data);
+		if (!(cqe.flags & IORING_CQE_F_MORE))
+			inflight_operations--;
+		// may free the operation, do not touch it afterwards
+		op->on_complete(*op, cqe.res, cqe.flags, out_handles);
+	});
+}
+#else
+void IOEventManager::submit_recv(socket_raw_t, void*, std::size_t, UringOperation&) {
+	throw IOUringError("io_uring backend is not built in");
+}
+
+void IOEventManager::submit_send(socket_raw_t, const void*, std::size_t, UringOperation&) {
+	throw IOUringError("io_uring backend is not built in");
 }
 
-void IOEventManager::poll(int timeout_ms, std::vector<std::coroutine_handle<>>& out_handles) {
+void IOEventManager::submit_recvmsg(socket_raw_t, msghdr*, UringOperation&) {
+	throw IOUringError("io_uring backend is not built in");
+}
+
+void IOEventManager::submit_sendmsg(socket_raw_t, const msghdr*, UringOperation&) {
+	throw IOUringError("io_uring backend is not built in");
+}
+
+void IOEventManager::submit_accept(socket_raw_t, bool, UringOperation&) {
+	throw IOUringError("io_uring backend is not built in");
+}
+
+void IOEventManager::submit_cancel(UringOperation&) {
+	throw IOUringError("io_uring backend is not built in");
+}
+#endif
+
+void IOEventManager::poll(int timeout_ms, std::vector<std::coroutine_handle<>>& out_handles,
+                          PollStats* stats) {
+#ifdef CNETUTILS_IO_URING
+	if (ring) {
+		// one io_uring_enter for all the operations queued since last poll
+		ring->submit();
+		if (ring->cq_ready())
+			timeout_ms = 0;
+	}
+#endif
+
 	const int MAX_EVENTS = 64;
 	epoll_event events[MAX_EVENTS];
+	const auto wait_start = stats ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point {};
 	int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
 	if (n < 0) {
-		if (errno == EINTR)
-			return;
-		// std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
-		return;
+		// EINTR mostly, the completions below are still worth reaping
+		n = 0;
+	}
+	if (stats) {
+		auto blocked = std::chrono::steady_clock::now() - wait_start;
+		stats->blocked_ns.record((std::uint64_t)std::chrono::nanoseconds(blocked).count());
+		stats->events_per_poll.record((std::uint64_t)n);
+		stats->polls.add();
+		if (n == 0)
+			stats->empty_polls.add();
 	}
 	for (int i = 0; i < n; ++i) {
-		int fd = events[i].data.fd;
-		auto it = table.find(fd);
-		if (it != table.end()) {
-			auto handle = it->second.handle;
-			// ET semantics: remove registration and let coroutine re-register if needed
-			table.erase(it);
-			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
-			if (handle)
-				out_handles.push_back(handle);
+		if (events[i].data.fd == wake_fd) {
+			eventfd_t ignored;
+			eventfd_read(wake_fd, &ignored);
+			continue;
+		}
+		if (events[i].data.fd == timer_fd) {
+			// fired, whatever is armed next must be armed again
+			std::uint64_t expirations;
+			if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+				timer_deadline = NO_DEADLINE;
+			continue;
+		}
+		FdSlot* found = table.find(events[i].data.fd);
+		if (!found || !found->registered)
+			continue; // the io_uring fd, or a fd forgot already
+		FdSlot& slot = *found;
+		const uint32_t revents = events[i].events;
+
+		// the registration stays, only the waiters are taken out
+		if (revents & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+			if (slot.reader) {
+				out_handles.push_back(slot.reader);
+				slot.reader = nullptr;
+				waiting_count--;
+			} else {
+				slot.read_ready = true;
+			}
+		}
+		if (revents & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+			if (slot.writer) {
+				out_handles.push_back(slot.writer);
+				slot.writer = nullptr;
+				waiting_count--;
+			} else {
+				slot.write_ready = true;
+			}
 		}
 	}
+
+#ifdef CNETUTILS_IO_URING
+	if (ring) {
+		unsigned reaped = reap_completions(out_handles);
+		if (stats)
+			stats->completions.add(reaped);
+	}
+#endif
 }
@@ -1,11 +1,17 @@
 #pragma once
 
+#include "fd_table.hpp"
+#include "io_uring_ring.h"
 #include "library_utils.h"
-#include "single_instance.hpp"
+#include "loop_stats.hpp"
+#include "thread_local_instance.hpp"
+#include <chrono>
 #include <coroutine>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <sys/epoll.h>
-#include <unordered_map>
+#include <sys/socket.h>
 #include <vector>
 
 #define IO_MANAFER_INCLUDE_PREFER
@@ -14,9 +20,16 @@
 #define SYNC_SOCKET_PREFER
 #include "socket_impl.h"
 
-class IOEventManager : public SingleInstance<IOEventManager> {
+/**
+ * @brief IOEventManager owns one epoll instance per thread, it pairs
+ *        with the Scheduler of the same thread. With the io_uring backend
+ *        it also owns a ring, the ring fd is watched by the epoll instance
+ *        so the readiness waiters and the completions share one wait
+ *
+ */
+class IOEventManager : public ThreadLocalInstance<IOEventManager> {
 public:
-	friend class SingleInstance<IOEventManager>;
+	friend class ThreadLocalInstance<IOEventManager>;
 	using socket_raw_t = CNetUtils::socket_raw_t;
 
 	enum class Event {
@@ -24,19 +37,166 @@ public:
 		MONITOR_WRITE
 	};
 
-	// register a waiter for (fd, events). If already registered, expand/replace.
-	// void add_waiter(socket_raw_t fd, uint32_t events, std::coroutine_handle<> h);
-	void add_waiter(socket_raw_t fd, Event events, std::coroutine_handle<> h);
+	enum class Backend {
+		Epoll, // readiness only, the callers do the syscalls themselves
+		IoUring // the socket operations are submitted to a ring
+	};
+
+	/**
+	 * @brief pick the backend of the managers created afterwards, it
+	 *        overrides the CNETUTILS_IO_BACKEND environment (epoll / io_uring)
+	 *        and the build default. A thread falls back to epoll if the
+	 *        kernel refuses to setup the ring
+	 *
+	 * @param backend
+	 */
+	static void prefer_backend(Backend backend) noexcept;
+	static Backend preferred_backend() noexcept;
+
+	/**
+	 * @brief for the tests: the multishot accepts are refused by the ring
+	 *        as a kernel before 5.19 does, so the listeners take the
+	 *        single shot fallback
+	 *
+	 * @param refuse
+	 */
+	static void refuse_multishot_accept(bool refuse) noexcept;
+
+	/**
+	 * @brief whether this manager runs a ring, the submit_xxx below are
+	 *        only usable when it does
+	 *
+	 */
+	CNETUTILS_FORCEINLINE bool uring_enabled() const noexcept {
+#ifdef CNETUTILS_IO_URING
+		return ring != nullptr;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * @brief register the fd for EPOLLIN | EPOLLOUT | EPOLLRDHUP, edge triggered,
+	 *        it stays registered until the fd is closed. Registering again
+	 *        (a reused fd number, or a socket moved from another thread)
+	 *        resets the waiter slots
+	 * @exception EpollCtlError
+	 *
+	 * @param fd
+	 */
+	void register_fd(socket_raw_t fd);
 
-	// remove a specific watcher
+	/**
+	 * @brief forget the fd before it is closed, the kernel drops the
+	 *        registration itself with the close
+	 *
+	 * @param fd
+	 */
+	void deregister_fd(socket_raw_t fd) noexcept;
+
+	/**
+	 * @brief take the fd out of the epoll set while it stays open, so the
+	 *        kernel stops waking the poll for it. register_fd adds it back
+	 *
+	 * @param fd
+	 */
+	void unwatch_fd(socket_raw_t fd) noexcept;
+
+	/**
+	 * @brief wait for the fd to become readable / writable, a reader and a
+	 *        writer may wait on the same fd at the same time. The fd is
+	 *        registered first if it is not yet
+	 * @exception InvalidFDException / EpollCtlError
+	 *
+	 * @param fd
+	 * @param events
+	 * @param h
+	 * @return false if an edge came since the last wait, the caller should
+	 *         retry its syscall instead of suspending
+	 */
+	bool add_waiter(socket_raw_t fd, Event events, std::coroutine_handle<> h);
+
+	// remove the waiters of the fd, the registration is kept
 	void remove_waiter(socket_raw_t fd);
 
-	// poll events, timeout in ms (-1 block)
-	void poll(int timeout_ms, std::vector<std::coroutine_handle<>>& out_handles);
+	/**
+	 * @brief remove one waiter of the fd, for a cancelled wait
+	 *
+	 * @return std::coroutine_handle<> the removed waiter, nullptr if none
+	 */
+	std::coroutine_handle<> remove_waiter(socket_raw_t fd, Event events);
+
+	/**
+	 * @brief queue a recv, the SQEs are handed to the kernel in batch by
+	 *        the next poll(), op.on_complete runs when the CQE arrives
+	 * @exception IOUringError: the ring is not enabled, or is full
+	 *
+	 * @param fd
+	 * @param buffer must stay valid until the completion
+	 * @param size
+	 * @param op must stay valid until the completion
+	 */
+	void submit_recv(socket_raw_t fd, void* buffer, std::size_t size, UringOperation& op);
+
+	/**
+	 * @brief queue a send, see submit_recv
+	 *
+	 */
+	void submit_send(socket_raw_t fd, const void* buffer, std::size_t size, UringOperation& op);
+
+	/**
+	 * @brief queue a recvmsg / sendmsg, for the scatter-gather I/O,
+	 *        msg and its iovecs must stay valid until the completion
+	 *
+	 */
+	void submit_recvmsg(socket_raw_t fd, msghdr* msg, UringOperation& op);
+	void submit_sendmsg(socket_raw_t fd, const msghdr* msg, UringOperation& op);
+
+	/**
+	 * @brief queue an accept, the accepted sockets are non-blocking.
+	 *        A multishot accept completes once per connection and stays
+	 *        armed as long as the CQE carries IORING_CQE_F_MORE
+	 *
+	 */
+	void submit_accept(socket_raw_t fd, bool multishot, UringOperation& op);
+
+	/**
+	 * @brief ask the kernel to cancel a submitted operation, the operation
+	 *        still completes (with -ECANCELED) through its own on_complete
+	 *
+	 */
+	void submit_cancel(UringOperation& op);
+
+	/**
+	 * @brief poll events, timeout in ms (-1 block)
+	 *
+	 * @param timeout_ms
+	 * @param out_handles the waiters to resume
+	 * @param stats where the epoll_wait counts and blocking time go, if any
+	 */
+	void poll(int timeout_ms, std::vector<std::coroutine_handle<>>& out_handles,
+	          PollStats* stats = nullptr);
+
+	/**
+	 * @brief the poll returns once deadline passes, to the microsecond
+	 *        (a timerfd, the poll timeout needs no rounding). Arming the
+	 *        same deadline again is free, an earlier armed one may only
+	 *        cause an extra wake-up
+	 *
+	 * @param deadline
+	 */
+	void arm_timer(std::chrono::steady_clock::time_point deadline) noexcept;
+
+	/**
+	 * @brief wake up the poll, from any thread. The wake-ups coming
+	 *        while the poll runs make the next poll return at once
+	 *
+	 */
+	void notify() noexcept;
 
 	// whether there are any watchers
 	CNETUTILS_FORCEINLINE bool has_watchers() const noexcept {
-		return !table.empty();
+		return waiting_count != 0 || inflight_operations != 0;
 	}
 
 private:
@@ -44,11 +204,36 @@ private:
 	~IOEventManager();
 
 	CNetUtils::IOEventManager_Internal_t epoll_fd { -1 };
+	int wake_fd { -1 }; // eventfd, readable while a notify() is pending
+	int timer_fd { -1 }; // timerfd, readable once timer_deadline passed
+
+	static constexpr const std::chrono::steady_clock::time_point NO_DEADLINE =
+	    std::chrono::steady_clock::time_point::max();
+	std::chrono::steady_clock::time_point timer_deadline { NO_DEADLINE };
 
-	struct Waiter {
-		uint32_t events;
-		std::coroutine_handle<> handle;
+	/**
+	 * @brief the state of a registered fd, an edge coming while nobody
+	 *        waits is remembered in the ready flag
+	 *
+	 */
+	struct FdSlot {
+		std::coroutine_handle<> reader;
+		std::coroutine_handle<> writer;
+		bool registered { false };
+		bool read_ready { false };
+		bool write_ready { false };
 	};
 
-	std::unordered_map<int, Waiter> table;
+	FdTable<FdSlot> table;
+	std::size_t waiting_count { 0 };
+
+	std::size_t inflight_operations { 0 }; // submitted, final CQE not reaped yet
+
+#ifdef CNETUTILS_IO_URING
+	static constexpr const unsigned RING_ENTRIES = 256;
+	std::unique_ptr<IOUring> ring;
+
+	io_uring_sqe* acquire_sqe();
+	unsigned reap_completions(std::vector<std::coroutine_handle<>>& out_handles);
+#endif
 };
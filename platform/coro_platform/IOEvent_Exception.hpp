@@ -90,3 +90,11 @@ class InvalidFDException : public IOManagerException {
 public:
 	using IOManagerException::IOManagerException;
 };
+
+/**
+ * @brief Raised when io_uring setup, submission or an unsupported ring operation fails.
+ */
+class IOUringError : public IOManagerException {
+public:
+	using IOManagerException::IOManagerException;
+};
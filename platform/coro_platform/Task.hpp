@@ -1,19 +1,49 @@
 #pragma once
 
-#pragma once
+#include "frame_pool.hpp"
 #include "scheduler.hpp"
 #include <coroutine>
+#include <optional>
+#include <type_traits>
 #include <utility>
 
+/**
+ * @brief The final awaiter of the Tasks: the awaiting parent is resumed
+ *        right away (symmetric transfer), without a trip through the
+ *        Scheduler queue. A detached (spawned) Task frees its own frame
+ *
+ * @tparam Promise
+ */
+template <typename Promise>
+struct TaskFinalAwaiter {
+	bool await_ready() noexcept { return false; }
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+		auto& promise = h.promise();
+		TraceRecorder::record_span(TraceRecord::Kind::Complete, h.address(), promise.trace_span);
+		if (promise.parent_coroutine)
+			return Scheduler::transfer_to(promise.parent_coroutine);
+		if (promise.detached)
+			h.destroy();
+		return std::noop_coroutine();
+	}
+
+	void await_resume() noexcept { }
+};
+
 /**
  * @brief This is the Task Type for wrapping the C++ Corotines
  *
  * @tparam T
  */
+template <typename T>
+class WithCancellation;
+
 template <typename T>
 class Task {
 public:
 	friend class Scheduler; // for the Schedular access
+	friend class WithCancellation<T>;
 	struct promise_type;
 	using coro_handle = std::coroutine_handle<promise_type>;
 
@@ -42,6 +72,14 @@ public:
 	struct promise_type {
 		T cached_value;
 		std::coroutine_handle<> parent_coroutine;
+		bool detached { false }; // spawned, nobody owns the frame
+		CancellationToken* cancel_token { nullptr }; // inherited from the awaiting Task
+		std::uint64_t trace_span { 0 }; // spawned while tracing, see TraceRecorder::record_span
+
+		// the frames come from the thread local pool, see FramePool
+		static void* operator new(std::size_t size) { return FramePool::allocate(size); }
+		static void operator delete(void* ptr, std::size_t size) noexcept { FramePool::deallocate(ptr, size); }
+
 		Task get_return_object() {
 			return { coro_handle::from_promise(*this) };
 		}
@@ -50,11 +88,8 @@ public:
 
 			return {};
 		}
-		// suspend always for the Task clean ups
-		std::suspend_always final_suspend() noexcept {
-			if (parent_coroutine) {
-				Scheduler::instance().internal_spawn(parent_coroutine);
-			}
+		// stay suspended for the owning Task to clean up, or free itself
+		TaskFinalAwaiter<promise_type> final_suspend() noexcept {
 			return {};
 		}
 
@@ -71,14 +106,18 @@ public:
 		return false; // always need suspend
 	}
 
-	void await_suspend(std::coroutine_handle<> h) {
-		// Should never be here
-		coroutine_handle.promise().parent_coroutine = h;
-		Scheduler::instance().internal_spawn(coroutine_handle);
+	// run the child right now, it resumes us from its final_suspend
+	template <typename Promise>
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) {
+		auto& promise = coroutine_handle.promise();
+		promise.parent_coroutine = h;
+		if (!promise.cancel_token)
+			promise.cancel_token = token_of(h);
+		return Scheduler::transfer_to(coroutine_handle);
 	}
 
 	T await_resume() {
-		return coroutine_handle.promise().cached_value;
+		return std::move(coroutine_handle.promise().cached_value);
 	}
 
 private:
@@ -93,6 +132,7 @@ template <>
 class Task<void> {
 public:
 	friend class Scheduler;
+	friend class WithCancellation<void>;
 	struct promise_type;
 	using coro_handle = std::coroutine_handle<promise_type>;
 
@@ -121,10 +161,14 @@ public:
 		return false; // always need suspend
 	}
 
-	void await_suspend(std::coroutine_handle<> h) {
-		// Should never be here
-		coroutine_handle.promise().parent_coroutine = h;
-		Scheduler::instance().internal_spawn(coroutine_handle);
+	// run the child right now, it resumes us from its final_suspend
+	template <typename Promise>
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) {
+		auto& promise = coroutine_handle.promise();
+		promise.parent_coroutine = h;
+		if (!promise.cancel_token)
+			promise.cancel_token = token_of(h);
+		return Scheduler::transfer_to(coroutine_handle);
 	}
 
 	void await_resume() {
@@ -133,6 +177,14 @@ public:
 	// concept requires
 	struct promise_type {
 		std::coroutine_handle<> parent_coroutine;
+		bool detached { false }; // spawned, nobody owns the frame
+		CancellationToken* cancel_token { nullptr }; // inherited from the awaiting Task
+		std::uint64_t trace_span { 0 }; // spawned while tracing, see TraceRecorder::record_span
+
+		// the frames come from the thread local pool, see FramePool
+		static void* operator new(std::size_t size) { return FramePool::allocate(size); }
+		static void operator delete(void* ptr, std::size_t size) noexcept { FramePool::deallocate(ptr, size); }
+
 		Task get_return_object() {
 			return { coro_handle::from_promise(*this) };
 		}
@@ -140,11 +192,8 @@ public:
 		std::suspend_always initial_suspend() {
 			return {};
 		}
-		// suspend always for the Task clean ups
-		std::suspend_always final_suspend() noexcept {
-			if (parent_coroutine) {
-				Scheduler::instance().internal_spawn(parent_coroutine);
-			}
+		// stay suspended for the owning Task to clean up, or free itself
+		TaskFinalAwaiter<promise_type> final_suspend() noexcept {
 			return {};
 		}
 		void return_void() {
@@ -160,4 +209,79 @@ private:
 private:
 	Task(const Task&) = delete;
 	Task& operator=(const Task&) = delete;
-};
\ No newline at end of file
+};
+
+/**
+ * @brief   WithCancellation runs a Task under a CancellationToken, either
+ *          its own one with a deadline, or one owned by the caller. The token
+ *          is linked under the token of the awaiting Task, so an outer
+ *          timeout still applies to the inner waits
+ *
+ * @tparam T
+ */
+template <typename T>
+class WithCancellation {
+public:
+	using result_t = std::conditional_t<std::is_void_v<T>, bool, std::optional<T>>;
+
+	WithCancellation(Task<T>&& task, CancellationToken::time_point deadline)
+	    : task(std::move(task))
+	    , owned(deadline)
+	    , token(owned) { }
+
+	WithCancellation(Task<T>&& task, CancellationToken& token)
+	    : task(std::move(task))
+	    , token(token) { }
+
+	bool await_ready() { return false; }
+
+	template <typename Promise>
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) {
+		token.link_under(token_of(h));
+		task.coroutine_handle.promise().cancel_token = &token;
+		return task.await_suspend(h);
+	}
+
+	/**
+	 * @brief nullopt (false for void) if the timeout or a cancellation
+	 *        interrupted the task
+	 */
+	result_t await_resume() {
+		token.unlink();
+		const bool interrupted = token.reason() != CancellationToken::Reason::None;
+		if constexpr (std::is_void_v<T>) {
+			return !interrupted;
+		} else {
+			if (interrupted)
+				return std::nullopt;
+			return task.await_resume();
+		}
+	}
+
+private:
+	Task<T> task;
+	CancellationToken owned;
+	CancellationToken& token;
+};
+
+/**
+ * @brief co_await with_timeout(sock->async_read(...), 5s): the waits of the
+ *        task give up (with ETIMEDOUT) once the timeout passes
+ *
+ * @return std::optional<T>, or bool for Task<void>: the task finished in time
+ */
+template <typename T>
+CNETUTILS_FORCEINLINE WithCancellation<T> with_timeout(Task<T>&& task, std::chrono::milliseconds timeout) {
+	return { std::move(task), LoopClock::now() + timeout };
+}
+
+/**
+ * @brief run the task until token.cancel() is called (on the loop thread),
+ *        the waits of the task then give up with ECANCELED
+ *
+ * @return std::optional<T>, or bool for Task<void>: the task was not cancelled
+ */
+template <typename T>
+CNETUTILS_FORCEINLINE WithCancellation<T> with_cancellation(Task<T>&& task, CancellationToken& token) {
+	return { std::move(task), token };
+}
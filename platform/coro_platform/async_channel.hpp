@@ -0,0 +1,343 @@
+#pragma once
+
+#include "library_utils.h"
+#include "scheduler.hpp"
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief   AsyncChannel is a bounded FIFO between coroutines: send()
+ *          suspends while the channel is full, recv() while it is empty,
+ *          and the waiters are resumed through their Scheduler, so nothing
+ *          polls. The stages may run on different loops, the channel is
+ *          guarded by a mutex and a waiter is posted back to its own loop.
+ *          A suspended waiter holds its loop, close() the channel to
+ *          release the receivers nobody will send to anymore.
+ *
+ * @tparam T movable
+ */
+template <typename T>
+class AsyncChannel {
+	/**
+	 * @brief a suspended sender / receiver, it lives in its awaiter
+	 *
+	 */
+	struct Waiter : LoopWaiter {
+		void (*deliver)(Waiter& receiver, T&& value) { nullptr }; // receivers only
+	};
+
+	using WaiterList = LoopWaiterQueue<Waiter>;
+
+public:
+	/**
+	 * @brief
+	 * @exception std::invalid_argument: capacity is 0
+	 *
+	 * @param capacity how many values the channel buffers
+	 */
+	explicit AsyncChannel(std::size_t capacity)
+	    : slots(capacity) {
+		if (capacity == 0)
+			throw std::invalid_argument("AsyncChannel capacity must be positive");
+	}
+
+	~AsyncChannel() {
+		close();
+	}
+
+	class SendAwaiter;
+	class RecvAwaiter;
+	class RecvManyAwaiter;
+
+	/**
+	 * @brief co_await send(value): suspends while the channel is full
+	 *
+	 * @return bool false if the channel is closed, the value is dropped
+	 */
+	SendAwaiter send(T value) { return SendAwaiter { *this, std::move(value) }; }
+
+	/**
+	 * @brief co_await recv(): suspends while the channel is empty
+	 *
+	 * @return std::optional<T> nullopt once the channel is closed and drained
+	 */
+	RecvAwaiter recv() { return RecvAwaiter { *this }; }
+
+	/**
+	 * @brief co_await recv_many(out, max): take up to max values at once,
+	 *        suspends only while the channel is empty
+	 *
+	 * @return std::size_t how many appended to out, 0 once closed and drained
+	 */
+	RecvManyAwaiter recv_many(std::vector<T>& out, std::size_t max) {
+		return RecvManyAwaiter { *this, out, max };
+	}
+
+	/**
+	 * @brief send without suspending
+	 *
+	 * @return false if the channel is full or closed, value is untouched then
+	 */
+	bool try_send(T& value) {
+		std::unique_lock guard { lock };
+		if (closed_flag || count == slots.size())
+			return false;
+		put_locked(std::move(value), guard);
+		return true;
+	}
+
+	/**
+	 * @brief receive without suspending
+	 *
+	 */
+	std::optional<T> try_recv() {
+		std::unique_lock guard { lock };
+		if (count == 0)
+			return std::nullopt;
+		T value = pop_locked();
+		refill_from_sender(guard);
+		return value;
+	}
+
+	/**
+	 * @brief no more sends, the buffered values can still be received.
+	 *        All the waiters are resumed, thread safe and idempotent
+	 *
+	 */
+	void close() {
+		std::unique_lock guard { lock };
+		if (closed_flag)
+			return;
+		closed_flag = true;
+		WaiterList waiting_senders = std::exchange(senders, {});
+		WaiterList waiting_receivers = std::exchange(receivers, {});
+		guard.unlock();
+		resume_all(waiting_senders);
+		resume_all(waiting_receivers);
+	}
+
+	bool closed() const {
+		std::lock_guard guard { lock };
+		return closed_flag;
+	}
+
+	std::size_t size() const {
+		std::lock_guard guard { lock };
+		return count;
+	}
+
+	CNETUTILS_FORCEINLINE std::size_t capacity() const noexcept { return slots.size(); }
+
+	class SendAwaiter : Waiter {
+	public:
+		bool await_ready() noexcept { return false; }
+
+		bool await_suspend(std::coroutine_handle<> h) {
+			std::unique_lock guard { channel.lock };
+			if (channel.closed_flag) {
+				sent = false;
+				return false;
+			}
+			if (channel.count < channel.slots.size()) {
+				sent = true;
+				channel.put_locked(std::move(value), guard);
+				return false;
+			}
+			// a receiver moves the value in when a slot frees
+			channel.park(*this, channel.senders, h);
+			return true;
+		}
+
+		/**
+		 * @brief false if the channel was closed before the value went in
+		 *
+		 */
+		bool await_resume() noexcept { return sent; }
+
+	private:
+		friend class AsyncChannel;
+		SendAwaiter(AsyncChannel& channel, T&& value)
+		    : channel(channel)
+		    , value(std::move(value)) { }
+
+		AsyncChannel& channel;
+		T value;
+		bool sent { false };
+	};
+
+	class RecvAwaiter : Waiter {
+	public:
+		bool await_ready() noexcept { return false; }
+
+		bool await_suspend(std::coroutine_handle<> h) {
+			std::unique_lock guard { channel.lock };
+			if (channel.count > 0) {
+				value.emplace(channel.pop_locked());
+				channel.refill_from_sender(guard);
+				return false;
+			}
+			if (channel.closed_flag)
+				return false;
+			this->deliver = &RecvAwaiter::accept;
+			channel.park(*this, channel.receivers, h);
+			return true;
+		}
+
+		/**
+		 * @brief nullopt once the channel is closed and drained
+		 *
+		 */
+		std::optional<T> await_resume() { return std::move(value); }
+
+	private:
+		friend class AsyncChannel;
+		explicit RecvAwaiter(AsyncChannel& channel)
+		    : channel(channel) { }
+
+		static void accept(Waiter& waiter, T&& sent) {
+			static_cast<RecvAwaiter&>(waiter).value.emplace(std::move(sent));
+		}
+
+		AsyncChannel& channel;
+		std::optional<T> value;
+	};
+
+	class RecvManyAwaiter : Waiter {
+	public:
+		bool await_ready() noexcept { return max == 0; }
+
+		bool await_suspend(std::coroutine_handle<> h) {
+			std::unique_lock guard { channel.lock };
+			if (channel.count > 0 || channel.closed_flag) {
+				taken = channel.take_locked(out, max, guard);
+				return false;
+			}
+			this->deliver = &RecvManyAwaiter::accept;
+			channel.park(*this, channel.receivers, h);
+			return true;
+		}
+
+		std::size_t await_resume() {
+			// woken with one value, the ones sent since then join the batch
+			if (taken > 0 && taken < max) {
+				std::unique_lock guard { channel.lock };
+				if (channel.count > 0)
+					taken += channel.take_locked(out, max - taken, guard);
+			}
+			return taken;
+		}
+
+	private:
+		friend class AsyncChannel;
+		RecvManyAwaiter(AsyncChannel& channel, std::vector<T>& out, std::size_t max)
+		    : channel(channel)
+		    , out(out)
+		    , max(max) { }
+
+		AsyncChannel& channel;
+		std::vector<T>& out;
+		std::size_t max;
+		std::size_t taken { 0 };
+
+		static void accept(Waiter& waiter, T&& sent) {
+			auto& self = static_cast<RecvManyAwaiter&>(waiter);
+			self.out.emplace_back(std::move(sent));
+			self.taken = 1;
+		}
+	};
+
+private:
+	mutable std::mutex lock;
+	std::vector<std::optional<T>> slots; // the ring buffer
+	std::size_t head { 0 };
+	std::size_t count { 0 };
+	bool closed_flag { false };
+	WaiterList senders; // waiting for a free slot
+	WaiterList receivers; // waiting for a value
+
+	void push_locked(T&& value) {
+		slots[(head + count) % slots.size()].emplace(std::move(value));
+		count++;
+	}
+
+	T pop_locked() {
+		auto& slot = slots[head];
+		T value = std::move(*slot);
+		slot.reset();
+		head = (head + 1) % slots.size();
+		count--;
+		return value;
+	}
+
+	/**
+	 * @brief take up to max values, then let the blocked senders in
+	 *
+	 */
+	std::size_t take_locked(std::vector<T>& out, std::size_t max, std::unique_lock<std::mutex>& guard) {
+		std::size_t taken = 0;
+		while (taken < max && count > 0) {
+			out.emplace_back(pop_locked());
+			taken++;
+		}
+		if (taken > 0)
+			refill_from_sender(guard);
+		return taken;
+	}
+
+	/**
+	 * @brief slots were freed: move the blocked senders' values in,
+	 *        unlocks the guard
+	 *
+	 */
+	void refill_from_sender(std::unique_lock<std::mutex>& guard) {
+		WaiterList admitted;
+		while (count < slots.size()) {
+			Waiter* waiter = senders.pop();
+			if (!waiter)
+				break;
+			auto& sender = static_cast<SendAwaiter&>(*waiter);
+			push_locked(std::move(sender.value));
+			sender.sent = true;
+			admitted.push(*waiter);
+		}
+		guard.unlock();
+		resume_all(admitted);
+	}
+
+	/**
+	 * @brief a value goes in: straight to the first waiting receiver,
+	 *        so no other one can take it meanwhile, or to the buffer.
+	 *        Unlocks the guard
+	 *
+	 */
+	void put_locked(T&& value, std::unique_lock<std::mutex>& guard) {
+		Waiter* waiter = receivers.pop();
+		if (!waiter) {
+			push_locked(std::move(value));
+			guard.unlock();
+			return;
+		}
+		waiter->deliver(*waiter, std::move(value));
+		guard.unlock();
+		waiter->wake();
+	}
+
+	void park(Waiter& waiter, WaiterList& list, std::coroutine_handle<> h) {
+		waiter.park(h);
+		list.push(waiter);
+	}
+
+	static void resume_all(WaiterList& list) {
+		while (Waiter* waiter = list.pop())
+			waiter->wake();
+	}
+
+	AsyncChannel(const AsyncChannel&) = delete;
+	AsyncChannel& operator=(const AsyncChannel&) = delete;
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "cancellation.hpp"
+#include "frame_pool.hpp"
+#include "scheduler.hpp"
+#include <concepts>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+/**
+ * @brief   AsyncGenerator<T> is a coroutine producing a stream of values:
+ *          co_yield hands one value to the consumer, and between two yields
+ *          the generator may co_await I/O like a Task. The consumer pulls:
+ *
+ *              while (auto piece = co_await gen.next()) ...
+ *
+ *          so at most one value is in flight, and a producer never runs ahead
+ *          of its consumer. Both hand over by symmetric transfer, the I/O
+ *          waits resume the generator from the Scheduler, and the waits
+ *          inherit the CancellationToken of the consumer.
+ *          Destroy a generator only while it is suspended at a co_yield or
+ *          done, not while its I/O is pending.
+ *
+ * @tparam T movable
+ */
+template <typename T>
+class AsyncGenerator {
+public:
+	struct promise_type;
+	using handle_t = std::coroutine_handle<promise_type>;
+
+	/**
+	 * @brief back to the consumer, on a co_yield and at the end
+	 *
+	 */
+	struct YieldAwaiter {
+		bool await_ready() noexcept { return false; }
+		std::coroutine_handle<> await_suspend(handle_t h) noexcept {
+			return Scheduler::transfer_to(h.promise().consumer);
+		}
+		void await_resume() noexcept { }
+	};
+
+	struct promise_type {
+		std::optional<T> current;
+		std::coroutine_handle<> consumer;
+		std::exception_ptr error;
+		CancellationToken* cancel_token { nullptr }; // inherited from the consumer
+
+		static void* operator new(std::size_t size) { return FramePool::allocate(size); }
+		static void operator delete(void* ptr, std::size_t size) noexcept { FramePool::deallocate(ptr, size); }
+
+		AsyncGenerator get_return_object() { return AsyncGenerator { handle_t::from_promise(*this) }; }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		YieldAwaiter final_suspend() noexcept { return {}; }
+
+		template <typename U>
+		    requires std::constructible_from<T, U&&>
+		YieldAwaiter yield_value(U&& value) {
+			current.emplace(std::forward<U>(value));
+			return {};
+		}
+
+		void return_void() noexcept { }
+		void unhandled_exception() noexcept { error = std::current_exception(); }
+	};
+
+	/**
+	 * @brief co_await next(): run the generator up to its next co_yield
+	 *
+	 */
+	class NextAwaiter {
+	public:
+		bool await_ready() noexcept { return !handle || handle.done(); }
+
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) {
+			auto& promise = handle.promise();
+			promise.consumer = h;
+			if (!promise.cancel_token)
+				promise.cancel_token = token_of(h);
+			return Scheduler::transfer_to(handle);
+		}
+
+		/**
+		 * @brief the next value, nullopt once the generator returned.
+		 *        What the generator threw is thrown here
+		 *
+		 */
+		std::optional<T> await_resume() {
+			if (!handle)
+				return std::nullopt;
+			auto& promise = handle.promise();
+			if (promise.error)
+				std::rethrow_exception(std::exchange(promise.error, nullptr));
+			if (handle.done())
+				return std::nullopt;
+			std::optional<T> value = std::move(promise.current);
+			promise.current.reset();
+			return value;
+		}
+
+	private:
+		friend class AsyncGenerator;
+		explicit NextAwaiter(handle_t handle)
+		    : handle(handle) { }
+
+		handle_t handle;
+	};
+
+	AsyncGenerator(AsyncGenerator&& other) noexcept
+	    : handle(std::exchange(other.handle, nullptr)) { }
+
+	AsyncGenerator& operator=(AsyncGenerator&& other) noexcept {
+		if (this != &other) {
+			if (handle)
+				handle.destroy();
+			handle = std::exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+
+	~AsyncGenerator() {
+		if (handle)
+			handle.destroy();
+	}
+
+	CNETUTILS_FORCEINLINE NextAwaiter next() noexcept { return NextAwaiter { handle }; }
+
+	/**
+	 * @brief whether the generator returned already
+	 *
+	 */
+	CNETUTILS_FORCEINLINE bool done() const noexcept { return !handle || handle.done(); }
+
+private:
+	handle_t handle;
+
+	explicit AsyncGenerator(handle_t h)
+	    : handle(h) { }
+
+	AsyncGenerator(const AsyncGenerator&) = delete;
+	AsyncGenerator& operator=(const AsyncGenerator&) = delete;
+};
@@ -0,0 +1,75 @@
+#include "async_semaphore.hpp"
+#include <format>
+
+AsyncSemaphore::~AsyncSemaphore() {
+	LoopWaiterQueue<Waiter> parked;
+	{
+		std::lock_guard guard { lock };
+		parked = std::exchange(waiters, {});
+	}
+	while (Waiter* waiter = parked.pop())
+		waiter->wake();
+}
+
+bool AsyncSemaphore::__park(Waiter& waiter, std::coroutine_handle<> h) {
+	std::lock_guard guard { lock };
+	acquired.add();
+	if (permits > 0 && waiters.empty()) {
+		permits--;
+		return false;
+	}
+	contended.add();
+	waiter.since = std::chrono::steady_clock::now();
+	waiter.park(h);
+	waiters.push(waiter);
+	waiting++;
+	return true;
+}
+
+bool AsyncSemaphore::try_acquire() noexcept {
+	std::lock_guard guard { lock };
+	if (permits == 0 || !waiters.empty())
+		return false;
+	permits--;
+	acquired.add();
+	return true;
+}
+
+void AsyncSemaphore::release() noexcept {
+	Waiter* waiter;
+	{
+		std::lock_guard guard { lock };
+		// the permit goes to the waiter directly
+		waiter = waiters.pop();
+		if (!waiter) {
+			permits++;
+			return;
+		}
+		waiting--;
+		wait_ns.record((std::uint64_t)std::chrono::nanoseconds(std::chrono::steady_clock::now() - waiter->since).count());
+	}
+	waiter->wake();
+}
+
+std::size_t AsyncSemaphore::available() const noexcept {
+	std::lock_guard guard { lock };
+	return permits;
+}
+
+AsyncSemaphore::Stats AsyncSemaphore::stats() const {
+	std::lock_guard guard { lock };
+	Stats copy;
+	copy.available = permits;
+	copy.waiting = waiting;
+	copy.acquired = acquired.load();
+	copy.contended = contended.load();
+	copy.wait_ns = wait_ns.snapshot();
+	return copy;
+}
+
+std::string AsyncSemaphore::Stats::to_string(const char* name) const {
+	std::string text = std::format("{}_available {}\n{}_waiting {}\n{}_acquired {}\n{}_contended {}\n",
+	                               name, available, name, waiting, name, acquired, name, contended);
+	text += wait_ns.describe(std::format("{}_wait_ns", name).c_str());
+	return text;
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "library_utils.h"
+#include "loop_stats.hpp"
+#include "scheduler.hpp"
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+
+class AsyncSemaphore;
+
+/**
+ * @brief a permit taken by co_await AsyncSemaphore::scoped(), given back
+ *        when it goes out of scope
+ *
+ */
+class SemaphoreGuard {
+public:
+	SemaphoreGuard() = default;
+	explicit SemaphoreGuard(AsyncSemaphore& semaphore) noexcept
+	    : semaphore(&semaphore) { }
+	SemaphoreGuard(SemaphoreGuard&& other) noexcept
+	    : semaphore(std::exchange(other.semaphore, nullptr)) { }
+	SemaphoreGuard& operator=(SemaphoreGuard&& other) noexcept {
+		if (this != &other) {
+			release();
+			semaphore = std::exchange(other.semaphore, nullptr);
+		}
+		return *this;
+	}
+	~SemaphoreGuard() { release(); }
+
+	/**
+	 * @brief give the permit back early, no-op if already done
+	 *
+	 */
+	void release() noexcept;
+
+	CNETUTILS_FORCEINLINE bool owns() const noexcept { return semaphore != nullptr; }
+
+private:
+	AsyncSemaphore* semaphore { nullptr };
+
+	SemaphoreGuard(const SemaphoreGuard&) = delete;
+	SemaphoreGuard& operator=(const SemaphoreGuard&) = delete;
+};
+
+/**
+ * @brief   AsyncSemaphore limits how many coroutines run a section at once,
+ *          such as the in-flight upstream calls. Instead of blocking the
+ *          loop thread, co_await acquire() parks the coroutine in a FIFO of
+ *          intrusive waiters, and release() hands the permit straight to the
+ *          oldest one (a newcomer can not barge in), which is resumed on its
+ *          own loop. A waiting coroutine holds its loop.
+ *          Thread safe, the coroutines may run on different loops.
+ *
+ */
+class AsyncSemaphore {
+	/**
+	 * @brief a parked acquire, it lives in its awaiter
+	 *
+	 */
+	struct Waiter : LoopWaiter {
+		std::chrono::steady_clock::time_point since {};
+	};
+
+public:
+	/**
+	 * @brief the counters of the semaphore, the times are in nanoseconds
+	 *
+	 */
+	struct Stats {
+		std::size_t available { 0 };
+		std::size_t waiting { 0 }; // parked right now
+		std::uint64_t acquired { 0 };
+		std::uint64_t contended { 0 }; // had to wait for their permit
+		HistogramSnapshot wait_ns; // of the contended ones
+
+		/**
+		 * @brief one line per metric, prefixed by name
+		 *
+		 */
+		std::string to_string(const char* name) const;
+	};
+
+	explicit AsyncSemaphore(std::size_t permits)
+	    : permits(permits) { }
+
+	/**
+	 * @brief the waiters still parked are resumed, as if they got a permit
+	 *
+	 */
+	~AsyncSemaphore();
+
+	class AcquireAwaiter : Waiter {
+	public:
+		bool await_ready() noexcept { return false; }
+		bool await_suspend(std::coroutine_handle<> h) { return semaphore.__park(*this, h); }
+		void await_resume() noexcept { }
+
+	protected:
+		friend class AsyncSemaphore;
+		explicit AcquireAwaiter(AsyncSemaphore& semaphore)
+		    : semaphore(semaphore) { }
+
+		AsyncSemaphore& semaphore;
+	};
+
+	class ScopedAwaiter : public AcquireAwaiter {
+	public:
+		SemaphoreGuard await_resume() noexcept { return SemaphoreGuard { semaphore }; }
+
+	private:
+		friend class AsyncSemaphore;
+		using AcquireAwaiter::AcquireAwaiter;
+	};
+
+	/**
+	 * @brief co_await acquire(): take a permit, suspends while there is none.
+	 *        Pairs with one release()
+	 *
+	 */
+	CNETUTILS_FORCEINLINE AcquireAwaiter acquire() noexcept { return AcquireAwaiter { *this }; }
+
+	/**
+	 * @brief co_await scoped(): acquire(), the SemaphoreGuard releases it
+	 *
+	 */
+	CNETUTILS_FORCEINLINE ScopedAwaiter scoped() noexcept { return ScopedAwaiter { *this }; }
+
+	/**
+	 * @brief take a permit without suspending
+	 *
+	 * @return false if there is none (or coroutines already wait for one)
+	 */
+	bool try_acquire() noexcept;
+
+	/**
+	 * @brief give a permit back, the oldest waiter takes it
+	 *
+	 */
+	void release() noexcept;
+
+	std::size_t available() const noexcept;
+
+	Stats stats() const;
+
+private:
+	mutable std::mutex lock;
+	std::size_t permits;
+	LoopWaiterQueue<Waiter> waiters;
+	std::size_t waiting { 0 };
+
+	// written under the lock
+	StatCounter acquired;
+	StatCounter contended;
+	Histogram wait_ns;
+
+	/**
+	 * @brief take a permit or queue the waiter
+	 *
+	 * @return true if the coroutine is parked
+	 */
+	bool __park(Waiter& waiter, std::coroutine_handle<> h);
+
+	AsyncSemaphore(const AsyncSemaphore&) = delete;
+	AsyncSemaphore& operator=(const AsyncSemaphore&) = delete;
+};
+
+inline void SemaphoreGuard::release() noexcept {
+	if (semaphore)
+		std::exchange(semaphore, nullptr)->release();
+}
+
+/**
+ * @brief   AsyncMutex is an AsyncSemaphore of one permit: co_await lock()
+ *          suspends the coroutine, not the loop thread, and the lock is
+ *          handed over in FIFO order
+ *
+ */
+class AsyncMutex {
+public:
+	using Stats = AsyncSemaphore::Stats;
+
+	AsyncMutex()
+	    : semaphore(1) { }
+
+	/**
+	 * @brief co_await lock(), pairs with one unlock()
+	 *
+	 */
+	CNETUTILS_FORCEINLINE AsyncSemaphore::AcquireAwaiter lock() noexcept { return semaphore.acquire(); }
+
+	/**
+	 * @brief co_await scoped_lock(): lock(), the guard unlocks it
+	 *
+	 */
+	CNETUTILS_FORCEINLINE AsyncSemaphore::ScopedAwaiter scoped_lock() noexcept { return semaphore.scoped(); }
+
+	CNETUTILS_FORCEINLINE bool try_lock() noexcept { return semaphore.try_acquire(); }
+	CNETUTILS_FORCEINLINE void unlock() noexcept { semaphore.release(); }
+
+	CNETUTILS_FORCEINLINE bool locked() const noexcept { return semaphore.available() == 0; }
+
+	CNETUTILS_FORCEINLINE Stats stats() const { return semaphore.stats(); }
+
+private:
+	AsyncSemaphore semaphore;
+};
@@ -0,0 +1,129 @@
+#include "cancellation.hpp"
+#include "scheduler.hpp"
+#include <cerrno>
+
+CancellationToken::~CancellationToken() {
+	unlink();
+	// the children outliving us fall back to their own deadline
+	while (first_child)
+		first_child->unlink();
+	if (hook)
+		hook->unwatch();
+}
+
+bool CancellationToken::cancelled() noexcept {
+	if (why != Reason::None)
+		return true;
+	if (parent && parent->cancelled()) {
+		why = parent->why;
+		return true;
+	}
+	if (until.has_value() && LoopClock::now() >= *until) {
+		why = Reason::TimedOut;
+		return true;
+	}
+	return false;
+}
+
+void CancellationToken::link_under(CancellationToken* parent_token) noexcept {
+	unlink();
+	if (!parent_token)
+		return;
+	parent = parent_token;
+	next_sibling = parent->first_child;
+	if (next_sibling)
+		next_sibling->prev_sibling = this;
+	parent->first_child = this;
+}
+
+std::optional<CancellationToken::time_point> CancellationToken::deadline() const noexcept {
+	std::optional<time_point> earliest = until;
+	for (auto token = parent; token; token = token->parent) {
+		if (token->until.has_value() && (!earliest || *token->until < *earliest))
+			earliest = token->until;
+	}
+	return earliest;
+}
+
+void CancellationToken::unlink() noexcept {
+	if (!parent)
+		return;
+	if (prev_sibling)
+		prev_sibling->next_sibling = next_sibling;
+	else
+		parent->first_child = next_sibling;
+	if (next_sibling)
+		next_sibling->prev_sibling = prev_sibling;
+	prev_sibling = next_sibling = nullptr;
+	parent = nullptr;
+}
+
+void CancellationToken::cancel_with(Reason reason) {
+	if (why == Reason::None)
+		why = reason;
+	// the waits are hooked on the innermost tokens, the triggers only
+	// queue the waiters, so the children stay linked meanwhile
+	for (auto token = first_child; token; token = token->next_sibling)
+		token->cancel_with(why);
+	if (hook)
+		hook->trigger(why);
+}
+
+bool CancellableWait::watch(CancellationToken* token, cancel_fn cancel) {
+	if (!token)
+		return false;
+	if (token->cancelled()) {
+		fired = token->reason();
+		return true;
+	}
+	watching = token;
+	on_cancel = cancel;
+	token->hook = this;
+	if (auto deadline = token->deadline(); deadline.has_value()) {
+		expire = *deadline;
+		on_expire = &CancellableWait::deadline_expired;
+		Scheduler::add_timer(*this);
+	}
+	return false;
+}
+
+void CancellableWait::unwatch() noexcept {
+	if (armed())
+		Scheduler::cancel_timer(*this);
+	if (watching && watching->hook == this)
+		watching->hook = nullptr;
+	watching = nullptr;
+}
+
+int CancellableWait::cancel_error() const noexcept {
+	switch (fired) {
+	case CancellationToken::Reason::None:
+		return 0;
+	case CancellationToken::Reason::TimedOut:
+		return ETIMEDOUT;
+	default:
+		return ECANCELED;
+	}
+}
+
+void CancellableWait::trigger(CancellationToken::Reason reason) {
+	fired = reason;
+	cancel_fn cancel = on_cancel;
+	unwatch();
+	if (cancel)
+		cancel(*this);
+}
+
+void CancellableWait::deadline_expired(TimerNode& node) {
+	auto& wait = static_cast<CancellableWait&>(node);
+	if (!wait.watching)
+		return;
+	// the deadline may be an outer one: that token timed out, and its
+	// children with it. The outermost of equal deadlines covers them all
+	CancellationToken* owner = wait.watching;
+	for (auto token = wait.watching; token; token = token->parent) {
+		if (token->until == wait.expire)
+			owner = token;
+	}
+	owner->cancel_with(CancellationToken::Reason::TimedOut);
+}
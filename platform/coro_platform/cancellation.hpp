@@ -0,0 +1,161 @@
+#pragma once
+
+#include "library_utils.h"
+#include "timing_wheel.hpp"
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <optional>
+
+struct CancellableWait;
+
+/**
+ * @brief   CancellationToken cancels the I/O waits of a Task chain: the token
+ *          is handed down from a Task to the Tasks it awaits, and the leaf
+ *          awaiters (socket waits, io_uring operations, sleeps) give up once
+ *          it is cancelled or its deadline passes.
+ *          A token is driven from the loop thread of the coroutine waiting
+ *          on it, cancel() is not thread safe.
+ *
+ */
+class CancellationToken {
+public:
+	using time_point = std::chrono::steady_clock::time_point;
+
+	enum class Reason {
+		None,
+		Cancelled, // cancel() was called
+		TimedOut // the deadline passed
+	};
+
+	CancellationToken() = default;
+	explicit CancellationToken(time_point deadline)
+	    : until(deadline) { }
+	~CancellationToken();
+
+	/**
+	 * @brief whether the waits should give up, a passed deadline counts
+	 *
+	 */
+	bool cancelled() noexcept;
+
+	CNETUTILS_FORCEINLINE Reason reason() const noexcept { return why; }
+
+	/**
+	 * @brief the earliest deadline of this token and the ones it is linked under
+	 *
+	 */
+	std::optional<time_point> deadline() const noexcept;
+
+	/**
+	 * @brief cancel now, the pending wait (if any) is withdrawn and resumed
+	 *
+	 */
+	CNETUTILS_FORCEINLINE void cancel() { cancel_with(Reason::Cancelled); }
+
+	/**
+	 * @brief nest this token under parent, so cancelling the parent
+	 *        cancels this one too, and the parent deadline applies.
+	 *        A parent may have several children (concurrent child tasks)
+	 *
+	 * @param parent may be nullptr
+	 */
+	void link_under(CancellationToken* parent) noexcept;
+	void unlink() noexcept;
+
+private:
+	friend struct CancellableWait;
+	Reason why { Reason::None };
+	std::optional<time_point> until;
+	CancellationToken* parent { nullptr };
+	CancellationToken* first_child { nullptr };
+	CancellationToken* prev_sibling { nullptr };
+	CancellationToken* next_sibling { nullptr };
+	CancellableWait* hook { nullptr }; // the wait currently suspended on this token
+
+	void cancel_with(Reason reason);
+
+	CancellationToken(const CancellationToken&) = delete;
+	CancellationToken& operator=(const CancellationToken&) = delete;
+};
+
+/**
+ * @brief   CancellableWait is the cancellation side of a leaf awaiter: while
+ *          the awaiter is suspended it hooks the token and arms a timer for
+ *          the deadline on the current loop. When either fires, on_cancel
+ *          withdraws the operation and gets the coroutine resumed.
+ *          Awaiters derive from it, cast back in on_cancel, and hand
+ *          waker(h) to whatever resumes them.
+ *
+ */
+struct CancellableWait : TimerNode {
+	using cancel_fn = void (*)(CancellableWait& wait);
+
+	/**
+	 * @brief start watching, call in await_suspend before suspending
+	 *
+	 * @param token nullptr means not cancellable
+	 * @param on_cancel
+	 * @return true if the token is cancelled already, do not suspend
+	 */
+	bool watch(CancellationToken* token, cancel_fn on_cancel);
+
+	/**
+	 * @brief stop watching, call in await_resume
+	 *
+	 */
+	void unwatch() noexcept;
+
+	/**
+	 * @brief 0 if the wait was not cancelled, else ECANCELED / ETIMEDOUT
+	 *
+	 */
+	int cancel_error() const noexcept;
+
+	/**
+	 * @brief the handle to give the waker: pinned while the deadline is
+	 *        armed, so the loop owning the timer resumes the coroutine
+	 *        itself and disarms the timer there, a stealing sibling would
+	 *        touch the wheel from the wrong thread
+	 *
+	 */
+	CNETUTILS_FORCEINLINE std::coroutine_handle<> waker(std::coroutine_handle<> h) const noexcept {
+		return armed() ? pin(h) : h;
+	}
+
+	// the frames are aligned, the low bit of the address is free for the mark
+	CNETUTILS_FORCEINLINE static std::coroutine_handle<> pin(std::coroutine_handle<> h) noexcept {
+		return std::coroutine_handle<>::from_address(
+		    reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(h.address()) | 1));
+	}
+	CNETUTILS_FORCEINLINE static bool pinned(std::coroutine_handle<> h) noexcept {
+		return reinterpret_cast<std::uintptr_t>(h.address()) & 1;
+	}
+	CNETUTILS_FORCEINLINE static std::coroutine_handle<> unpin(std::coroutine_handle<> h) noexcept {
+		return std::coroutine_handle<>::from_address(
+		    reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(h.address()) & ~std::uintptr_t(1)));
+	}
+
+	~CancellableWait() { unwatch(); }
+
+private:
+	friend class CancellationToken;
+	CancellationToken* watching { nullptr };
+	cancel_fn on_cancel { nullptr };
+	CancellationToken::Reason fired { CancellationToken::Reason::None };
+
+	void trigger(CancellationToken::Reason reason);
+	static void deadline_expired(TimerNode& node);
+};
+
+/**
+ * @brief the token of the coroutine h, nullptr if its promise carries none
+ *
+ */
+template <typename Promise>
+CNETUTILS_FORCEINLINE CancellationToken* token_of(std::coroutine_handle<Promise> h) noexcept {
+	if constexpr (requires { h.promise().cancel_token; })
+		return h.promise().cancel_token;
+	else
+		return nullptr;
+}
@@ -0,0 +1,217 @@
+#include "coro_trace.hpp"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <format>
+#include <mutex>
+#include <unordered_set>
+
+namespace {
+/**
+ * @brief all the rings, kept after their threads exit for the export
+ *
+ */
+struct RingRegistry {
+	std::mutex lock;
+	std::vector<std::shared_ptr<TraceRing>> rings;
+	std::uint32_t next_thread { 1 };
+
+	static RingRegistry& get() {
+		static RingRegistry registry;
+		return registry;
+	}
+};
+
+std::atomic<std::size_t> ring_capacity { TraceRecorder::DEFAULT_CAPACITY };
+
+/**
+ * @brief the ring of this thread, retired when the thread exits
+ *
+ */
+struct ThreadRing {
+	std::shared_ptr<TraceRing> ring;
+
+	~ThreadRing() {
+		if (ring)
+			ring->retire();
+	}
+};
+
+thread_local ThreadRing this_thread_ring;
+
+CNETUTILS_FORCEINLINE std::uint64_t now_ns() noexcept {
+	return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+	           std::chrono::steady_clock::now().time_since_epoch())
+	    .count();
+}
+}
+
+TraceRing::TraceRing(std::size_t capacity, std::uint32_t thread)
+    : slots(new Slot[std::bit_ceil(std::max<std::size_t>(capacity, 2))])
+    , mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1)
+    , thread_id(thread) {
+}
+
+void TraceRing::push(TraceRecord::Kind kind, const void* coroutine, int fd, std::uint64_t span) noexcept {
+	const std::uint64_t index = head.load(std::memory_order_relaxed);
+	Slot& slot = slots[index & mask];
+	slot.ts_ns.store(now_ns(), std::memory_order_relaxed);
+	slot.coroutine.store((std::uintptr_t)coroutine, std::memory_order_relaxed);
+	slot.meta.store((std::uint64_t)(std::uint32_t)fd << 8 | (std::uint64_t)kind, std::memory_order_relaxed);
+	slot.span.store(span, std::memory_order_relaxed);
+	head.store(index + 1, std::memory_order_release);
+}
+
+std::vector<TraceRecord> TraceRing::snapshot() const {
+	const std::uint64_t capacity = mask + 1;
+	const std::uint64_t end = head.load(std::memory_order_acquire);
+	std::uint64_t begin = std::max(floor.load(std::memory_order_relaxed), end > capacity ? end - capacity : 0);
+
+	std::vector<TraceRecord> copy;
+	copy.reserve(end - begin);
+	for (std::uint64_t i = begin; i < end; i++) {
+		const Slot& slot = slots[i & mask];
+		const std::uint64_t meta = slot.meta.load(std::memory_order_relaxed);
+		copy.push_back(TraceRecord {
+		    slot.ts_ns.load(std::memory_order_relaxed),
+		    (const void*)slot.coroutine.load(std::memory_order_relaxed),
+		    (int)(std::uint32_t)(meta >> 8),
+		    (TraceRecord::Kind)(meta & 0xff),
+		    slot.span.load(std::memory_order_relaxed) });
+	}
+
+	// the writer went on meanwhile, the slots it reused are not ours anymore
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const std::uint64_t now = head.load(std::memory_order_relaxed);
+	if (now > capacity && now - capacity > begin) {
+		const std::uint64_t lost = std::min<std::uint64_t>(now - capacity - begin, copy.size());
+		copy.erase(copy.begin(), copy.begin() + (std::ptrdiff_t)lost);
+	}
+	return copy;
+}
+
+std::uint64_t TraceRing::overwritten() const noexcept {
+	const std::uint64_t capacity = mask + 1;
+	const std::uint64_t end = head.load(std::memory_order_acquire);
+	const std::uint64_t begin = floor.load(std::memory_order_relaxed);
+	return end - begin > capacity ? end - begin - capacity : 0;
+}
+
+void TraceRing::discard() noexcept {
+	floor.store(head.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+void TraceRecorder::enable(std::size_t capacity_per_thread) noexcept {
+	ring_capacity.store(capacity_per_thread, std::memory_order_relaxed);
+	recording.store(true, std::memory_order_relaxed);
+}
+
+void TraceRecorder::disable() noexcept {
+	recording.store(false, std::memory_order_relaxed);
+}
+
+void TraceRecorder::__record(TraceRecord::Kind kind, const void* coroutine, int fd, std::uint64_t span) noexcept {
+	auto& ring = this_thread_ring.ring;
+	if (!ring) {
+		try {
+			auto& registry = RingRegistry::get();
+			std::lock_guard guard { registry.lock };
+			ring = std::make_shared<TraceRing>(ring_capacity.load(std::memory_order_relaxed), registry.next_thread++);
+			registry.rings.push_back(ring);
+		} catch (...) {
+			return; // no memory for a ring, the event is lost
+		}
+	}
+	ring->push(kind, coroutine, fd, span);
+}
+
+void TraceRecorder::clear() {
+	auto& registry = RingRegistry::get();
+	std::lock_guard guard { registry.lock };
+	std::erase_if(registry.rings, [](const std::shared_ptr<TraceRing>& ring) {
+		return ring->is_retired();
+	});
+	for (auto& ring : registry.rings)
+		ring->discard();
+}
+
+std::string TraceRecorder::to_chrome_json() {
+	std::vector<std::shared_ptr<TraceRing>> rings;
+	{
+		auto& registry = RingRegistry::get();
+		std::lock_guard guard { registry.lock };
+		rings = registry.rings;
+	}
+
+	std::vector<std::pair<std::uint32_t, std::vector<TraceRecord>>> threads;
+	std::uint64_t origin = UINT64_MAX;
+	for (auto& ring : rings) {
+		auto records = ring->snapshot();
+		if (!records.empty())
+			origin = std::min(origin, records.front().ts_ns);
+		threads.emplace_back(ring->thread(), std::move(records));
+	}
+
+	// spawn / complete pair up by span id as the async span of a spawned
+	// coroutine, its frame address may be some other Task's later on
+	std::unordered_set<std::uint64_t> spawned;
+	for (auto& [thread, records] : threads)
+		for (auto& record : records)
+			if (record.kind == TraceRecord::Kind::Spawn && record.span)
+				spawned.insert(record.span);
+
+	std::string json = "{\"traceEvents\":[";
+	bool first = true;
+	auto emit = [&](std::string event) {
+		if (!first)
+			json += ',';
+		first = false;
+		json += event;
+	};
+
+	for (auto& [thread, records] : threads) {
+		emit(std::format("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},"
+		                 "\"args\":{{\"name\":\"coroutine thread {}\"}}}}",
+		                 thread, thread));
+		for (auto& record : records) {
+			// microseconds with the nanoseconds kept as decimals
+			const std::uint64_t ts = record.ts_ns - origin;
+			const std::string common = std::format("\"pid\":1,\"tid\":{},\"ts\":{}.{:03}",
+			                                       thread, ts / 1000, ts % 1000);
+			const void* frame = record.coroutine;
+			switch (record.kind) {
+			case TraceRecord::Kind::Resume:
+				emit(std::format("{{\"name\":\"resume\",\"cat\":\"coroutine\",\"ph\":\"B\",{},"
+				                 "\"args\":{{\"coroutine\":\"{}\"}}}}",
+				                 common, frame));
+				break;
+			case TraceRecord::Kind::Suspend:
+				emit(std::format("{{\"ph\":\"E\",{}}}", common));
+				break;
+			case TraceRecord::Kind::Spawn:
+				if (record.span)
+					emit(std::format("{{\"name\":\"coroutine\",\"cat\":\"coroutine\",\"ph\":\"b\",\"id\":\"{}\",{},"
+					                 "\"args\":{{\"coroutine\":\"{}\"}}}}",
+					                 record.span, common, frame));
+				break;
+			case TraceRecord::Kind::Complete:
+				if (record.span && spawned.count(record.span))
+					emit(std::format("{{\"name\":\"coroutine\",\"cat\":\"coroutine\",\"ph\":\"e\",\"id\":\"{}\",{}}}",
+					                 record.span, common));
+				else
+					emit(std::format("{{\"name\":\"task done\",\"cat\":\"coroutine\",\"ph\":\"i\",\"s\":\"t\",{},"
+					                 "\"args\":{{\"coroutine\":\"{}\"}}}}",
+					                 common, frame));
+				break;
+			case TraceRecord::Kind::IoWaitBegin:
+			case TraceRecord::Kind::IoWaitEnd:
+				emit(std::format("{{\"name\":\"io_wait fd={}\",\"cat\":\"io\",\"ph\":\"{}\",\"id\":\"{}\",{}}}",
+				                 record.fd, record.kind == TraceRecord::Kind::IoWaitBegin ? "b" : "e",
+				                 frame, common));
+				break;
+			}
+		}
+	}
+	json += "]}";
+	return json;
+}
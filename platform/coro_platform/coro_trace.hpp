@@ -0,0 +1,151 @@
+#pragma once
+
+#include "library_utils.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief one recorded lifecycle event of a coroutine frame
+ *
+ */
+struct TraceRecord {
+	enum class Kind : std::uint8_t {
+		Spawn, // handed to a loop by spawn() / post()
+		Resume, // the loop resumes it from its ready queue
+		Suspend, // back to the loop, suspended or done
+		IoWaitBegin, // parked on a fd
+		IoWaitEnd,
+		Complete // a Task reached its final suspend
+	};
+
+	std::uint64_t ts_ns; // steady_clock
+	const void* coroutine; // the frame address
+	int fd; // the I/O waits only, else -1
+	Kind kind;
+	std::uint64_t span { 0 }; // Spawn / Complete: the id given at spawn, 0 if not spawned
+};
+
+/**
+ * @brief   TraceRing keeps the last records of one thread. Only its thread
+ *          writes, a snapshot may be taken from any thread without locking,
+ *          the records overwritten meanwhile are dropped from it
+ *
+ */
+class TraceRing {
+public:
+	/**
+	 * @param capacity rounded up to a power of two
+	 * @param thread the tid shown by the trace viewer
+	 */
+	TraceRing(std::size_t capacity, std::uint32_t thread);
+
+	void push(TraceRecord::Kind kind, const void* coroutine, int fd, std::uint64_t span = 0) noexcept;
+
+	std::vector<TraceRecord> snapshot() const;
+
+	/**
+	 * @brief how many records were dropped because the ring wrapped around
+	 *
+	 */
+	std::uint64_t overwritten() const noexcept;
+
+	/**
+	 * @brief drop what was recorded so far, any thread
+	 *
+	 */
+	void discard() noexcept;
+
+	CNETUTILS_FORCEINLINE void retire() noexcept { retired.store(true, std::memory_order_relaxed); }
+	CNETUTILS_FORCEINLINE bool is_retired() const noexcept { return retired.load(std::memory_order_relaxed); }
+	CNETUTILS_FORCEINLINE std::uint32_t thread() const noexcept { return thread_id; }
+
+private:
+	// atomic words, so a reader racing the writer reads stale, not torn
+	struct Slot {
+		std::atomic<std::uint64_t> ts_ns { 0 };
+		std::atomic<std::uintptr_t> coroutine { 0 };
+		std::atomic<std::uint64_t> meta { 0 }; // fd << 8 | kind
+		std::atomic<std::uint64_t> span { 0 };
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	std::size_t mask;
+	std::atomic<std::uint64_t> head { 0 };
+	std::atomic<std::uint64_t> floor { 0 }; // the records before it were cleared
+	std::atomic<bool> retired { false }; // its thread exited
+	std::uint32_t thread_id;
+};
+
+/**
+ * @brief   TraceRecorder is the opt-in coroutine tracer: once enabled, the
+ *          Scheduler, the Tasks and the socket waits record their events into
+ *          a ring of the current thread, and the rings are exported as Chrome
+ *          Trace Event JSON, for chrome://tracing or ui.perfetto.dev.
+ *          Disabled, a record costs a relaxed load and a branch.
+ *
+ */
+class TraceRecorder {
+public:
+	static constexpr const std::size_t DEFAULT_CAPACITY = 1 << 16;
+
+	/**
+	 * @brief start recording on all the threads
+	 *
+	 * @param capacity_per_thread the records kept per thread, the older
+	 *        ones are overwritten. For the rings created from now on
+	 */
+	static void enable(std::size_t capacity_per_thread = DEFAULT_CAPACITY) noexcept;
+	static void disable() noexcept;
+
+	CNETUTILS_FORCEINLINE static bool enabled() noexcept {
+		return recording.load(std::memory_order_relaxed);
+	}
+
+	CNETUTILS_FORCEINLINE static void record(TraceRecord::Kind kind, const void* coroutine, int fd = -1) noexcept {
+		if (enabled())
+			__record(kind, coroutine, fd, 0);
+	}
+
+	/**
+	 * @brief the Spawn / Complete of a coroutine, paired up by the span id:
+	 *        the pooled frames are reused at once, their address is no id
+	 *
+	 */
+	CNETUTILS_FORCEINLINE static void record_span(TraceRecord::Kind kind, const void* coroutine, std::uint64_t span) noexcept {
+		if (enabled())
+			__record(kind, coroutine, -1, span);
+	}
+
+	/**
+	 * @brief a fresh span id, for the promise of a coroutine being spawned
+	 *
+	 * @return std::uint64_t 0 while disabled
+	 */
+	CNETUTILS_FORCEINLINE static std::uint64_t next_span() noexcept {
+		return enabled() ? span_ids.fetch_add(1, std::memory_order_relaxed) : 0;
+	}
+
+	/**
+	 * @brief the records of all the threads as Chrome Trace Event JSON:
+	 *        the resumes are slices of the loop thread, the lives of the
+	 *        spawned coroutines and their I/O waits are async spans
+	 *
+	 */
+	static std::string to_chrome_json();
+
+	/**
+	 * @brief forget the rings of the exited threads, and what the live
+	 *        ones recorded so far
+	 *
+	 */
+	static void clear();
+
+private:
+	static inline std::atomic<bool> recording { false };
+	static inline std::atomic<std::uint64_t> span_ids { 1 };
+	static void __record(TraceRecord::Kind kind, const void* coroutine, int fd, std::uint64_t span) noexcept;
+};
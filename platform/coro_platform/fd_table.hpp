@@ -0,0 +1,48 @@
+#pragma once
+
+#include "library_utils.h"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief   FdTable is a flat table indexed by fd. The kernel hands out the
+ *          lowest free fd number, so the fds in use stay dense and a vector
+ *          grown to the highest one beats a hash map: no hashing, and no
+ *          node allocation when a slot is filled or cleared.
+ *          Whether a slot is in use is up to the Slot itself.
+ *
+ * @tparam Slot default constructible, a default one means unused
+ */
+template <typename Slot>
+class FdTable {
+public:
+	/**
+	 * @brief the slot of fd, nullptr if the table never grew that far
+	 *
+	 * @param fd
+	 * @return Slot*
+	 */
+	Slot* find(int fd) noexcept {
+		return fd >= 0 && (std::size_t)fd < slots.size() ? &slots[(std::size_t)fd] : nullptr;
+	}
+
+	/**
+	 * @brief the slot of fd, the table grows to hold it.
+	 *        Growing invalidates the Slot pointers taken before
+	 *
+	 * @param fd must be non-negative
+	 * @return Slot&
+	 */
+	Slot& operator[](int fd) {
+		const std::size_t index = (std::size_t)fd;
+		if (index >= slots.size())
+			slots.resize(std::max(index + 1, slots.size() * 2));
+		return slots[index];
+	}
+
+	CNETUTILS_FORCEINLINE std::size_t capacity() const noexcept { return slots.size(); }
+
+private:
+	std::vector<Slot> slots;
+};
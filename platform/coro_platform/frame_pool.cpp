@@ -0,0 +1,87 @@
+#include "frame_pool.hpp"
+#include <array>
+#include <new>
+
+namespace {
+struct FreeBlock {
+	FreeBlock* next;
+};
+
+struct FreeLists {
+	std::array<FreeBlock*, FramePool::SIZE_CLASSES> heads {};
+	std::array<std::size_t, FramePool::SIZE_CLASSES> counts {};
+	FramePool::Stats stats {};
+
+	void release() noexcept {
+		for (std::size_t i = 0; i < FramePool::SIZE_CLASSES; i++) {
+			while (FreeBlock* block = heads[i]) {
+				heads[i] = block->next;
+				::operator delete(block);
+			}
+			counts[i] = 0;
+		}
+	}
+
+	~FreeLists();
+};
+
+// trivially destructible, still readable while the thread locals are torn down
+thread_local bool lists_destroyed = false;
+thread_local FreeLists lists;
+
+FreeLists::~FreeLists() {
+	release();
+	lists_destroyed = true;
+}
+
+CNETUTILS_FORCEINLINE std::size_t size_class(std::size_t size) noexcept {
+	return (size + FramePool::GRANULE - 1) / FramePool::GRANULE - 1;
+}
+}
+
+void* FramePool::allocate(std::size_t size) {
+	const std::size_t index = size_class(size);
+	if (index >= SIZE_CLASSES || lists_destroyed) {
+		if (!lists_destroyed)
+			lists.stats.oversized++;
+		return ::operator new(size);
+	}
+
+	if (FreeBlock* block = lists.heads[index]) {
+		lists.heads[index] = block->next;
+		lists.counts[index]--;
+		lists.stats.hits++;
+		return block;
+	}
+	lists.stats.misses++;
+	return ::operator new((index + 1) * GRANULE);
+}
+
+void FramePool::deallocate(void* ptr, std::size_t size) noexcept {
+	if (!ptr)
+		return;
+	const std::size_t index = size_class(size);
+	if (index >= SIZE_CLASSES || lists_destroyed) {
+		::operator delete(ptr);
+		return;
+	}
+
+	if (lists.counts[index] >= MAX_CACHED_PER_CLASS) {
+		lists.stats.released++;
+		::operator delete(ptr);
+		return;
+	}
+	auto block = static_cast<FreeBlock*>(ptr);
+	block->next = lists.heads[index];
+	lists.heads[index] = block;
+	lists.counts[index]++;
+}
+
+FramePool::Stats FramePool::stats() noexcept {
+	return lists_destroyed ? Stats {} : lists.stats;
+}
+
+void FramePool::trim() noexcept {
+	if (!lists_destroyed)
+		lists.release();
+}
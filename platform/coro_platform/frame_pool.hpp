@@ -0,0 +1,53 @@
+#pragma once
+
+#include "library_utils.h"
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief   FramePool serves the coroutine frames of Task<T>. The frames are
+ *          rounded up to size classes of GRANULE bytes, each thread keeps a
+ *          free list per class, so a request's chain of short-lived frames
+ *          reuses the blocks instead of going through malloc. Frames larger
+ *          than the biggest class go to the global operator new.
+ *          A frame freed on another thread (a stolen coroutine) simply
+ *          joins the free list of that thread.
+ *
+ */
+class FramePool {
+public:
+	static constexpr const std::size_t GRANULE = 64;
+	static constexpr const std::size_t SIZE_CLASSES = 128; // up to 8 KiB, frames holding a 4 KiB buffer fit
+	static constexpr const std::size_t MAX_CACHED_PER_CLASS = 256;
+
+	/**
+	 * @brief the counters of the calling thread
+	 *
+	 */
+	struct Stats {
+		std::uint64_t hits { 0 }; // served from the free lists
+		std::uint64_t misses { 0 }; // the free list was empty
+		std::uint64_t oversized { 0 }; // too big for the pool
+		std::uint64_t released { 0 }; // returned to the heap, the free list was full
+
+		CNETUTILS_FORCEINLINE double hit_rate() const noexcept {
+			const std::uint64_t total = hits + misses + oversized;
+			return total ? (double)hits / (double)total : 0.0;
+		}
+	};
+
+	static void* allocate(std::size_t size);
+	static void deallocate(void* ptr, std::size_t size) noexcept;
+
+	/**
+	 * @brief snapshot of this thread's counters
+	 *
+	 */
+	static Stats stats() noexcept;
+
+	/**
+	 * @brief give all the cached blocks of this thread back to the heap
+	 *
+	 */
+	static void trim() noexcept;
+};
@@ -0,0 +1,173 @@
+#include "io_uring_ring.h"
+
+#ifdef CNETUTILS_IO_URING
+
+#include "IOEvent_Exception.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+int sys_io_uring_setup(unsigned entries, io_uring_params* params) {
+	return (int)::syscall(__NR_io_uring_setup, entries, params);
+}
+
+int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return (int)::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+	return (int)::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief the operations IOEventManager submits, older kernels miss some
+ */
+bool probe_required_ops(int ring_fd) {
+	static constexpr const unsigned PROBE_OPS = 256;
+	std::size_t size = sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op);
+	std::unique_ptr<unsigned char[]> buffer(new unsigned char[size]());
+	auto probe = reinterpret_cast<io_uring_probe*>(buffer.get());
+	if (sys_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0)
+		return false;
+
+	for (unsigned op : { IORING_OP_RECV, IORING_OP_SEND, IORING_OP_ACCEPT, IORING_OP_ASYNC_CANCEL }) {
+		if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+			return false;
+	}
+	return true;
+}
+}
+
+IOUring::IOUring(unsigned entries) {
+	io_uring_params params {};
+	ring_fd = sys_io_uring_setup(entries, &params);
+	if (ring_fd < 0)
+		throw IOUringError("io_uring_setup failed", errno);
+
+	sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap)
+		sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+	sq_ring_ptr = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+	                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if (sq_ring_ptr == MAP_FAILED) {
+		sq_ring_ptr = nullptr;
+		int err = errno;
+		release();
+		throw IOUringError("mmap the io_uring submission ring failed", err);
+	}
+
+	if (single_mmap) {
+		cq_ring_ptr = sq_ring_ptr;
+	} else {
+		cq_ring_ptr = ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+		                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		if (cq_ring_ptr == MAP_FAILED) {
+			cq_ring_ptr = nullptr;
+			int err = errno;
+			release();
+			throw IOUringError("mmap the io_uring completion ring failed", err);
+		}
+	}
+
+	sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	void* sqes_ptr = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+	                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (sqes_ptr == MAP_FAILED) {
+		int err = errno;
+		release();
+		throw IOUringError("mmap the io_uring sqes failed", err);
+	}
+	sqes = static_cast<io_uring_sqe*>(sqes_ptr);
+
+	auto sq_base = static_cast<unsigned char*>(sq_ring_ptr);
+	sq_head = reinterpret_cast<unsigned*>(sq_base + params.sq_off.head);
+	sq_tail = reinterpret_cast<unsigned*>(sq_base + params.sq_off.tail);
+	sq_flags = reinterpret_cast<unsigned*>(sq_base + params.sq_off.flags);
+	sq_mask = *reinterpret_cast<unsigned*>(sq_base + params.sq_off.ring_mask);
+	sq_entries = *reinterpret_cast<unsigned*>(sq_base + params.sq_off.ring_entries);
+	// the index array is kept as identity, SQEs are consumed in order
+	auto sq_array = reinterpret_cast<unsigned*>(sq_base + params.sq_off.array);
+	for (unsigned i = 0; i < sq_entries; i++)
+		sq_array[i] = i;
+	sqe_tail = sqe_published = *sq_tail;
+
+	auto cq_base = static_cast<unsigned char*>(cq_ring_ptr);
+	cq_head = reinterpret_cast<unsigned*>(cq_base + params.cq_off.head);
+	cq_tail = reinterpret_cast<unsigned*>(cq_base + params.cq_off.tail);
+	cq_mask = *reinterpret_cast<unsigned*>(cq_base + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe*>(cq_base + params.cq_off.cqes);
+
+	if (!probe_required_ops(ring_fd)) {
+		release();
+		throw IOUringError("io_uring misses the socket operations");
+	}
+}
+
+IOUring::~IOUring() {
+	release();
+}
+
+void IOUring::release() noexcept {
+	if (sqes)
+		::munmap(sqes, sqes_size);
+	if (cq_ring_ptr && cq_ring_ptr != sq_ring_ptr)
+		::munmap(cq_ring_ptr, cq_ring_size);
+	if (sq_ring_ptr)
+		::munmap(sq_ring_ptr, sq_ring_size);
+	sqes = nullptr;
+	cq_ring_ptr = sq_ring_ptr = nullptr;
+	if (ring_fd >= 0)
+		::close(ring_fd);
+	ring_fd = -1;
+}
+
+io_uring_sqe* IOUring::get_sqe() noexcept {
+	unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+	if (sqe_tail - head >= sq_entries)
+		return nullptr;
+	io_uring_sqe* sqe = &sqes[sqe_tail & sq_mask];
+	std::memset(sqe, 0, sizeof(*sqe));
+	sqe_tail++;
+	return sqe;
+}
+
+unsigned IOUring::submit() {
+	unsigned to_submit = sqe_tail - sqe_published;
+	if (to_submit == 0)
+		return 0;
+	__atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+
+	int n;
+	do {
+		n = sys_io_uring_enter(ring_fd, to_submit, 0, 0);
+	} while (n < 0 && errno == EINTR);
+	if (n < 0) {
+		// EAGAIN / EBUSY: the kernel is short of resources, retry next tick
+		if (errno == EAGAIN || errno == EBUSY)
+			return 0;
+		throw IOUringError("io_uring_enter failed", errno);
+	}
+	sqe_published += (unsigned)n;
+	return (unsigned)n;
+}
+
+bool IOUring::cq_ready() const noexcept {
+	return *cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+}
+
+void IOUring::flush_overflow() {
+	int n;
+	do {
+		n = sys_io_uring_enter(ring_fd, 0, 0, IORING_ENTER_GETEVENTS);
+	} while (n < 0 && errno == EINTR);
+}
+
+#endif
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "library_utils.h"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef CNETUTILS_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+/**
+ * @brief   UringOperation is one io_uring request in flight, it lives in the
+ *          awaiter inside the coroutine frame (or in its owner for the
+ *          multishot ones), its address is the user_data of the SQE
+ *
+ */
+struct UringOperation {
+	using handles_t = std::vector<std::coroutine_handle<>>;
+	using complete_fn = void (*)(UringOperation& op, int res, std::uint32_t flags, handles_t& out_handles);
+
+	/**
+	 * @brief the default completion: keep the result and resume the handle
+	 *
+	 */
+	static void resume_once(UringOperation& op, int res, std::uint32_t flags, handles_t& out_handles) {
+		op.result = res;
+		op.flags = flags;
+		if (op.handle)
+			out_handles.push_back(op.handle);
+	}
+
+	std::coroutine_handle<> handle;
+	int result { 0 }; // the cqe res, -errno on failures
+	std::uint32_t flags { 0 }; // the cqe flags
+	complete_fn on_complete { &UringOperation::resume_once };
+};
+
+#ifdef CNETUTILS_IO_URING
+
+/**
+ * @brief   IOUring is a thin owner of one io_uring instance, built on the raw
+ *          syscalls so no liburing is needed. The SQEs queued by get_sqe()
+ *          are handed to the kernel in one batch by submit().
+ *          It is not thread safe, each IOEventManager owns its own ring.
+ *
+ */
+class IOUring {
+public:
+	/**
+	 * @brief setup the ring
+	 * @exception IOUringError: the kernel has no io_uring, or misses
+	 *            the RECV/SEND/ACCEPT operations
+	 *
+	 * @param entries the submission queue size
+	 */
+	explicit IOUring(unsigned entries);
+	~IOUring();
+
+	CNETUTILS_FORCEINLINE int fd() const noexcept { return ring_fd; }
+
+	/**
+	 * @brief a zeroed SQE, nullptr if the submission queue is full
+	 *
+	 * @return io_uring_sqe*
+	 */
+	io_uring_sqe* get_sqe() noexcept;
+
+	/**
+	 * @brief hand all the queued SQEs to the kernel
+	 * @exception IOUringError: io_uring_enter failed
+	 *
+	 * @return unsigned how many submitted
+	 */
+	unsigned submit();
+
+	/**
+	 * @brief whether the completion queue holds any entries
+	 *
+	 */
+	bool cq_ready() const noexcept;
+
+	/**
+	 * @brief consume all the available CQEs
+	 *
+	 * @tparam OnCqe void(const io_uring_cqe&)
+	 * @param on_cqe
+	 * @return unsigned how many consumed
+	 */
+	template <typename OnCqe>
+	unsigned reap(OnCqe&& on_cqe);
+
+private:
+	int ring_fd { -1 };
+
+	// submission ring
+	unsigned* sq_head { nullptr };
+	unsigned* sq_tail { nullptr };
+	unsigned* sq_flags { nullptr };
+	unsigned sq_mask { 0 };
+	unsigned sq_entries { 0 };
+	io_uring_sqe* sqes { nullptr };
+	unsigned sqe_tail { 0 }; // queued locally, published by submit()
+	unsigned sqe_published { 0 };
+
+	// completion ring
+	unsigned* cq_head { nullptr };
+	unsigned* cq_tail { nullptr };
+	unsigned cq_mask { 0 };
+	io_uring_cqe* cqes { nullptr };
+
+	// mappings
+	void* sq_ring_ptr { nullptr };
+	std::size_t sq_ring_size { 0 };
+	void* cq_ring_ptr { nullptr };
+	std::size_t cq_ring_size { 0 };
+	std::size_t sqes_size { 0 };
+
+	void flush_overflow();
+	void release() noexcept;
+
+	IOUring(const IOUring&) = delete;
+	IOUring& operator=(const IOUring&) = delete;
+};
+
+template <typename OnCqe>
+inline unsigned IOUring::reap(OnCqe&& on_cqe) {
+	unsigned total = 0;
+	while (true) {
+		unsigned head = *cq_head;
+		unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++, total++)
+			on_cqe(cqes[head & cq_mask]);
+		__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+		// the kernel holds the overflowed entries until asked for them
+		if (!(__atomic_load_n(sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW))
+			break;
+		flush_overflow();
+	}
+	return total;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "library_utils.h"
+#include <chrono>
+
+/**
+ * @brief   LoopClock is the time of the coroutine waits: the sleeps, the
+ *          timeouts and the Scheduler's timers. It reads steady_clock, unless
+ *          the thread switched to the virtual clock (see Scheduler::simulate):
+ *          the virtual time only moves when the idle loop jumps to its next
+ *          timer, so the timer heavy tests run at full CPU speed and
+ *          repeat exactly
+ *
+ */
+class LoopClock {
+public:
+	using time_point = std::chrono::steady_clock::time_point;
+
+	CNETUTILS_FORCEINLINE static time_point now() noexcept {
+		return simulated ? virtual_now : std::chrono::steady_clock::now();
+	}
+
+	CNETUTILS_FORCEINLINE static bool is_virtual() noexcept { return simulated; }
+
+	/**
+	 * @brief switch this thread to the virtual clock, for good: the deadlines
+	 *        taken from the virtual time mean nothing to the real one
+	 *
+	 * @param start where the virtual time starts, not after the real now
+	 */
+	static void use_virtual(time_point start) noexcept {
+		if (simulated)
+			return;
+		virtual_now = start;
+		simulated = true;
+	}
+
+	/**
+	 * @brief move the virtual clock forward to tp, never backward
+	 *
+	 * @param tp
+	 */
+	CNETUTILS_FORCEINLINE static void advance_to(time_point tp) noexcept {
+		if (tp > virtual_now)
+			virtual_now = tp;
+	}
+
+private:
+	static inline thread_local bool simulated { false };
+	static inline thread_local time_point virtual_now {};
+};
@@ -0,0 +1,120 @@
+#include "loop_stats.hpp"
+#include <algorithm>
+#include <bit>
+#include <format>
+
+std::uint64_t HistogramSnapshot::percentile(double q) const noexcept {
+	if (count == 0)
+		return 0;
+	const double wanted = std::clamp(q, 0.0, 1.0) * (double)count;
+	std::uint64_t seen = 0;
+	for (std::size_t i = 0; i < BUCKETS; i++) {
+		seen += buckets[i];
+		if (seen > 0 && (double)seen >= wanted) {
+			if (i == 0)
+				return 0;
+			// the bucket bound is never beyond the largest value seen
+			return std::min<std::uint64_t>(max, (std::uint64_t(1) << i) - 1);
+		}
+	}
+	return max;
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other) noexcept {
+	for (std::size_t i = 0; i < BUCKETS; i++)
+		buckets[i] += other.buckets[i];
+	count += other.count;
+	sum += other.sum;
+	max = std::max(max, other.max);
+}
+
+std::string HistogramSnapshot::describe(const char* name) const {
+	return std::format("{} count={} mean={:.1f} p50={} p99={} max={}\n",
+	                   name, count, mean(), percentile(0.5), percentile(0.99), max);
+}
+
+void Histogram::record(std::uint64_t value) noexcept {
+	const std::size_t index = std::min<std::size_t>(std::bit_width(value), BUCKETS - 1);
+	buckets[index].add();
+	count.add();
+	sum.add(value);
+	max.raise_to(value);
+}
+
+HistogramSnapshot Histogram::snapshot() const noexcept {
+	HistogramSnapshot copy;
+	for (std::size_t i = 0; i < BUCKETS; i++)
+		copy.buckets[i] = buckets[i].load();
+	copy.count = count.load();
+	copy.sum = sum.load();
+	copy.max = max.load();
+	return copy;
+}
+
+LoopStatsSnapshot LoopStatsSnapshot::of(const LoopStats& stats) noexcept {
+	LoopStatsSnapshot copy;
+	copy.loops = 1;
+	copy.iterations = stats.iterations.load();
+	copy.resumed = stats.resumed.load();
+	copy.timers_fired = stats.timers_fired.load();
+	copy.posted = stats.posted.load();
+	copy.yielded = stats.yielded.load();
+	copy.budget_exhausted = stats.budget_exhausted.load();
+	copy.polls = stats.poll.polls.load();
+	copy.empty_polls = stats.poll.empty_polls.load();
+	copy.completions = stats.poll.completions.load();
+	copy.resumed_per_tick = stats.resumed_per_tick.snapshot();
+	copy.ready_depth = stats.ready_depth.snapshot();
+	copy.ready_to_resume_ns = stats.ready_to_resume_ns.snapshot();
+	copy.sleeper_lateness_ns = stats.sleeper_lateness_ns.snapshot();
+	copy.events_per_poll = stats.poll.events_per_poll.snapshot();
+	copy.poll_blocked_ns = stats.poll.blocked_ns.snapshot();
+	return copy;
+}
+
+void LoopStatsSnapshot::merge(const LoopStatsSnapshot& other) noexcept {
+	loops += other.loops;
+	iterations += other.iterations;
+	resumed += other.resumed;
+	timers_fired += other.timers_fired;
+	posted += other.posted;
+	yielded += other.yielded;
+	budget_exhausted += other.budget_exhausted;
+	polls += other.polls;
+	empty_polls += other.empty_polls;
+	completions += other.completions;
+	resumed_per_tick.merge(other.resumed_per_tick);
+	ready_depth.merge(other.ready_depth);
+	ready_to_resume_ns.merge(other.ready_to_resume_ns);
+	sleeper_lateness_ns.merge(other.sleeper_lateness_ns);
+	events_per_poll.merge(other.events_per_poll);
+	poll_blocked_ns.merge(other.poll_blocked_ns);
+}
+
+std::string LoopStatsSnapshot::to_string() const {
+	std::string text;
+	auto counter = [&](const char* name, std::uint64_t value) {
+		text += std::format("{} {}\n", name, value);
+	};
+	auto histogram = [&](const char* name, const HistogramSnapshot& h) {
+		text += h.describe(name);
+	};
+
+	counter("loops", loops);
+	counter("iterations", iterations);
+	counter("resumed", resumed);
+	counter("timers_fired", timers_fired);
+	counter("posted", posted);
+	counter("yielded", yielded);
+	counter("budget_exhausted", budget_exhausted);
+	counter("polls", polls);
+	counter("empty_polls", empty_polls);
+	counter("completions", completions);
+	histogram("resumed_per_tick", resumed_per_tick);
+	histogram("ready_depth", ready_depth);
+	histogram("ready_to_resume_ns", ready_to_resume_ns);
+	histogram("sleeper_lateness_ns", sleeper_lateness_ns);
+	histogram("events_per_poll", events_per_poll);
+	histogram("poll_blocked_ns", poll_blocked_ns);
+	return text;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "library_utils.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief   StatCounter is written by its loop thread only, so a relaxed
+ *          load + store is enough (no locked instruction), and any thread
+ *          may read it for a snapshot
+ *
+ */
+class StatCounter {
+public:
+	CNETUTILS_FORCEINLINE void add(std::uint64_t n = 1) noexcept {
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	CNETUTILS_FORCEINLINE void raise_to(std::uint64_t n) noexcept {
+		if (n > value.load(std::memory_order_relaxed))
+			value.store(n, std::memory_order_relaxed);
+	}
+
+	CNETUTILS_FORCEINLINE std::uint64_t load() const noexcept {
+		return value.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<std::uint64_t> value { 0 };
+};
+
+/**
+ * @brief a copy of a Histogram, bucket i counts the values in [2^(i-1), 2^i)
+ *
+ */
+struct HistogramSnapshot {
+	static constexpr const std::size_t BUCKETS = 48;
+
+	std::array<std::uint64_t, BUCKETS> buckets {};
+	std::uint64_t count { 0 };
+	std::uint64_t sum { 0 };
+	std::uint64_t max { 0 };
+
+	CNETUTILS_FORCEINLINE double mean() const noexcept {
+		return count ? (double)sum / (double)count : 0.0;
+	}
+
+	/**
+	 * @brief the upper bound of the bucket holding the q-quantile,
+	 *        so it over-estimates by at most 2x
+	 *
+	 * @param q in [0, 1]
+	 */
+	std::uint64_t percentile(double q) const noexcept;
+
+	void merge(const HistogramSnapshot& other) noexcept;
+
+	/**
+	 * @brief `name count=.. mean=.. p50=.. p99=.. max=..` and a newline
+	 *
+	 */
+	std::string describe(const char* name) const;
+};
+
+/**
+ * @brief   Histogram keeps power of two buckets, recording is a bit_width
+ *          and three counter bumps
+ *
+ */
+class Histogram {
+public:
+	static constexpr const std::size_t BUCKETS = HistogramSnapshot::BUCKETS;
+
+	void record(std::uint64_t value) noexcept;
+	HistogramSnapshot snapshot() const noexcept;
+
+private:
+	std::array<StatCounter, BUCKETS> buckets;
+	StatCounter count;
+	StatCounter sum;
+	StatCounter max;
+};
+
+/**
+ * @brief the epoll / io_uring side of one loop, filled by IOEventManager::poll
+ *
+ */
+struct PollStats {
+	StatCounter polls; // epoll_wait calls
+	StatCounter empty_polls; // returned no events (timeouts, EINTR)
+	StatCounter completions; // io_uring CQEs reaped
+	Histogram events_per_poll; // epoll_wait return counts
+	Histogram blocked_ns; // time spent in epoll_wait
+};
+
+/**
+ * @brief the counters of one Scheduler loop, see Scheduler::stats()
+ *
+ */
+struct LoopStats {
+	StatCounter iterations; // rounds of the loop
+	StatCounter resumed; // coroutines resumed from the ready queue
+	StatCounter timers_fired;
+	StatCounter posted; // coroutines posted by the other threads
+	StatCounter yielded; // put behind the next poll, by yield() or the coop budget
+	StatCounter budget_exhausted; // ticks cut short by the resume budget
+	Histogram resumed_per_tick;
+	Histogram ready_depth; // ready queue size when a tick starts draining
+	Histogram ready_to_resume_ns; // queued by a poll / timer until resumed
+	Histogram sleeper_lateness_ns; // fired after the timer's deadline
+	PollStats poll;
+};
+
+/**
+ * @brief a plain copy of LoopStats, several loops can be merged into one
+ *
+ */
+struct LoopStatsSnapshot {
+	std::size_t loops { 0 };
+	std::uint64_t iterations { 0 };
+	std::uint64_t resumed { 0 };
+	std::uint64_t timers_fired { 0 };
+	std::uint64_t posted { 0 };
+	std::uint64_t yielded { 0 };
+	std::uint64_t budget_exhausted { 0 };
+	std::uint64_t polls { 0 };
+	std::uint64_t empty_polls { 0 };
+	std::uint64_t completions { 0 };
+	HistogramSnapshot resumed_per_tick;
+	HistogramSnapshot ready_depth;
+	HistogramSnapshot ready_to_resume_ns;
+	HistogramSnapshot sleeper_lateness_ns;
+	HistogramSnapshot events_per_poll;
+	HistogramSnapshot poll_blocked_ns;
+
+	static LoopStatsSnapshot of(const LoopStats& stats) noexcept;
+	void merge(const LoopStatsSnapshot& other) noexcept;
+
+	/**
+	 * @brief one line per metric, `name count=.. mean=.. p50=.. p99=.. max=..`,
+	 *        plain enough for a handler to serve as text/plain
+	 *
+	 */
+	std::string to_string() const;
+};
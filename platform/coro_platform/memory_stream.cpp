@@ -0,0 +1,107 @@
+#include "memory_stream.hpp"
+#include "scheduler.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+std::size_t MemoryStream::Direction::put(const char* from, std::size_t n) noexcept {
+	n = std::min(n, ring.size() - size);
+	const std::size_t tail = (head + size) % ring.size();
+	const std::size_t first = std::min(n, ring.size() - tail);
+	std::memcpy(ring.data() + tail, from, first);
+	std::memcpy(ring.data(), from + first, n - first);
+	size += n;
+	return n;
+}
+
+std::size_t MemoryStream::Direction::take(char* to, std::size_t n) noexcept {
+	n = std::min(n, size);
+	const std::size_t first = std::min(n, ring.size() - head);
+	std::memcpy(to, ring.data() + head, first);
+	std::memcpy(to + first, ring.data(), n - first);
+	head = (head + n) % ring.size();
+	size -= n;
+	return n;
+}
+
+MemoryStream::pair_t MemoryStream::make_pair(std::size_t buffer_size) {
+	auto link = std::make_shared<Link>();
+	for (auto& way : link->ways)
+		way.ring.resize(std::max<std::size_t>(1, buffer_size));
+	return { std::shared_ptr<MemoryStream>(new MemoryStream(link, 0)),
+		     std::shared_ptr<MemoryStream>(new MemoryStream(link, 1)) };
+}
+
+void MemoryStream::wake(std::coroutine_handle<>& slot) {
+	if (slot)
+		Scheduler::wake(std::exchange(slot, nullptr));
+}
+
+void MemoryStream::WaitFor::withdraw(CancellableWait& wait) {
+	wake(static_cast<WaitFor&>(wait).slot);
+}
+
+void MemoryStream::close() noexcept {
+	if (!link)
+		return;
+	for (auto& way : link->ways) {
+		way.closed = true;
+		wake(way.reader);
+		wake(way.writer);
+	}
+	link.reset();
+}
+
+std::size_t MemoryStream::readable() const noexcept {
+	return link ? link->ways[side].size : 0;
+}
+
+Task<ssize_t> MemoryStream::async_read(void* buffer, std::size_t buffer_size) {
+	while (true) {
+		if (!link) {
+			errno = EBADF;
+			co_return -1;
+		}
+		Direction& in = link->ways[side];
+		if (in.size > 0) {
+			std::size_t n = in.take((char*)buffer, buffer_size);
+			wake(in.writer);
+			co_return (ssize_t)n;
+		}
+		if (in.closed)
+			co_return 0;
+		// the link may go meanwhile, keep it until we are resumed
+		auto keep = link;
+		if (int err = co_await WaitFor { in.reader }) {
+			errno = err;
+			co_return -1;
+		}
+	}
+}
+
+Task<ssize_t> MemoryStream::async_write(const void* buffer, std::size_t buffer_size) {
+	std::size_t sent = 0;
+	while (sent < buffer_size) {
+		if (!link) {
+			errno = EBADF;
+			co_return -1;
+		}
+		Direction& out = link->ways[1 - side];
+		if (out.closed) {
+			errno = EPIPE;
+			co_return -1;
+		}
+		std::size_t n = out.put((const char*)buffer + sent, buffer_size - sent);
+		if (n > 0) {
+			sent += n;
+			wake(out.reader);
+			continue;
+		}
+		auto keep = link;
+		if (int err = co_await WaitFor { out.writer }) {
+			errno = err;
+			co_return -1;
+		}
+	}
+	co_return (ssize_t)buffer_size;
+}
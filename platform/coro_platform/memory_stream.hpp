@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Task.hpp"
+#include "cancellation.hpp"
+#include "library_utils.h"
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief   MemoryStream is one end of an in-memory, socketpair like byte
+ *          stream: no fd, no syscall, the waits suspend on the peer and are
+ *          resumed through the Scheduler. With the virtual LoopClock it runs
+ *          the protocol tests and benchmarks without any kernel noise.
+ *          Both ends live on one loop. The waits honour the
+ *          CancellationToken of the Task, like the socket ones
+ *
+ */
+class MemoryStream {
+	struct Link;
+
+public:
+	using pair_t = std::pair<std::shared_ptr<MemoryStream>, std::shared_ptr<MemoryStream>>;
+
+	static constexpr const std::size_t DEFAULT_BUFFER = 64 * 1024;
+
+	/**
+	 * @brief two connected ends
+	 *
+	 * @param buffer_size the bytes in flight per direction, a writer
+	 *        suspends beyond it
+	 */
+	static pair_t make_pair(std::size_t buffer_size = DEFAULT_BUFFER);
+
+	~MemoryStream() { close(); }
+
+	/**
+	 * @brief read what is buffered, suspends while nothing is
+	 *
+	 * @return ssize_t the bytes read, 0 once the peer closed and everything
+	 *         was read, -1 with errno (EBADF closed, ETIMEDOUT / ECANCELED)
+	 */
+	Task<ssize_t> async_read(void* buffer, std::size_t buffer_size);
+
+	/**
+	 * @brief write all, suspends while the peer's buffer is full
+	 *
+	 * @return ssize_t buffer_size, -1 with errno (EPIPE the peer closed,
+	 *         EBADF, ETIMEDOUT / ECANCELED)
+	 */
+	Task<ssize_t> async_write(const void* buffer, std::size_t buffer_size);
+
+	/**
+	 * @brief the peer reads the end of stream once drained, and its
+	 *        writes fail, the waiters are resumed
+	 *
+	 */
+	void close() noexcept;
+
+	CNETUTILS_FORCEINLINE bool is_open() const noexcept { return link != nullptr; }
+
+	/**
+	 * @brief the bytes waiting to be read by this end
+	 *
+	 */
+	std::size_t readable() const noexcept;
+
+private:
+	/**
+	 * @brief the bytes going one way, a ring of buffer_size bytes
+	 *
+	 */
+	struct Direction {
+		std::vector<char> ring;
+		std::size_t head { 0 };
+		std::size_t size { 0 };
+		bool closed { false }; // either end closed
+		std::coroutine_handle<> reader;
+		std::coroutine_handle<> writer;
+
+		std::size_t put(const char* from, std::size_t n) noexcept;
+		std::size_t take(char* to, std::size_t n) noexcept;
+	};
+
+	struct Link {
+		Direction ways[2];
+	};
+
+	/**
+	 * @brief suspend in slot until the peer wakes us
+	 *
+	 */
+	struct WaitFor : CancellableWait {
+		std::coroutine_handle<>& slot;
+
+		explicit WaitFor(std::coroutine_handle<>& slot)
+		    : slot(slot) { }
+
+		bool await_ready() noexcept { return false; }
+
+		template <typename Promise>
+		bool await_suspend(std::coroutine_handle<Promise> h) {
+			if (watch(token_of(h), &WaitFor::withdraw))
+				return false;
+			slot = waker(h);
+			return true;
+		}
+
+		/**
+		 * @brief 0 if woken by the peer, else ECANCELED / ETIMEDOUT
+		 */
+		int await_resume() {
+			unwatch();
+			return cancel_error();
+		}
+
+		static void withdraw(CancellableWait& wait);
+	};
+
+	std::shared_ptr<Link> link;
+	int side { 0 }; // reads ways[side], writes ways[1 - side]
+
+	MemoryStream(std::shared_ptr<Link> link, int side)
+	    : link(std::move(link))
+	    , side(side) { }
+
+	static void wake(std::coroutine_handle<>& slot);
+
+	MemoryStream(const MemoryStream&) = delete;
+	MemoryStream& operator=(const MemoryStream&) = delete;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @brief   MpscInbox is a lock-free multi producer, single consumer queue:
+ *          any thread pushes with one CAS, the owner takes the whole list
+ *          with one exchange (so there is no ABA) and replays it in the
+ *          push order.
+ *
+ * @tparam T must be trivially copyable (like std::coroutine_handle<>)
+ */
+template <typename T>
+class MpscInbox {
+public:
+	MpscInbox() = default;
+	~MpscInbox() {
+		drain([](T) { });
+	}
+
+	/**
+	 * @brief push from any thread
+	 *
+	 * @param value
+	 * @return true if the inbox was empty, the consumer may need a wake up
+	 */
+	bool push(T value) {
+		Node* node = new Node { value, nullptr };
+		Node* old = head.load(std::memory_order_relaxed);
+		do {
+			node->next = old;
+		} while (!head.compare_exchange_weak(old, node,
+		                                     std::memory_order_release,
+		                                     std::memory_order_relaxed));
+		return old == nullptr;
+	}
+
+	/**
+	 * @brief take all the values pushed so far, consumer thread only
+	 *
+	 * @tparam OnValue void(T)
+	 * @param on_value called in the push order
+	 * @return std::size_t how many taken
+	 */
+	template <typename OnValue>
+	std::size_t drain(OnValue&& on_value) {
+		Node* list = head.exchange(nullptr, std::memory_order_acquire);
+		// the stack holds the newest first
+		Node* ordered = nullptr;
+		while (list) {
+			Node* next = list->next;
+			list->next = ordered;
+			ordered = list;
+			list = next;
+		}
+
+		std::size_t count = 0;
+		while (ordered) {
+			Node* next = ordered->next;
+			on_value(ordered->value);
+			delete ordered;
+			ordered = next;
+			count++;
+		}
+		return count;
+	}
+
+	bool empty() const noexcept {
+		return head.load(std::memory_order_acquire) == nullptr;
+	}
+
+private:
+	struct Node {
+		T value;
+		Node* next;
+	};
+
+	std::atomic<Node*> head { nullptr };
+
+	MpscInbox(const MpscInbox&) = delete;
+	MpscInbox& operator=(const MpscInbox&) = delete;
+};
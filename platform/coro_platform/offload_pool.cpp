@@ -0,0 +1,137 @@
+#include "offload_pool.hpp"
+#include <algorithm>
+#include <format>
+
+namespace {
+CNETUTILS_FORCEINLINE std::uint64_t nanoseconds_since(std::chrono::steady_clock::time_point from) noexcept {
+	return (std::uint64_t)std::chrono::nanoseconds(std::chrono::steady_clock::now() - from).count();
+}
+}
+
+OffloadPool::OffloadPool(std::size_t threads, std::size_t max_queued, Overflow overflow)
+    : max_queued(std::max<std::size_t>(1, max_queued))
+    , overflow(overflow) {
+	threads = std::max<std::size_t>(1, threads);
+	worker_stats.reserve(threads);
+	workers.reserve(threads);
+	for (std::size_t i = 0; i < threads; i++) {
+		worker_stats.emplace_back(std::make_unique<WorkerStats>());
+		workers.emplace_back(&OffloadPool::work, this, std::ref(*worker_stats.back()));
+	}
+}
+
+OffloadPool::~OffloadPool() {
+	{
+		std::lock_guard guard { lock };
+		stopping = true;
+	}
+	has_jobs.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+OffloadPool& OffloadPool::shared() {
+	static OffloadPool pool { std::max(1u, std::thread::hardware_concurrency()) };
+	return pool;
+}
+
+bool OffloadPool::submit(OffloadJob& job) {
+	{
+		std::lock_guard guard { lock };
+		queue_depth.record(queued);
+		if (queued >= max_queued && overflow == Overflow::CallerRuns) {
+			ran_inline.add();
+			return false;
+		}
+		submitted.add();
+		job.next = nullptr;
+		job.queued_at = std::chrono::steady_clock::now();
+		if (queued >= max_queued) {
+			// a worker moves it up once it takes a job, no wake-up needed
+			overflowed.add();
+			if (parked_tail)
+				parked_tail->next = &job;
+			else
+				parked_head = &job;
+			parked_tail = &job;
+			parked++;
+			return true;
+		}
+		if (tail)
+			tail->next = &job;
+		else
+			head = &job;
+		tail = &job;
+		queued++;
+	}
+	has_jobs.notify_one();
+	return true;
+}
+
+void OffloadPool::work(WorkerStats& stats) {
+	while (true) {
+		OffloadJob* job;
+		{
+			std::unique_lock guard { lock };
+			has_jobs.wait(guard, [this]() { return head != nullptr || stopping; });
+			if (!head)
+				return; // stopping and drained
+			job = head;
+			head = job->next;
+			if (!head)
+				tail = nullptr;
+			queued--;
+			queue_wait_ns.record(nanoseconds_since(job->queued_at));
+			if (parked_head) {
+				// the freed slot goes to the first parked job
+				OffloadJob* next = parked_head;
+				parked_head = next->next;
+				if (!parked_head)
+					parked_tail = nullptr;
+				parked--;
+				next->next = nullptr;
+				if (tail)
+					tail->next = next;
+				else
+					head = next;
+				tail = next;
+				queued++;
+			}
+		}
+
+		auto started = std::chrono::steady_clock::now();
+		job->execute(*job); // the job is gone afterwards
+		stats.run_ns.record(nanoseconds_since(started));
+		stats.completed.add();
+	}
+}
+
+OffloadPool::Stats OffloadPool::stats() const {
+	Stats copy;
+	copy.threads = workers.size();
+	{
+		std::lock_guard guard { lock };
+		copy.queued = queued;
+		copy.parked = parked;
+		copy.submitted = submitted.load();
+		copy.overflowed = overflowed.load();
+		copy.ran_inline = ran_inline.load();
+		copy.queue_depth = queue_depth.snapshot();
+		copy.queue_wait_ns = queue_wait_ns.snapshot();
+	}
+	for (auto& worker : worker_stats) {
+		copy.completed += worker->completed.load();
+		copy.run_ns.merge(worker->run_ns.snapshot());
+	}
+	return copy;
+}
+
+std::string OffloadPool::Stats::to_string() const {
+	std::string text = std::format("offload_threads {}\noffload_queued {}\noffload_parked {}\noffload_submitted {}\n"
+	                               "offload_completed {}\noffload_overflowed {}\noffload_ran_inline {}\n",
+	                               threads, queued, parked, submitted, completed, overflowed, ran_inline);
+	text += queue_depth.describe("offload_queue_depth");
+	text += queue_wait_ns.describe("offload_queue_wait_ns");
+	text += run_ns.describe("offload_run_ns");
+	return text;
+}
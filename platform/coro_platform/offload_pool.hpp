@@ -0,0 +1,241 @@
+#pragma once
+
+#include "library_utils.h"
+#include "loop_stats.hpp"
+#include "scheduler.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief one offloaded call, it lives in the awaiter inside the coroutine
+ *        frame, so queueing it never allocates
+ *
+ */
+struct OffloadJob {
+	void (*execute)(OffloadJob& job) { nullptr };
+	OffloadJob* next { nullptr };
+	std::chrono::steady_clock::time_point queued_at {};
+};
+
+/**
+ * @brief   OffloadPool runs the blocking or CPU heavy calls of the coroutines
+ *          (parsing a big body, file reads, compression) on its own threads,
+ *          so they never stall an event loop. The coroutine resumes on the
+ *          loop it was suspended on, see offload().
+ *          The queue is bounded: once max_queued jobs wait, the next ones
+ *          park on an overflow list (in their frames, like the queue) and
+ *          move up as the workers free the slots, the loop never runs the
+ *          call itself unless the pool was made with Overflow::CallerRuns.
+ *
+ */
+class OffloadPool {
+public:
+	/**
+	 * @brief what a submit does with a full queue
+	 *
+	 */
+	enum class Overflow {
+		Park, // wait for a slot, the loop goes on meanwhile
+		CallerRuns // run the call on the loop, it slows down instead
+	};
+
+	/**
+	 * @brief the counters of the pool, the times are in nanoseconds
+	 *
+	 */
+	struct Stats {
+		std::size_t threads { 0 };
+		std::size_t queued { 0 }; // waiting right now
+		std::uint64_t submitted { 0 };
+		std::uint64_t completed { 0 };
+		std::size_t parked { 0 }; // waiting for a queue slot right now
+		std::uint64_t overflowed { 0 }; // parked as the queue was full
+		std::uint64_t ran_inline { 0 }; // the queue was full, Overflow::CallerRuns
+		HistogramSnapshot queue_depth; // the depth seen by each submit
+		HistogramSnapshot queue_wait_ns;
+		HistogramSnapshot run_ns;
+
+		std::string to_string() const;
+	};
+
+	/**
+	 * @brief start the worker threads
+	 *
+	 * @param threads at least one
+	 * @param max_queued the jobs beyond it park, or run inline
+	 * @param overflow
+	 */
+	explicit OffloadPool(std::size_t threads, std::size_t max_queued = DEFAULT_MAX_QUEUED,
+	                     Overflow overflow = Overflow::Park);
+
+	/**
+	 * @brief the queued and parked jobs still run, then the workers are joined
+	 *
+	 */
+	~OffloadPool();
+
+	/**
+	 * @brief the pool offload(fn) uses, one thread per core
+	 *
+	 */
+	static OffloadPool& shared();
+
+	/**
+	 * @brief run fn on the pool, co_await it for the result. The
+	 *        exceptions of fn are thrown from the co_await
+	 *
+	 * @tparam Fn R()
+	 * @param fn
+	 */
+	template <typename Fn>
+	auto offload(Fn&& fn);
+
+	Stats stats() const;
+
+	static constexpr const std::size_t DEFAULT_MAX_QUEUED = 1024;
+
+private:
+	/**
+	 * @brief the per worker counters, so recording needs no lock
+	 *
+	 */
+	struct WorkerStats {
+		StatCounter completed;
+		Histogram run_ns;
+	};
+
+	mutable std::mutex lock;
+	std::condition_variable has_jobs;
+	OffloadJob* head { nullptr };
+	OffloadJob* tail { nullptr };
+	std::size_t queued { 0 };
+	const std::size_t max_queued;
+	const Overflow overflow;
+	OffloadJob* parked_head { nullptr }; // the queue is full while any is parked
+	OffloadJob* parked_tail { nullptr };
+	std::size_t parked { 0 };
+	bool stopping { false };
+
+	// written under the lock
+	StatCounter submitted;
+	StatCounter overflowed;
+	StatCounter ran_inline;
+	Histogram queue_depth;
+	Histogram queue_wait_ns;
+
+	std::vector<std::unique_ptr<WorkerStats>> worker_stats;
+	std::vector<std::thread> workers;
+
+	template <typename Fn>
+	friend class OffloadAwaiter;
+
+	/**
+	 * @brief queue the job, or park it if the queue is full
+	 *
+	 * @return false if the queue is full with Overflow::CallerRuns,
+	 *         the caller runs it itself
+	 */
+	bool submit(OffloadJob& job);
+	void work(WorkerStats& stats);
+
+	OffloadPool(const OffloadPool&) = delete;
+	OffloadPool& operator=(const OffloadPool&) = delete;
+};
+
+/**
+ * @brief   OffloadAwaiter hands its call to an OffloadPool, the coroutine
+ *          is posted back to its loop once the call returns. The loop is
+ *          held meanwhile, so it does not leave run() without it.
+ *
+ * @tparam Fn
+ */
+template <typename Fn>
+class OffloadAwaiter : OffloadJob {
+public:
+	using result_t = std::invoke_result_t<Fn&>;
+
+	OffloadAwaiter(OffloadPool& pool, Fn fn)
+	    : pool(pool)
+	    , fn(std::move(fn)) {
+		execute = &OffloadAwaiter::run_and_post;
+	}
+
+	bool await_ready() noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> h) {
+		handle = h;
+		loop = &Scheduler::instance();
+		loop->hold();
+		if (pool.submit(*this))
+			return true;
+		// Overflow::CallerRuns and the queue is full
+		loop->release();
+		invoke();
+		return false;
+	}
+
+	result_t await_resume() {
+		if (error)
+			std::rethrow_exception(error);
+		if constexpr (!std::is_void_v<result_t>)
+			return std::move(*result);
+	}
+
+private:
+	using storage_t = std::conditional_t<std::is_void_v<result_t>, bool, result_t>;
+
+	OffloadPool& pool;
+	Fn fn;
+	std::optional<storage_t> result;
+	std::exception_ptr error;
+	std::coroutine_handle<> handle;
+	Scheduler* loop { nullptr };
+
+	void invoke() noexcept {
+		try {
+			if constexpr (std::is_void_v<result_t>) {
+				fn();
+				result.emplace(true);
+			} else {
+				result.emplace(fn());
+			}
+		} catch (...) {
+			error = std::current_exception();
+		}
+	}
+
+	static void run_and_post(OffloadJob& job) {
+		auto& self = static_cast<OffloadAwaiter&>(job);
+		self.invoke();
+		// the coroutine may free this awaiter as soon as it is posted
+		Scheduler* owner = self.loop;
+		owner->post(self.handle);
+		owner->release();
+	}
+};
+
+template <typename Fn>
+inline auto OffloadPool::offload(Fn&& fn) {
+	return OffloadAwaiter<std::decay_t<Fn>>(*this, std::forward<Fn>(fn));
+}
+
+/**
+ * @brief run fn on the shared OffloadPool, see OffloadPool::offload
+ *
+ */
+template <typename Fn>
+CNETUTILS_FORCEINLINE auto offload(Fn&& fn) {
+	return OffloadPool::shared().offload(std::forward<Fn>(fn));
+}
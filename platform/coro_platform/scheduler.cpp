@@ -1,52 +1,334 @@
 #include "scheduler.hpp"
 #include "IOEventMonitor.h"
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
 #include <thread>
+#include <utility>
 
-int Scheduler::caculate_time_out() const noexcept {
-	int timeout_ms = -1;
-	if (!ready_coroutines.empty()) {
-		timeout_ms = 0;
-	} else if (!sleepys.empty()) {
-		auto next = sleepys.top().sleep;
-		auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(
-		                next - current())
-		                .count();
-		timeout_ms = (int)std::max<long long>(0, diff);
+namespace {
+/**
+ * @brief the live Schedulers, for Scheduler::stats_all()
+ *
+ */
+struct LoopRegistry {
+	std::mutex lock;
+	std::vector<const Scheduler*> loops;
+
+	static LoopRegistry& get() {
+		static LoopRegistry registry;
+		return registry;
+	}
+};
+
+thread_local Scheduler* this_thread_loop = nullptr;
+
+CNETUTILS_FORCEINLINE std::uint64_t nanoseconds_between(Scheduler::sch_tp_t from, Scheduler::sch_tp_t to) noexcept {
+	return to > from ? (std::uint64_t)std::chrono::nanoseconds(to - from).count() : 0;
+}
+}
+
+std::size_t WorkStealingGroup::join(Scheduler& scheduler) {
+	std::size_t index = joined.fetch_add(1, std::memory_order_acq_rel);
+	if (index >= members.size())
+		throw std::length_error("WorkStealingGroup is full");
+	members[index].store(&scheduler, std::memory_order_release);
+	return index;
+}
+
+std::coroutine_handle<> WorkStealingGroup::steal_for(const Scheduler& thief) {
+	const std::size_t n = members.size();
+	// start from the next sibling, so the thieves spread over the victims
+	for (std::size_t i = 1; i < n; i++) {
+		Scheduler* victim = members[(thief.group_index + i) % n].load(std::memory_order_acquire);
+		if (!victim)
+			continue;
+		if (auto h = victim->ready_coroutines.steal())
+			return *h;
+	}
+	return nullptr;
+}
+
+void WorkStealingGroup::wake_idle(const Scheduler& busy) noexcept {
+	// pairs with the fence of a parking member: either it sees our works,
+	// or we see it parked
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (parked.load(std::memory_order_relaxed) == 0)
+		return;
+	const std::size_t n = members.size();
+	for (std::size_t i = 1; i < n; i++) {
+		Scheduler* member = members[(busy.group_index + i) % n].load(std::memory_order_acquire);
+		if (member && member->parked.exchange(false, std::memory_order_acq_rel)) {
+			member->notify();
+			return;
+		}
 	}
-	return timeout_ms;
+}
+
+bool WorkStealingGroup::wait_for_works(Scheduler& member) {
+	if (finished.load(std::memory_order_acquire))
+		return false;
+
+	// the last one going idle finishes the group
+	if (idle.fetch_add(1, std::memory_order_acq_rel) + 1 == members.size()) {
+		finished.store(true, std::memory_order_release);
+		for (auto& other : members) {
+			Scheduler* sibling = other.load(std::memory_order_acquire);
+			if (sibling && sibling != &member)
+				sibling->notify();
+		}
+	}
+
+	std::vector<std::coroutine_handle<>> ready_from_io;
+	while (!finished.load(std::memory_order_acquire)) {
+		member.parked.store(true, std::memory_order_relaxed);
+		parked.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!has_stealable(member) && !member.has_pending_works())
+			member.io->poll(-1, ready_from_io, &member.loop_stats.poll);
+		member.parked.store(false, std::memory_order_relaxed);
+		parked.fetch_sub(1, std::memory_order_relaxed);
+
+		if (finished.load(std::memory_order_acquire))
+			break;
+		for (auto h : ready_from_io)
+			member.push_ready(h);
+		if (!ready_from_io.empty() || has_stealable(member) || member.has_pending_works()) {
+			idle.fetch_sub(1, std::memory_order_acq_rel);
+			return true;
+		}
+	}
+
+	// the siblings are destroyed once their threads exit, so nobody
+	// leaves before all the members stopped looking into the others
+	left.fetch_add(1, std::memory_order_acq_rel);
+	while (left.load(std::memory_order_acquire) < members.size())
+		std::this_thread::yield();
+	return false;
+}
+
+bool WorkStealingGroup::has_stealable(const Scheduler& thief) const noexcept {
+	for (auto& member : members) {
+		Scheduler* victim = member.load(std::memory_order_acquire);
+		if (victim && victim != &thief && !victim->ready_coroutines.empty())
+			return true;
+	}
+	return false;
+}
+
+Scheduler::Scheduler()
+    : io(&IOEventManager::instance()) {
+	this_thread_loop = this;
+	auto& registry = LoopRegistry::get();
+	std::lock_guard guard { registry.lock };
+	registry.loops.push_back(this);
+}
+
+Scheduler::~Scheduler() {
+	run();
+	auto& registry = LoopRegistry::get();
+	std::lock_guard guard { registry.lock };
+	std::erase(registry.loops, this);
+	this_thread_loop = nullptr;
+}
+
+LoopStatsSnapshot Scheduler::stats_all() {
+	LoopStatsSnapshot merged;
+	auto& registry = LoopRegistry::get();
+	std::lock_guard guard { registry.lock };
+	for (const Scheduler* loop : registry.loops)
+		merged.merge(LoopStatsSnapshot::of(loop->loop_stats));
+	return merged;
+}
+
+void Scheduler::post(coro_handle_t h) {
+	// the first post after a drain wakes the loop, the later ones ride along
+	if (inbox.push(h))
+		notify();
+}
+
+void Scheduler::resume_on(Scheduler& loop, coro_handle_t h) {
+	if (&loop == this_thread_loop)
+		loop.internal_spawn(h);
+	else
+		loop.post(h);
+}
+
+Scheduler* Scheduler::of_this_thread() noexcept {
+	return this_thread_loop;
+}
+
+void Scheduler::hold() noexcept {
+	holds.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Scheduler::release() noexcept {
+	// the last release lets an idle loop return from run()
+	if (holds.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		notify();
+}
+
+void Scheduler::notify() noexcept {
+	io->notify();
+}
+
+void Scheduler::take_posted() {
+	std::size_t taken = inbox.drain([this](coro_handle_t h) {
+		push_ready(h);
+	});
+	loop_stats.posted.add(taken);
+}
+
+bool Scheduler::has_pending_works() const noexcept {
+	return !ready_coroutines.empty() || !pinned_ready.empty() || !deferred.empty() || !timers.empty() || io->has_watchers()
+	    || !inbox.empty() || holds.load(std::memory_order_acquire) != 0;
+}
+
+void Scheduler::simulate() noexcept {
+	// start on a tick, so the jumps land on the same times on every run
+	Scheduler& self = instance();
+	LoopClock::use_virtual(self.timers.position());
+}
+
+int Scheduler::caculate_time_out() noexcept {
+	if (!ready_coroutines.empty() || !pinned_ready.empty() || !deferred.empty() || !inbox.empty())
+		return 0;
+	if (group && group->has_stealable(*this))
+		return 0;
+	if (auto next = timers.next_expiry(); next.has_value()) {
+		if (*next <= current())
+			return 0;
+		if (!LoopClock::is_virtual())
+			io->arm_timer(*next);
+	}
+	return -1;
+}
+
+void Scheduler::resume_ready(coro_handle_t h) {
+	if (queued_batch > 0) {
+		queued_batch--;
+		loop_stats.ready_to_resume_ns.record(nanoseconds_between(queued_at, current()));
+	}
+	inline_transfers = 0;
+	const void* frame = h.address();
+	TraceRecorder::record(TraceRecord::Kind::Resume, frame);
+	h.resume();
+	TraceRecorder::record(TraceRecord::Kind::Suspend, frame);
+}
+
+void Scheduler::drain_ready() {
+	loop_stats.ready_depth.record(ready_coroutines.size() + pinned_ready.size());
+	std::uint64_t resumed = 0;
+	bool exhausted = false;
+	auto budget_left = [&]() {
+		if (resume_budget && resumed == resume_budget) {
+			// the rest waits for the next tick, after the poll and the timers
+			if (!std::exchange(exhausted, true))
+				loop_stats.budget_exhausted.add();
+			return false;
+		}
+		return true;
+	};
+
+	// the pinned ones first, only this loop may resume them. Indexed,
+	// a resumed one may pin another
+	std::size_t pinned_done = 0;
+	while (pinned_done < pinned_ready.size() && budget_left()) {
+		resumed++;
+		resume_ready(pinned_ready[pinned_done++]);
+	}
+	pinned_ready.erase(pinned_ready.begin(), pinned_ready.begin() + (std::ptrdiff_t)pinned_done);
+
+	// the siblings may win a race on the top, so check the emptiness again
+	while (!ready_coroutines.empty() && budget_left()) {
+		if (auto front_one = ready_coroutines.steal()) {
+			resumed++;
+			resume_ready(*front_one);
+		}
+	}
+	queued_batch = 0;
+	loop_stats.resumed.add(resumed);
+	loop_stats.resumed_per_tick.record(resumed);
 }
 
 void Scheduler::__run() {
-	while (!ready_coroutines.empty() || !sleepys.empty() || IOEventManager::instance().has_watchers()) {
+	while (has_pending_works() || (group && group->wait_for_works(*this))) {
+		loop_stats.iterations.add();
+
+		// the works posted by the other threads join the local queue
+		take_posted();
+
 		// resume all ready ones first
-		while (!ready_coroutines.empty()) {
-			auto front_one = ready_coroutines.front();
-			ready_coroutines.pop();
-			front_one.resume();
-		}
+		drain_ready();
 
-		// move expired sleepers to ready queue
-		auto now = current();
-		while (!sleepys.empty() && sleepys.top().sleep <= now) {
-			ready_coroutines.push(sleepys.top().coro_handle);
-			sleepys.pop();
+		// nothing left locally, help the busy siblings
+		if (group && ready_coroutines.empty()) {
+			if (auto stolen = group->steal_for(*this))
+				ready_coroutines.push(stolen);
 		}
 
+		// move expired sleepers to ready queue, a whole tick in a batch
+		const sch_tp_t now = current();
+		timers.advance(now, [this, now](TimerNode& node) {
+			loop_stats.timers_fired.add();
+			loop_stats.sleeper_lateness_ns.record(nanoseconds_between(node.expire, now));
+			if (node.on_expire)
+				node.on_expire(node);
+			else
+				push_ready(node.handle);
+		});
+
 		// compute timeout for epoll (ms)
 		int timeout_ms = caculate_time_out();
 
+		// nothing can wake us anymore, epoll_wait(-1) would block forever,
+		// the loop condition decides whether to wait for the group or leave
+		if (timeout_ms < 0 && timers.empty() && !io->has_watchers()
+		    && holds.load(std::memory_order_acquire) == 0)
+			continue;
+
+		// on the virtual clock nothing is waited for in real time, the
+		// time jumps to the next timer once the poll brings nothing
+		const bool jump = timeout_ms < 0 && LoopClock::is_virtual() && !timers.empty();
+		if (jump)
+			timeout_ms = 0;
+
+		// going to block: park, so the busy siblings wake us for their works
+		const bool parking = group && timeout_ms != 0;
+		if (parking) {
+			parked.store(true, std::memory_order_relaxed);
+			group->parked.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (group->has_stealable(*this))
+				timeout_ms = 0;
+		}
+
 		// POLL IO and collect handles that should be resumed (ET: coroutine will re-register)
 		std::vector<std::coroutine_handle<>> ready_from_io;
-		IOEventManager::instance().poll(timeout_ms, ready_from_io);
+		io->poll(timeout_ms, ready_from_io, &loop_stats.poll);
+
+		if (parking) {
+			parked.store(false, std::memory_order_relaxed);
+			group->parked.fetch_sub(1, std::memory_order_relaxed);
+		}
 
 		// push io-ready handles into ready_coroutines
 		for (auto h : ready_from_io) {
-			ready_coroutines.push(h);
+			push_ready(h);
 		}
+		queued_batch = ready_coroutines.size();
+		queued_at = current();
+
+		// the yielded ones go behind what the poll brought
+		for (auto h : deferred)
+			ready_coroutines.push(h);
+		deferred.clear();
+		if (group && queued_batch > 1)
+			group->wake_idle(*this);
 
-		// If still nothing ready and there are sleepers, sleep until next sleeper time
-		if (ready_coroutines.empty() && !sleepys.empty()) {
-			std::this_thread::sleep_until(sleepys.top().sleep);
+		if (jump && ready_coroutines.empty() && inbox.empty()) {
+			if (auto next = timers.next_expiry(); next.has_value())
+				LoopClock::advance_to(*next);
 		}
 	}
 }
@@ -1,10 +1,20 @@
 #pragma once
 
+#include "cancellation.hpp"
+#include "coro_trace.hpp"
 #include "library_utils.h"
-#include "single_instance.hpp"
+#include "loop_clock.hpp"
+#include "loop_stats.hpp"
+#include "mpsc_inbox.hpp"
+#include "thread_local_instance.hpp"
+#include "timing_wheel.hpp"
+#include "work_stealing_deque.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <coroutine>
-#include <queue>
+#include <cstddef>
+#include <vector>
 
 #define IO_MANAFER_INCLUDE_PREFER
 #include "coro_platform_impl.h"
@@ -12,61 +22,361 @@
 template <typename T>
 class Task;
 struct AwaitableSleep;
+class Scheduler;
+class IOEventManager;
+
+/**
+ * @brief ExecutorMode decides how several worker loops cooperate
+ *
+ */
+enum class ExecutorMode {
+	ThreadPerCore, // independent loops, a coroutine never leaves its loop
+	WorkStealing // idle loops steal the ready coroutines of the busy ones
+};
+
+/**
+ * @brief   WorkStealingGroup links the Schedulers of several worker threads,
+ *          an idle Scheduler steals the ready coroutines queued in the others.
+ *          The group must outlive all the workers joined in, and all the
+ *          members must join: an idle member waits for the others, the
+ *          members leave run() together once all of them are idle.
+ *
+ */
+class WorkStealingGroup {
+public:
+	explicit WorkStealingGroup(std::size_t workers)
+	    : members(workers) { }
+
+	/**
+	 * @brief steal one ready coroutine from any other member
+	 *
+	 * @param thief the Scheduler asking for works
+	 * @return std::coroutine_handle<> nullptr if nothing can be stolen
+	 */
+	std::coroutine_handle<> steal_for(const Scheduler& thief);
+
+	/**
+	 * @brief whether any other member has queued ready coroutines
+	 *
+	 * @param thief
+	 */
+	bool has_stealable(const Scheduler& thief) const noexcept;
+
+	/**
+	 * @brief wake one parked member, so it comes to steal the works
+	 *        just queued by the caller
+	 *
+	 * @param busy the Scheduler which queued the works
+	 */
+	void wake_idle(const Scheduler& busy) noexcept;
+
+private:
+	friend class Scheduler;
+	std::vector<std::atomic<Scheduler*>> members;
+	std::atomic<std::size_t> joined { 0 };
+	std::atomic<std::size_t> parked { 0 }; // members blocked in their poll
+	std::atomic<std::size_t> idle { 0 }; // members with no works of their own
+	std::atomic<std::size_t> left { 0 }; // members seen the group finished
+	std::atomic<bool> finished { false };
+
+	std::size_t join(Scheduler& scheduler);
+
+	/**
+	 * @brief block an idle member until works come, or until all the
+	 *        members are idle
+	 *
+	 * @param member
+	 * @return true if it should run again, false if the group is finished
+	 */
+	bool wait_for_works(Scheduler& member);
+};
 
 /**
  * @brief   Scheduler will Schedule the co-routines for the sessions
  *          So, IO Manager will
+ *          Each thread owns its own Scheduler (and IOEventManager), so
+ *          several event loops can run side by side, one per worker thread
  *
  */
-class Scheduler : public SingleInstance<Scheduler> {
+class Scheduler : public ThreadLocalInstance<Scheduler> {
 public:
 	using sch_tp_t = std::chrono::steady_clock::time_point;
 	using coro_handle_t = std::coroutine_handle<>;
-	friend SingleInstance<Scheduler>; // for friend sessions
+	friend ThreadLocalInstance<Scheduler>; // for friend sessions
 	friend class AwaitableSleep; // for sleep call
+	friend class WorkStealingGroup; // siblings steal from ready_coroutines
 	template <typename T>
 	friend class Task; // Task can access the internals for conv
 
 	CNETUTILS_FORCEINLINE static void run() { instance().__run(); }
 
+	/**
+	 * @brief join this thread's Scheduler into a stealing group,
+	 *        call it on the worker thread before run()
+	 * @exception std::length_error: the group is already full
+	 *
+	 * @param group
+	 */
+	CNETUTILS_FORCEINLINE static void join_group(WorkStealingGroup& group) {
+		instance().group_index = group.join(instance());
+		instance().group = &group;
+	}
+
 	template <typename Task_RType>
 	static void spawn(Task<Task_RType>&& task);
 
-	~Scheduler() override {
-		run();
+	/**
+	 * @brief queue a suspended coroutine to this loop from any thread,
+	 *        the loop is woken up if it is blocked in its poll.
+	 *        The loop must still be running, see hold()
+	 *
+	 * @param h
+	 */
+	void post(coro_handle_t h);
+
+	/**
+	 * @brief resume h on loop: queued directly when called on the loop's
+	 *        own thread, posted otherwise
+	 *
+	 * @param loop
+	 * @param h
+	 */
+	static void resume_on(Scheduler& loop, coro_handle_t h);
+
+	/**
+	 * @brief the Scheduler of the calling thread, nullptr if it has none
+	 *        yet (instance() would create one)
+	 *
+	 */
+	static Scheduler* of_this_thread() noexcept;
+
+	/**
+	 * @brief spawn a task on this loop from any thread, see post()
+	 *
+	 * @param task
+	 */
+	template <typename Task_RType>
+	void post(Task<Task_RType>&& task);
+
+	/**
+	 * @brief keep the loop running while another thread still has works
+	 *        to post, without it run() returns once the loop itself is idle.
+	 *        Thread safe, each hold() pairs with one release()
+	 *
+	 */
+	void hold() noexcept;
+	void release() noexcept;
+
+	/**
+	 * @brief arm a timer on this thread's loop, node.handle is resumed
+	 *        once node.expire is reached. The node must stay alive until
+	 *        it expires or is cancelled (a destroyed node cancels itself)
+	 *
+	 * @param node
+	 */
+	CNETUTILS_FORCEINLINE static void add_timer(TimerNode& node) {
+		instance().timers.insert(node);
 	}
 
-private:
 	/**
-	 * @brief 	To support Sleep, we need to defines a convient types
-	 *			for the Schedular to decide which one we need sleep
+	 * @brief disarm a timer, O(1), no-op if already expired
 	 *
+	 * @param node
 	 */
-	struct SleepItem {
-		SleepItem(coro_handle_t h,
-		          sch_tp_t tp);
+	CNETUTILS_FORCEINLINE static void cancel_timer(TimerNode& node) noexcept {
+		instance().timers.cancel(node);
+	}
 
-		std::chrono::steady_clock::time_point sleep;
-		std::coroutine_handle<> coro_handle;
+	/**
+	 * @brief queue a suspended coroutine to be resumed by this thread's loop,
+	 *        for the awaiters completing outside of the IOEventManager
+	 *
+	 * @param h
+	 */
+	CNETUTILS_FORCEINLINE static void wake(coro_handle_t h) {
+		instance().internal_spawn(h);
+	}
 
-		CNETUTILS_FORCEINLINE bool operator<(
-		    const SleepItem& other) const noexcept {
-			return sleep > other.sleep;
+	/**
+	 * @brief queue a suspended coroutine behind the next poll, so the fresh
+	 *        I/O and the expired timers go first, see yield()
+	 *
+	 * @param h
+	 */
+	CNETUTILS_FORCEINLINE static void defer(coro_handle_t h) {
+		Scheduler& self = instance();
+		self.deferred.push_back(h);
+		self.loop_stats.yielded.add();
+	}
+
+	/**
+	 * @brief how many coroutines one tick resumes from the ready queue
+	 *        before polling the I/O and the timers again, 0 for no limit.
+	 *        For this thread's loop, DEFAULT_RESUME_BUDGET by default
+	 *
+	 * @param budget
+	 */
+	CNETUTILS_FORCEINLINE static void set_resume_budget(std::size_t budget) noexcept {
+		instance().resume_budget = budget;
+	}
+
+	/**
+	 * @brief how many times a coroutine may go on inline (awaiting or
+	 *        finishing a Task without suspending) before it is made to
+	 *        yield(), so a coroutine whose awaits never block (an always
+	 *        ready socket) can not starve the loop. 0 turns it off (the
+	 *        default), capped at MAX_INLINE_TRANSFERS
+	 *
+	 * @param budget
+	 */
+	CNETUTILS_FORCEINLINE static void set_coop_budget(std::size_t budget) noexcept {
+		instance().coop_budget = std::min(budget, MAX_INLINE_TRANSFERS);
+	}
+
+	static constexpr const std::size_t DEFAULT_RESUME_BUDGET = 256;
+
+	/**
+	 * @brief run this thread's loop on the virtual LoopClock, for the
+	 *        tests and the benchmarks: once nothing is ready, the loop polls
+	 *        without blocking and jumps the time to its next timer. Call it
+	 *        before any timer is armed, there is no way back. The I/O
+	 *        should be in memory (MemoryStream), a real socket gets no time
+	 *        to answer
+	 *
+	 */
+	static void simulate() noexcept;
+
+	/**
+	 * @brief the resolution of the sleeps and the timeouts
+	 *
+	 */
+	static constexpr const std::chrono::microseconds TIMER_TICK { 50 };
+
+	/**
+	 * @brief the target of a symmetric transfer (Task await / final suspend).
+	 *        Without a guaranteed tail call (gcc at -O0/-O1) every transfer
+	 *        nests a call, so after MAX_INLINE_TRANSFERS in one resume the
+	 *        target goes through the ready queue and the stack unwinds.
+	 *        Once the coop budget is spent the target yields instead
+	 *
+	 * @param h
+	 * @return coro_handle_t what the awaiter should resume
+	 */
+	CNETUTILS_FORCEINLINE static coro_handle_t transfer_to(coro_handle_t h) {
+		Scheduler& self = instance();
+		++self.inline_transfers;
+		if (self.coop_budget && self.inline_transfers >= self.coop_budget) {
+			defer(h);
+			return std::noop_coroutine();
 		}
-	};
-	std::queue<std::coroutine_handle<>> ready_coroutines;
-	std::priority_queue<SleepItem> sleepys;
+		if (self.inline_transfers < MAX_INLINE_TRANSFERS)
+			return h;
+		self.internal_spawn(h);
+		return std::noop_coroutine();
+	}
+
+	/**
+	 * @brief snapshot of this thread's loop counters
+	 *
+	 */
+	static LoopStatsSnapshot stats() noexcept {
+		return LoopStatsSnapshot::of(instance().loop_stats);
+	}
+
+	/**
+	 * @brief the counters of all the live loops merged, safe from any
+	 *        thread (a handler may serve it while the loops run)
+	 *
+	 */
+	static LoopStatsSnapshot stats_all();
+
+	~Scheduler() override;
+
+private:
+	/**
+	 * @brief only this thread pushes, but the siblings in the
+	 *        WorkStealingGroup may take from it
+	 */
+	WorkStealingDeque<std::coroutine_handle<>> ready_coroutines;
+
+	/**
+	 * @brief the ready coroutines whose deadline is still armed on this
+	 *        loop's wheel, never stolen
+	 */
+	std::vector<coro_handle_t> pinned_ready;
+
+	/**
+	 * @brief the sleeping coroutines, see AwaitableSleep
+	 *
+	 */
+	TimingWheel timers { LoopClock::now(), TIMER_TICK };
+
+	/**
+	 * @brief the stealing group, nullptr if this loop runs alone
+	 *
+	 */
+	WorkStealingGroup* group { nullptr };
+	std::size_t group_index { 0 };
+
+	/**
+	 * @brief set while this loop blocks in its poll inside a stealing
+	 *        group, a busy sibling clears it and wakes the loop up
+	 */
+	std::atomic<bool> parked { false };
+
+	/**
+	 * @brief the coroutines posted by the other threads
+	 *
+	 */
+	MpscInbox<coro_handle_t> inbox;
+	std::atomic<std::size_t> holds { 0 };
+
+	/**
+	 * @brief this thread's IOEventManager, its eventfd wakes the loop up
+	 *
+	 */
+	IOEventManager* io { nullptr };
+
+	/**
+	 * @brief symmetric transfers since the loop resumed a coroutine
+	 */
+	std::size_t inline_transfers { 0 };
+	static constexpr const std::size_t MAX_INLINE_TRANSFERS = 128;
+
+	/**
+	 * @brief the coroutines which yielded, queued after the next poll
+	 *
+	 */
+	std::vector<coro_handle_t> deferred;
+	std::size_t resume_budget { DEFAULT_RESUME_BUDGET };
+	std::size_t coop_budget { 0 };
+
+	/**
+	 * @brief the counters of this loop, written by this thread only
+	 *
+	 */
+	LoopStats loop_stats;
+
+	/**
+	 * @brief the handles queued by the last poll / timers are the first
+	 *        queued_batch ones taken from the queue (FIFO), their wait is
+	 *        measured from queued_at
+	 */
+	std::size_t queued_batch { 0 };
+	sch_tp_t queued_at {};
 
 private:
-	Scheduler() = default;
+	Scheduler();
 	CNETUTILS_FORCEINLINE sch_tp_t
-	current() const noexcept { return std::chrono::steady_clock::now(); }
+	current() const noexcept { return LoopClock::now(); }
 	/**
-	 * @brief Helpers for find the max sleep await out
+	 * @brief Helpers for find the max sleep await out: 0 if there are works
+	 *        already, else -1 and the next timer deadline is armed in the
+	 *        IOEventManager, which wakes the poll up to the microsecond
 	 *
 	 * @return int
 	 */
-	int caculate_time_out() const noexcept;
+	int caculate_time_out() noexcept;
 
 	/**
 	 * @brief Spawn internal calls
@@ -75,19 +385,51 @@ private:
 	 * @return CNETUTILS_FORCEINLINE
 	 */
 	CNETUTILS_FORCEINLINE void internal_spawn(coro_handle_t h) {
+		push_ready(h);
+		if (group && ready_coroutines.size() > 1)
+			group->wake_idle(*this);
+	}
+
+	/**
+	 * @brief queue a woken coroutine, the pinned ones (see
+	 *        CancellableWait::waker) are kept out of the siblings' reach
+	 *
+	 * @param h
+	 */
+	CNETUTILS_FORCEINLINE void push_ready(coro_handle_t h) {
+		if (CancellableWait::pinned(h)) [[unlikely]] {
+			h = CancellableWait::unpin(h);
+			if (group) {
+				pinned_ready.push_back(h);
+				return;
+			}
+		}
 		ready_coroutines.push(h);
 	}
 
 	/**
-	 * @brief Task helpers for the sleeps, not open as
-	 *		  user is expected to call await sleep(ms)
+	 * @brief resume one ready coroutine, traced
 	 *
-	 * @param which
-	 * @param until_when
-	 * @return CNETUTILS_FORCEINLINE
 	 */
-	CNETUTILS_FORCEINLINE void sleep_until(
-	    coro_handle_t which, sch_tp_t until_when) { sleepys.emplace(which, until_when); }
+	void resume_ready(coro_handle_t h);
+
+	/**
+	 * @brief whether anything may still resume a coroutine on this loop
+	 *
+	 */
+	bool has_pending_works() const noexcept;
+
+	/**
+	 * @brief move the posted coroutines to the ready queue
+	 *
+	 */
+	void take_posted();
+
+	/**
+	 * @brief wake the loop up from its poll, any thread
+	 *
+	 */
+	void notify() noexcept;
 
 	/**
 	 * @brief 	Actual Run and de-wrapper from instance of
@@ -95,6 +437,13 @@ private:
 	 */
 	void __run();
 
+	/**
+	 * @brief resume the local ready coroutines until the queue is empty,
+	 *        or the resume budget of the tick is spent
+	 *
+	 */
+	void drain_ready();
+
 	/**
 	 * @brief in_spawn a type for the schedular
 	 *
@@ -106,37 +455,76 @@ private:
 };
 
 /**
- * @brief Sleep call awaitable
+ * @brief Sleep call awaitable, the timer node lives in the awaitable,
+ *        so sleeping never allocates. A cancelled token wakes it early
  *
  */
-struct AwaitableSleep {
-	AwaitableSleep(std::chrono::milliseconds how_long)
-	    : duration(how_long)
-	    , wake_time(std::chrono::steady_clock::now() + how_long) { }
+struct AwaitableSleep : CancellableWait {
+	AwaitableSleep(std::chrono::nanoseconds how_long)
+	    : duration(how_long) {
+		node.expire = LoopClock::now() + how_long;
+	}
 
 	/**
 	 * @brief await_ready always lets the sessions sleep!
 	 *
 	 */
 	bool await_ready() { return false; }
-	void await_suspend(std::coroutine_handle<> h) {
-		Scheduler::instance().sleep_until(h, wake_time);
+
+	template <typename Promise>
+	bool await_suspend(std::coroutine_handle<Promise> h) {
+		if (watch(token_of(h), &AwaitableSleep::wake_early))
+			return false;
+		node.handle = waker(h);
+		Scheduler::add_timer(node);
+		return true;
 	}
 
-	void await_resume() { }
+	void await_resume() { unwatch(); }
+
+private:
+	static void wake_early(CancellableWait& wait) {
+		auto& self = static_cast<AwaitableSleep&>(wait);
+		Scheduler::cancel_timer(self.node);
+		Scheduler::wake(self.node.handle);
+	}
 
 private:
-	std::chrono::milliseconds duration;
-	std::chrono::steady_clock::time_point wake_time;
+	std::chrono::nanoseconds duration;
+	TimerNode node;
 };
 
-CNETUTILS_FORCEINLINE AwaitableSleep sleep(std::chrono::milliseconds s) {
+/**
+ * @brief co_await sleep(250us): precise to Scheduler::TIMER_TICK
+ *
+ */
+CNETUTILS_FORCEINLINE AwaitableSleep sleep(std::chrono::nanoseconds s) {
 	return { s };
 }
 
+/**
+ * @brief co_await yield(): let the loop poll the I/O and fire the timers
+ *        before resuming us, for the long running loops that never block
+ *
+ */
+struct AwaitableYield {
+	bool await_ready() noexcept { return false; }
+	void await_suspend(std::coroutine_handle<> h) { Scheduler::defer(h); }
+	void await_resume() noexcept { }
+};
+
+CNETUTILS_FORCEINLINE AwaitableYield yield() noexcept {
+	return {};
+}
+
 #include "Task.hpp"
 template <typename T>
 inline void Scheduler::__spawn(Task<T>&& task) {
+	// nobody will await it, the frame frees itself at final_suspend
+	auto& promise = task.coroutine_handle.promise();
+	promise.detached = true;
+	promise.trace_span = TraceRecorder::next_span();
+	TraceRecorder::record_span(TraceRecord::Kind::Spawn, task.coroutine_handle.address(), promise.trace_span);
 	internal_spawn(task.coroutine_handle);
 	task.coroutine_handle = nullptr;
 }
@@ -144,4 +532,109 @@ inline void Scheduler::__spawn(Task<T>&& task) {
 template <typename Task_RType>
 inline void Scheduler::spawn(Task<Task_RType>&& task) {
 	instance().__spawn(std::move(task));
-}
\ No newline at end of file
+}
+
+template <typename Task_RType>
+inline void Scheduler::post(Task<Task_RType>&& task) {
+	auto& promise = task.coroutine_handle.promise();
+	promise.detached = true;
+	promise.trace_span = TraceRecorder::next_span();
+	TraceRecorder::record_span(TraceRecord::Kind::Spawn, task.coroutine_handle.address(), promise.trace_span);
+	post(task.coroutine_handle);
+	task.coroutine_handle = nullptr;
+}
+
+/**
+ * @brief   LoopHold keeps a Scheduler running for as long as it lives,
+ *          for the threads which will post to the loop later
+ *
+ */
+class LoopHold {
+public:
+	explicit LoopHold(Scheduler& loop) noexcept
+	    : loop(&loop) {
+		loop.hold();
+	}
+	~LoopHold() {
+		if (loop)
+			loop->release();
+	}
+	LoopHold(LoopHold&& other) noexcept
+	    : loop(other.loop) {
+		other.loop = nullptr;
+	}
+	LoopHold& operator=(LoopHold&&) = delete;
+	LoopHold(const LoopHold&) = delete;
+	LoopHold& operator=(const LoopHold&) = delete;
+
+	CNETUTILS_FORCEINLINE Scheduler& scheduler() const noexcept { return *loop; }
+
+private:
+	Scheduler* loop;
+};
+/**
+ * @brief   LoopWaiter is a coroutine parked on a primitive shared by
+ *          several loops (a channel, a semaphore), resumed on its own loop
+ *          by whichever thread wakes it. Nothing local may wake it, so the
+ *          waiter holds its loop meanwhile. Intrusive, it lives in the
+ *          awaiter, and next links it in the primitive's LoopWaiterQueue
+ *
+ */
+struct LoopWaiter {
+	std::coroutine_handle<> handle;
+	Scheduler* loop { nullptr };
+	LoopWaiter* next { nullptr };
+
+	/**
+	 * @brief call in await_suspend, before a waker may see the waiter
+	 *
+	 */
+	void park(std::coroutine_handle<> h) noexcept {
+		handle = h;
+		loop = &Scheduler::instance();
+		next = nullptr;
+		loop->hold();
+	}
+
+	/**
+	 * @brief resume it on its loop, any thread. The waiter is gone as
+	 *        soon as its coroutine runs, do not touch it afterwards
+	 *
+	 */
+	void wake() {
+		Scheduler* owner = loop;
+		Scheduler::resume_on(*owner, handle);
+		owner->release();
+	}
+};
+
+/**
+ * @brief FIFO of the waiters W (LoopWaiters), not locked
+ *
+ */
+template <typename W>
+struct LoopWaiterQueue {
+	LoopWaiter* head { nullptr };
+	LoopWaiter* tail { nullptr };
+
+	CNETUTILS_FORCEINLINE bool empty() const noexcept { return head == nullptr; }
+
+	void push(W& waiter) noexcept {
+		waiter.next = nullptr;
+		if (tail)
+			tail->next = &waiter;
+		else
+			head = &waiter;
+		tail = &waiter;
+	}
+
+	W* pop() noexcept {
+		LoopWaiter* waiter = head;
+		if (waiter) {
+			head = waiter->next;
+			if (!head)
+				tail = nullptr;
+		}
+		return static_cast<W*>(waiter);
+	}
+};
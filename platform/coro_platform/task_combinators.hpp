@@ -0,0 +1,417 @@
+#pragma once
+
+#include "Task.hpp"
+#include "cancellation.hpp"
+#include "frame_pool.hpp"
+#include "scheduler.hpp"
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace combinator_detail {
+/**
+ * @brief the value a child leaves in the shared state, void becomes monostate
+ *
+ */
+template <typename T>
+using slot_t = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+/**
+ * @brief   Child drives one Task of a combinator as a detached coroutine.
+ *          Its promise owns the child's own CancellationToken (a leaf wait
+ *          hooks one token, so concurrent children can not share one),
+ *          linked under the token the combinator hands down.
+ *          Once the Task is done the token is unlinked, the state is told,
+ *          and the frame frees itself.
+ *
+ */
+class Child {
+public:
+	struct promise_type;
+	using handle_t = std::coroutine_handle<promise_type>;
+	using done_fn = void (*)(void* state, std::size_t index);
+
+	struct FinalAwaiter {
+		bool await_ready() noexcept { return false; }
+		void await_suspend(handle_t h) noexcept {
+			auto& promise = h.promise();
+			// the parent may resume right after on_done, and free its token
+			promise.token.unlink();
+			promise.on_done(promise.state, promise.index);
+			h.destroy();
+		}
+		void await_resume() noexcept { }
+	};
+
+	struct promise_type {
+		CancellationToken token;
+		CancellationToken* cancel_token { &token }; // inherited by the awaited Task
+		done_fn on_done { nullptr };
+		void* state { nullptr };
+		std::size_t index { 0 };
+
+		static void* operator new(std::size_t size) { return FramePool::allocate(size); }
+		static void operator delete(void* ptr, std::size_t size) noexcept { FramePool::deallocate(ptr, size); }
+
+		Child get_return_object() { return Child { handle_t::from_promise(*this) }; }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		void return_void() noexcept { }
+		void unhandled_exception() noexcept { }
+	};
+
+	explicit Child(handle_t h)
+	    : handle(h) { }
+	Child(Child&& other) noexcept
+	    : handle(std::exchange(other.handle, nullptr)) { }
+	~Child() {
+		if (handle)
+			handle.destroy();
+	}
+
+	/**
+	 * @brief queue the child on this loop, it owns itself from now on
+	 *
+	 * @param parent_token the child's token is linked under it
+	 */
+	void start(CancellationToken* parent_token, done_fn on_done, void* state, std::size_t index) {
+		auto& promise = handle.promise();
+		promise.token.link_under(parent_token);
+		promise.on_done = on_done;
+		promise.state = state;
+		promise.index = index;
+		Scheduler::wake(std::exchange(handle, nullptr));
+	}
+
+private:
+	handle_t handle;
+
+	Child(const Child&) = delete;
+	Child& operator=(const Child&) = delete;
+};
+
+/**
+ * @brief co_await the task and hand its value to state->store(index, value),
+ *        the index is an integral_constant for the tuple states
+ *
+ */
+template <typename State, typename T, typename Index>
+Child run_child(std::shared_ptr<State> state, Task<T> task, Index index) {
+	if constexpr (std::is_void_v<T>) {
+		co_await task;
+		state->store(index, std::monostate {});
+	} else {
+		state->store(index, co_await task);
+	}
+}
+
+/**
+ * @brief when_all over a pack, the parent resumes with the last child
+ *
+ */
+template <typename... Ts>
+struct AllOfPack {
+	using result_t = std::tuple<slot_t<Ts>...>;
+
+	std::coroutine_handle<> parent;
+	std::tuple<std::optional<slot_t<Ts>>...> slots;
+	std::atomic<std::size_t> remaining { sizeof...(Ts) + 1 }; // and the parent's start
+
+	template <std::size_t I, typename V>
+	void store(std::integral_constant<std::size_t, I>, V&& value) {
+		std::get<I>(slots).emplace(std::forward<V>(value));
+	}
+
+	static void child_done(void* state, std::size_t) {
+		auto self = static_cast<AllOfPack*>(state);
+		if (self->arrive())
+			Scheduler::wake(self->parent);
+	}
+
+	/**
+	 * @brief true for the last arrival, who resumes the parent
+	 *
+	 */
+	bool arrive() noexcept {
+		return remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+	}
+
+	result_t take() {
+		return std::apply([](auto&... slot) { return result_t { std::move(*slot)... }; }, slots);
+	}
+};
+
+/**
+ * @brief when_all over a vector
+ *
+ */
+template <typename T>
+struct AllOfRange {
+	using result_t = std::conditional_t<std::is_void_v<T>, void, std::vector<T>>;
+
+	std::coroutine_handle<> parent;
+	std::vector<std::optional<slot_t<T>>> slots;
+	std::atomic<std::size_t> remaining;
+
+	explicit AllOfRange(std::size_t count)
+	    : slots(count)
+	    , remaining(count + 1) { } // and the parent's start
+
+	template <typename V>
+	void store(std::size_t index, V&& value) {
+		slots[index].emplace(std::forward<V>(value));
+	}
+
+	static void child_done(void* state, std::size_t) {
+		auto self = static_cast<AllOfRange*>(state);
+		if (self->arrive())
+			Scheduler::wake(self->parent);
+	}
+
+	/**
+	 * @brief true for the last arrival, who resumes the parent
+	 *
+	 */
+	bool arrive() noexcept {
+		return remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+	}
+
+	result_t take() {
+		if constexpr (!std::is_void_v<T>) {
+			std::vector<T> values;
+			values.reserve(slots.size());
+			for (auto& slot : slots)
+				values.emplace_back(std::move(*slot));
+			return values;
+		}
+	}
+};
+
+/**
+ * @brief when_any, the first child to finish wins and the others are
+ *        cancelled. The parent resumes with the last of them: their
+ *        operations (an io_uring recv) may still use its frame until then
+ *
+ */
+template <typename T>
+struct AnyOf {
+	static constexpr const std::size_t NO_WINNER = std::numeric_limits<std::size_t>::max();
+
+	std::coroutine_handle<> parent;
+	CancellationToken group; // the children are linked under it
+	std::atomic<std::size_t> winner { NO_WINNER };
+	std::optional<slot_t<T>> value;
+	std::atomic<std::size_t> remaining; // the children and the parent's start
+	std::atomic<int> until_cancel { 2 }; // the winner and the parent's start
+
+	explicit AnyOf(std::size_t count)
+	    : remaining(count + 1) { }
+
+	template <typename V>
+	void store(std::size_t index, V&& result) {
+		std::size_t expected = NO_WINNER;
+		if (winner.compare_exchange_strong(expected, index, std::memory_order_acq_rel))
+			value.emplace(std::forward<V>(result));
+	}
+
+	static void child_done(void* state, std::size_t index) {
+		auto self = static_cast<AnyOf*>(state);
+		if (self->winner.load(std::memory_order_acquire) == index)
+			self->settle();
+		if (self->arrive())
+			Scheduler::wake(self->parent);
+	}
+
+	/**
+	 * @brief cancel the losers once there is a winner and all of them
+	 *        are started, by whoever of the two comes last
+	 *
+	 */
+	void settle() {
+		if (until_cancel.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			group.cancel();
+	}
+
+	/**
+	 * @brief true for the last arrival, who resumes the parent
+	 *
+	 */
+	bool arrive() noexcept {
+		return remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+	}
+};
+}
+
+/**
+ * @brief what when_any resumes with: the index of the winner and its value
+ *
+ */
+template <typename T>
+struct WhenAnyResult {
+	std::size_t index;
+	T value;
+};
+
+template <>
+struct WhenAnyResult<void> {
+	std::size_t index;
+};
+
+template <typename... Ts>
+class WhenAllPack {
+	using state_t = combinator_detail::AllOfPack<Ts...>;
+
+public:
+	explicit WhenAllPack(Task<Ts>&&... tasks)
+	    : state(std::make_shared<state_t>())
+	    , children(std::move(tasks)...) { }
+
+	bool await_ready() const noexcept { return sizeof...(Ts) == 0; }
+
+	// a child stolen by a sibling loop may finish before we suspend
+	template <typename Promise>
+	bool await_suspend(std::coroutine_handle<Promise> h) {
+		state->parent = h;
+		start_all(token_of(h), std::index_sequence_for<Ts...> {});
+		return !state->arrive();
+	}
+
+	typename state_t::result_t await_resume() { return state->take(); }
+
+private:
+	std::shared_ptr<state_t> state;
+	std::tuple<Task<Ts>...> children;
+
+	template <std::size_t... Is>
+	void start_all(CancellationToken* token, std::index_sequence<Is...>) {
+		(combinator_detail::run_child(state, std::move(std::get<Is>(children)),
+		                              std::integral_constant<std::size_t, Is> {})
+		     .start(token, &state_t::child_done, state.get(), Is),
+		 ...);
+	}
+};
+
+template <typename T>
+class WhenAllRange {
+	using state_t = combinator_detail::AllOfRange<T>;
+
+public:
+	explicit WhenAllRange(std::vector<Task<T>>&& tasks)
+	    : state(std::make_shared<state_t>(tasks.size()))
+	    , children(std::move(tasks)) { }
+
+	bool await_ready() const noexcept { return children.empty(); }
+
+	template <typename Promise>
+	bool await_suspend(std::coroutine_handle<Promise> h) {
+		state->parent = h;
+		CancellationToken* token = token_of(h);
+		for (std::size_t i = 0; i < children.size(); i++)
+			combinator_detail::run_child(state, std::move(children[i]), i)
+			    .start(token, &state_t::child_done, state.get(), i);
+		children.clear();
+		return !state->arrive();
+	}
+
+	typename state_t::result_t await_resume() { return state->take(); }
+
+private:
+	std::shared_ptr<state_t> state;
+	std::vector<Task<T>> children;
+};
+
+template <typename T>
+class WhenAny {
+	using state_t = combinator_detail::AnyOf<T>;
+
+public:
+	explicit WhenAny(std::vector<Task<T>>&& tasks)
+	    : state(std::make_shared<state_t>(tasks.size()))
+	    , children(std::move(tasks)) { }
+
+	bool await_ready() const noexcept { return children.empty(); }
+
+	template <typename Promise>
+	bool await_suspend(std::coroutine_handle<Promise> h) {
+		state->parent = h;
+		state->group.link_under(token_of(h));
+		for (std::size_t i = 0; i < children.size(); i++)
+			combinator_detail::run_child(state, std::move(children[i]), i)
+			    .start(&state->group, &state_t::child_done, state.get(), i);
+		children.clear();
+		state->settle();
+		return !state->arrive();
+	}
+
+	/**
+	 * @brief all the children are done here, the losers cancelled
+	 * @exception std::invalid_argument: when_any over no tasks
+	 *
+	 */
+	WhenAnyResult<T> await_resume() {
+		if (state->winner.load(std::memory_order_acquire) == state_t::NO_WINNER)
+			throw std::invalid_argument("when_any over no tasks");
+		state->group.unlink();
+		if constexpr (std::is_void_v<T>)
+			return { state->winner.load(std::memory_order_relaxed) };
+		else
+			return { state->winner.load(std::memory_order_relaxed), std::move(*state->value) };
+	}
+
+private:
+	std::shared_ptr<state_t> state;
+	std::vector<Task<T>> children;
+};
+
+/**
+ * @brief run the tasks concurrently on the Scheduler, the awaiting
+ *        coroutine resumes once, when all of them are done
+ *
+ * @return std::tuple of the values, std::monostate for Task<void>
+ */
+template <typename... Ts>
+CNETUTILS_FORCEINLINE WhenAllPack<Ts...> when_all(Task<Ts>&&... tasks) {
+	return WhenAllPack<Ts...> { std::move(tasks)... };
+}
+
+/**
+ * @brief the range version of when_all
+ *
+ * @return std::vector<T> in the order of the tasks, void for Task<void>
+ */
+template <typename T>
+CNETUTILS_FORCEINLINE WhenAllRange<T> when_all(std::vector<Task<T>> tasks) {
+	return WhenAllRange<T> { std::move(tasks) };
+}
+
+/**
+ * @brief run the tasks concurrently, resume with the first one done.
+ *        The others are cancelled through their CancellationToken (their
+ *        socket waits and sleeps give up), and awaited: the buffers they
+ *        were handed are free again once the parent resumes
+ *
+ * @return WhenAnyResult<T>: the index of the winner, and its value
+ */
+template <typename T>
+CNETUTILS_FORCEINLINE WhenAny<T> when_any(std::vector<Task<T>> tasks) {
+	return WhenAny<T> { std::move(tasks) };
+}
+
+template <typename T, typename... Rest>
+    requires(std::is_same_v<Task<T>, std::decay_t<Rest>> && ...)
+CNETUTILS_FORCEINLINE WhenAny<T> when_any(Task<T>&& first, Rest&&... rest) {
+	std::vector<Task<T>> tasks;
+	tasks.reserve(1 + sizeof...(Rest));
+	tasks.emplace_back(std::move(first));
+	(tasks.emplace_back(std::move(rest)), ...);
+	return WhenAny<T> { std::move(tasks) };
+}
@@ -0,0 +1,172 @@
+#include "timing_wheel.hpp"
+#include <algorithm>
+#include <bit>
+
+TimerNode::~TimerNode() {
+	if (owner)
+		owner->cancel(*this);
+}
+
+TimingWheel::TimingWheel(time_point start, std::chrono::nanoseconds tick)
+    : start(start)
+    , tick(tick) {
+}
+
+TimingWheel::~TimingWheel() {
+	// leave the nodes alive but unarmed, they are owned by the waiters
+	auto release = [](TimerNode* node) {
+		while (node) {
+			TimerNode* next = node->next;
+			node->owner = nullptr;
+			node->prev = node->next = nullptr;
+			node = next;
+		}
+	};
+	for (auto& level : wheels)
+		for (auto head : level)
+			release(head);
+	release(due);
+}
+
+TimingWheel::tick_t TimingWheel::to_tick(time_point tp) const noexcept {
+	if (tp <= start)
+		return 0;
+	// round up, so a timer never fires earlier than asked
+	auto elapsed = tp - start;
+	return (tick_t)((elapsed + tick - std::chrono::nanoseconds(1)) / tick);
+}
+
+void TimingWheel::insert(TimerNode& node) {
+	if (node.owner)
+		cancel(node);
+	node.owner = this;
+	node.expire_tick = to_tick(node.expire);
+	armed_count++;
+	place(node);
+}
+
+void TimingWheel::cancel(TimerNode& node) noexcept {
+	if (node.owner != this)
+		return;
+	unlink(node);
+	node.owner = nullptr;
+	armed_count--;
+}
+
+void TimingWheel::place(TimerNode& node) noexcept {
+	if (node.expire_tick <= current) {
+		node.level = DUE_LEVEL;
+		node.slot = 0;
+		link(due, node);
+		return;
+	}
+
+	// the timers farther than the top level can hold are clamped, they will
+	// be placed again when their top level slot cascades
+	static constexpr const tick_t MAX_SPAN = (tick_t(1) << (SLOT_BITS * LEVELS)) - 1;
+	const tick_t at = std::min(node.expire_tick, current + MAX_SPAN);
+
+	// the highest digit where `at` differs from now decides the level,
+	// crossing the round of the top level wraps around in the top level
+	unsigned level = (unsigned)(std::bit_width(at ^ current) - 1) / SLOT_BITS;
+	if (level >= LEVELS)
+		level = LEVELS - 1;
+	const unsigned slot = (unsigned)(at >> (level * SLOT_BITS)) & (SLOTS - 1);
+	node.level = (std::uint8_t)level;
+	node.slot = (std::uint8_t)slot;
+	link(wheels[level][slot], node);
+	occupied[level] |= std::uint64_t(1) << slot;
+}
+
+void TimingWheel::link(TimerNode*& head, TimerNode& node) noexcept {
+	node.prev = nullptr;
+	node.next = head;
+	if (head)
+		head->prev = &node;
+	head = &node;
+}
+
+void TimingWheel::unlink(TimerNode& node) noexcept {
+	TimerNode*& head = node.level == DUE_LEVEL
+	    ? due
+	    : wheels[node.level][node.slot];
+	if (node.prev)
+		node.prev->next = node.next;
+	else
+		head = node.next;
+	if (node.next)
+		node.next->prev = node.prev;
+	node.prev = node.next = nullptr;
+
+	if (node.level != DUE_LEVEL && !head)
+		occupied[node.level] &= ~(std::uint64_t(1) << node.slot);
+}
+
+TimerNode* TimingWheel::take(std::uint8_t level, std::uint8_t slot) noexcept {
+	TimerNode* head;
+	if (level == DUE_LEVEL) {
+		head = due;
+		due = nullptr;
+	} else {
+		head = wheels[level][slot];
+		wheels[level][slot] = nullptr;
+		occupied[level] &= ~(std::uint64_t(1) << slot);
+	}
+	return head;
+}
+
+std::optional<TimingWheel::tick_t> TimingWheel::next_event_tick() const noexcept {
+	std::optional<tick_t> best;
+	for (unsigned level = 0; level < LEVELS; level++) {
+		if (!occupied[level])
+			continue;
+		const unsigned shift = level * SLOT_BITS;
+		const unsigned digit = (unsigned)(current >> shift) & (SLOTS - 1);
+		const tick_t round = current & ~((tick_t(1) << (shift + SLOT_BITS)) - 1);
+
+		// the slots after the current digit belong to this round,
+		// only the top level may hold the next round (wrapped around)
+		const std::uint64_t later = digit == SLOTS - 1
+		    ? 0
+		    : occupied[level] & (~std::uint64_t(0) << (digit + 1));
+		tick_t at;
+		if (later) {
+			at = round | (tick_t(std::countr_zero(later)) << shift);
+		} else if (level == LEVELS - 1) {
+			const tick_t next_round = round + (tick_t(1) << (shift + SLOT_BITS));
+			at = next_round | (tick_t(std::countr_zero(occupied[level])) << shift);
+		} else {
+			continue;
+		}
+		if (!best || at < *best)
+			best = at;
+	}
+	return best;
+}
+
+void TimingWheel::cascade(tick_t at) noexcept {
+	// from the top down, so the nodes may fall through several levels
+	for (unsigned level = LEVELS - 1; level >= 1; level--) {
+		const unsigned shift = level * SLOT_BITS;
+		if (at & ((tick_t(1) << shift) - 1))
+			continue; // not a boundary of this level
+		const unsigned slot = (unsigned)(at >> shift) & (SLOTS - 1);
+		TimerNode* node = take((std::uint8_t)level, (std::uint8_t)slot);
+		while (node) {
+			TimerNode* next = node->next;
+			place(*node);
+			node = next;
+		}
+	}
+}
+
+std::optional<TimingWheel::time_point> TimingWheel::next_expiry() const noexcept {
+	if (armed_count == 0)
+		return std::nullopt;
+	if (due)
+		return start + tick * current;
+	auto next_tick = next_event_tick();
+	if (!next_tick.has_value())
+		return std::nullopt;
+	return start + tick * (*next_tick);
+}
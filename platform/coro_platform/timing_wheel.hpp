@@ -0,0 +1,183 @@
+#pragma once
+
+#include "library_utils.h"
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+class TimingWheel;
+
+/**
+ * @brief   TimerNode is an intrusive timer entry, it lives inside the waiter
+ *          (for example the AwaitableSleep in a coroutine frame), so arming
+ *          or cancelling a timer never allocates
+ *
+ */
+struct TimerNode {
+	using time_point = std::chrono::steady_clock::time_point;
+
+	TimerNode() = default;
+	~TimerNode();
+
+	/**
+	 * @brief when the timer expires
+	 *
+	 */
+	time_point expire {};
+
+	/**
+	 * @brief who will be resumed when the timer expires
+	 *
+	 */
+	std::coroutine_handle<> handle;
+
+	/**
+	 * @brief called instead of resuming the handle, if set
+	 *
+	 */
+	void (*on_expire)(TimerNode& node) { nullptr };
+
+	/**
+	 * @brief whether the node is armed in a wheel
+	 *
+	 */
+	CNETUTILS_FORCEINLINE bool armed() const noexcept { return owner != nullptr; }
+
+private:
+	friend class TimingWheel;
+	TimingWheel* owner { nullptr };
+	TimerNode* prev { nullptr };
+	TimerNode* next { nullptr };
+	std::uint64_t expire_tick { 0 };
+	std::uint8_t level { 0 };
+	std::uint8_t slot { 0 };
+
+	TimerNode(const TimerNode&) = delete;
+	TimerNode& operator=(const TimerNode&) = delete;
+};
+
+/**
+ * @brief   TimingWheel is a hierarchical timing wheel: LEVELS wheels of
+ *          SLOTS slots, each level is SLOTS times coarser than the one below.
+ *          Insert and cancel are O(1), the timers of a slot expire in batch,
+ *          and the empty ticks are skipped with the slot occupancy bitmaps.
+ *          A timer never expires before its deadline, but may expire up to
+ *          one tick later.
+ *
+ */
+class TimingWheel {
+public:
+	using time_point = std::chrono::steady_clock::time_point;
+	using tick_t = std::uint64_t;
+
+	static constexpr const unsigned SLOT_BITS = 6;
+	static constexpr const std::size_t SLOTS = 1 << SLOT_BITS;
+	static constexpr const std::size_t LEVELS = 6;
+
+	explicit TimingWheel(time_point start,
+	                     std::chrono::nanoseconds tick = std::chrono::milliseconds(1));
+	~TimingWheel();
+
+	/**
+	 * @brief arm the node, a node armed already is re-armed
+	 *
+	 * @param node
+	 */
+	void insert(TimerNode& node);
+
+	/**
+	 * @brief disarm the node, no-op if the node is not armed
+	 *
+	 * @param node
+	 */
+	void cancel(TimerNode& node) noexcept;
+
+	/**
+	 * @brief expire all the timers due at now, the node is disarmed
+	 *        before on_expire is called, so on_expire may re-arm it
+	 *
+	 * @tparam OnExpire void(TimerNode&)
+	 * @param now
+	 * @param on_expire
+	 */
+	template <typename OnExpire>
+	void advance(time_point now, OnExpire&& on_expire);
+
+	/**
+	 * @brief the earliest time the wheel needs to advance, it may be a
+	 *        cascading point earlier than the real expiry
+	 *
+	 * @return std::optional<time_point> nullopt if no timers are armed
+	 */
+	std::optional<time_point> next_expiry() const noexcept;
+
+	/**
+	 * @brief the time of the last processed tick
+	 *
+	 */
+	CNETUTILS_FORCEINLINE time_point position() const noexcept { return start + tick * current; }
+
+	CNETUTILS_FORCEINLINE bool empty() const noexcept { return armed_count == 0; }
+	CNETUTILS_FORCEINLINE std::size_t size() const noexcept { return armed_count; }
+
+private:
+	/**
+	 * @brief the nodes already due, drained by the next advance()
+	 *
+	 */
+	static constexpr const std::uint8_t DUE_LEVEL = LEVELS;
+
+	time_point start;
+	std::chrono::nanoseconds tick;
+	tick_t current { 0 }; // the last processed tick
+	std::size_t armed_count { 0 };
+
+	std::array<std::array<TimerNode*, SLOTS>, LEVELS> wheels {};
+	std::array<std::uint64_t, LEVELS> occupied {}; // bitmaps of non-empty slots
+	TimerNode* due { nullptr };
+
+	tick_t to_tick(time_point tp) const noexcept;
+	void place(TimerNode& node) noexcept;
+	void link(TimerNode*& head, TimerNode& node) noexcept;
+	void unlink(TimerNode& node) noexcept;
+	std::optional<tick_t> next_event_tick() const noexcept;
+	void cascade(tick_t at) noexcept;
+
+	/**
+	 * @brief take the whole list out of a slot (or the due list)
+	 */
+	TimerNode* take(std::uint8_t level, std::uint8_t slot) noexcept;
+};
+
+template <typename OnExpire>
+inline void TimingWheel::advance(time_point now, OnExpire&& on_expire) {
+	const tick_t target = now < start ? 0 : (tick_t)((now - start) / tick);
+
+	auto fire = [&](TimerNode* node) {
+		while (node) {
+			TimerNode* next = node->next;
+			node->owner = nullptr;
+			node->prev = node->next = nullptr;
+			armed_count--;
+			on_expire(*node);
+			node = next;
+		}
+	};
+
+	fire(take(DUE_LEVEL, 0));
+	while (armed_count > 0) {
+		auto next_tick = next_event_tick();
+		if (!next_tick.has_value() || *next_tick > target)
+			break;
+		current = *next_tick;
+		cascade(current);
+		fire(take(0, current & (SLOTS - 1)));
+		// cascading may move the timers of this very tick to due
+		fire(take(DUE_LEVEL, 0));
+	}
+	if (current < target)
+		current = target;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+/**
+ * @brief   WorkStealingDeque is a lock-free Chase-Lev deque, the owner thread
+ *          pushes at the bottom and any thread (the owner included) takes from
+ *          the top, so the owner keeps the FIFO order of an event loop
+ *          while the idle workers steal the oldest works.
+ *
+ * @tparam T must be trivially copyable (like std::coroutine_handle<>)
+ */
+template <typename T>
+class WorkStealingDeque {
+public:
+	static constexpr const std::size_t DEFAULT_CAPACITY = 256;
+
+	explicit WorkStealingDeque(std::size_t capacity = DEFAULT_CAPACITY) {
+		std::size_t cap = 1;
+		while (cap < capacity)
+			cap <<= 1;
+		auto first = std::make_unique<Ring>(cap);
+		ring.store(first.get(), std::memory_order_relaxed);
+		rings.emplace_back(std::move(first));
+	}
+
+	/**
+	 * @brief push a work at the bottom, owner thread only
+	 *
+	 * @param value
+	 */
+	void push(T value) {
+		std::int64_t b = bottom.load(std::memory_order_relaxed);
+		std::int64_t t = top.load(std::memory_order_acquire);
+		Ring* r = ring.load(std::memory_order_relaxed);
+		if (b - t > static_cast<std::int64_t>(r->capacity) - 1) {
+			r = grow(r, b, t);
+		}
+		r->put(b, value);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief take the oldest work from the top, safe from any thread
+	 *
+	 * @return std::optional<T> empty if nothing left or another thread won the race
+	 */
+	std::optional<T> steal() {
+		std::int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		std::int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return std::nullopt;
+
+		T value = ring.load(std::memory_order_acquire)->get(t);
+		if (!top.compare_exchange_strong(t, t + 1,
+		                                 std::memory_order_seq_cst,
+		                                 std::memory_order_relaxed))
+			return std::nullopt;
+		return value;
+	}
+
+	/**
+	 * @brief approximate size, exact when called by the owner with no thieves
+	 *
+	 * @return std::size_t
+	 */
+	std::size_t size() const noexcept {
+		std::int64_t b = bottom.load(std::memory_order_relaxed);
+		std::int64_t t = top.load(std::memory_order_relaxed);
+		return b > t ? static_cast<std::size_t>(b - t) : 0;
+	}
+
+	bool empty() const noexcept { return size() == 0; }
+
+private:
+	struct Ring {
+		explicit Ring(std::size_t cap)
+		    : capacity(cap)
+		    , mask(cap - 1)
+		    , slots(new std::atomic<T>[cap]) { }
+
+		void put(std::int64_t index, T value) noexcept {
+			slots[static_cast<std::size_t>(index) & mask].store(value, std::memory_order_relaxed);
+		}
+
+		T get(std::int64_t index) const noexcept {
+			return slots[static_cast<std::size_t>(index) & mask].load(std::memory_order_relaxed);
+		}
+
+		std::size_t capacity;
+		std::size_t mask;
+		std::unique_ptr<std::atomic<T>[]> slots;
+	};
+
+	/**
+	 * @brief double the ring, the old rings are kept alive as the thieves
+	 *        may still be reading them
+	 */
+	Ring* grow(Ring* old, std::int64_t b, std::int64_t t) {
+		auto bigger = std::make_unique<Ring>(old->capacity << 1);
+		for (std::int64_t i = t; i < b; i++)
+			bigger->put(i, old->get(i));
+		Ring* r = bigger.get();
+		rings.emplace_back(std::move(bigger));
+		ring.store(r, std::memory_order_release);
+		return r;
+	}
+
+	alignas(64) std::atomic<std::int64_t> top { 0 };
+	alignas(64) std::atomic<std::int64_t> bottom { 0 };
+	std::atomic<Ring*> ring { nullptr };
+	std::vector<std::unique_ptr<Ring>> rings; // owner only
+};
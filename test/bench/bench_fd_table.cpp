@@ -0,0 +1,123 @@
+#include "fd_table.hpp"
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief the waiter table of IOEventManager, before and after the flat
+ *        table: 100k idle connections stay registered, 10k active ones
+ *        keep suspending and being woken up
+ */
+
+static std::size_t allocations = 0;
+
+void* operator new(std::size_t size) {
+	allocations++;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+static constexpr const int IDLE_CONNECTIONS = 100000;
+static constexpr const int ACTIVE_CONNECTIONS = 10000;
+static constexpr const int ROUNDS = 100;
+static constexpr const int FIRST_FD = 8; // stdio, epoll, listeners...
+
+struct Result {
+	double ns_per_wait;
+	std::size_t allocations;
+};
+
+// as before: insert on every wait, find and erase on every wakeup
+static Result bench_hash_map(const std::vector<int>& active, std::coroutine_handle<> h) {
+	struct Waiter {
+		std::uint32_t events;
+		std::coroutine_handle<> handle;
+	};
+	std::unordered_map<int, Waiter> table;
+	for (int fd = FIRST_FD; fd < FIRST_FD + IDLE_CONNECTIONS + ACTIVE_CONNECTIONS; fd++)
+		table[fd] = Waiter { 1, h };
+	for (int fd : active)
+		table.erase(fd);
+
+	std::size_t woken = 0;
+	const std::size_t before = allocations;
+	auto start = std::chrono::steady_clock::now();
+	for (int round = 0; round < ROUNDS; round++) {
+		for (int fd : active)
+			table[fd] = Waiter { 1, h };
+		for (int fd : active) {
+			auto it = table.find(fd);
+			if (it != table.end()) {
+				woken += it->second.handle == h;
+				table.erase(it);
+			}
+		}
+	}
+	auto cost = std::chrono::steady_clock::now() - start;
+	if (woken != (std::size_t)ROUNDS * active.size())
+		std::abort();
+	return { std::chrono::duration<double, std::nano>(cost).count() / woken, allocations - before };
+}
+
+// now: the slots stay, a wait fills the waiter and a wakeup takes it
+static Result bench_fd_table(const std::vector<int>& active, std::coroutine_handle<> h) {
+	struct Slot {
+		std::coroutine_handle<> reader;
+		std::coroutine_handle<> writer;
+		bool registered { false };
+	};
+	FdTable<Slot> table;
+	for (int fd = FIRST_FD; fd < FIRST_FD + IDLE_CONNECTIONS + ACTIVE_CONNECTIONS; fd++)
+		table[fd] = Slot { h, nullptr, true };
+	for (int fd : active)
+		table[fd].reader = nullptr;
+
+	std::size_t woken = 0;
+	const std::size_t before = allocations;
+	auto start = std::chrono::steady_clock::now();
+	for (int round = 0; round < ROUNDS; round++) {
+		for (int fd : active)
+			table[fd].reader = h;
+		for (int fd : active) {
+			Slot* slot = table.find(fd);
+			if (slot && slot->registered && slot->reader) {
+				woken += slot->reader == h;
+				slot->reader = nullptr;
+			}
+		}
+	}
+	auto cost = std::chrono::steady_clock::now() - start;
+	if (woken != (std::size_t)ROUNDS * active.size())
+		std::abort();
+	return { std::chrono::duration<double, std::nano>(cost).count() / woken, allocations - before };
+}
+
+int main() {
+	// the active ones are spread over the whole fd range, and wake up
+	// in the order epoll reports them, not in fd order
+	std::vector<int> fds(IDLE_CONNECTIONS + ACTIVE_CONNECTIONS);
+	std::iota(fds.begin(), fds.end(), FIRST_FD);
+	std::mt19937 rng { 7 };
+	std::shuffle(fds.begin(), fds.end(), rng);
+	std::vector<int> active(fds.begin(), fds.begin() + ACTIVE_CONNECTIONS);
+
+	auto h = std::noop_coroutine();
+	Result map = bench_hash_map(active, h);
+	Result flat = bench_fd_table(active, h);
+
+	std::printf("%d idle, %d active, %d rounds\n", IDLE_CONNECTIONS, ACTIVE_CONNECTIONS, ROUNDS);
+	std::printf("unordered_map: %7.2f ns per wait/wakeup, %zu allocations\n", map.ns_per_wait, map.allocations);
+	std::printf("FdTable      : %7.2f ns per wait/wakeup, %zu allocations\n", flat.ns_per_wait, flat.allocations);
+	return 0;
+}
@@ -0,0 +1,113 @@
+#include "Task.hpp"
+#include "coro_sys_socket.h"
+#include "scheduler.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <memory>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @brief one buffer written over and over on a loopback TCP connection,
+ *        copied by async_write or handed to async_write_zerocopy.
+ *        On loopback the kernel copies the pages anyway when they reach
+ *        the receiver, see the copied column: a real NIC is where it pays
+ */
+
+using namespace CNetUtils;
+
+static constexpr const std::size_t BYTES_PER_RUN = 512 * 1024 * 1024;
+static constexpr const std::size_t SIZES[] = {
+	16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024
+};
+
+static std::pair<int, int> loopback_pair() {
+	int listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	sockaddr_in addr {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	::bind(listener, reinterpret_cast<sockaddr*>(&addr), len);
+	::listen(listener, 1);
+	::getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len);
+
+	int client = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	::connect(client, reinterpret_cast<sockaddr*>(&addr), len);
+	int server = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	::close(listener);
+	::fcntl(client, F_SETFL, ::fcntl(client, F_GETFL) | O_NONBLOCK);
+	return { server, client };
+}
+
+static std::size_t received = 0;
+
+Task<void> drain(std::shared_ptr<CoroClientSocket> socket) {
+	std::vector<char> buffer(256 * 1024);
+	ssize_t n;
+	while ((n = co_await socket->async_read(buffer.data(), buffer.size())) > 0)
+		received += (std::size_t)n;
+	socket->close();
+}
+
+static std::uint32_t copied = 0;
+
+// the buffer never changes, so every write shares the one owner
+Task<void> send_repeatedly(std::shared_ptr<CoroClientSocket> socket, std::shared_ptr<const std::vector<char>> buffer,
+                           std::size_t rounds, bool zerocopy) {
+	for (std::size_t i = 0; i < rounds; i++) {
+		ssize_t n = zerocopy ? co_await socket->async_write_zerocopy(buffer, buffer->data(), buffer->size())
+		                     : co_await socket->async_write(buffer->data(), buffer->size());
+		if (n < 0)
+			break;
+	}
+	copied = socket->zerocopy_copied(); // the ones reported before the close
+	socket->close();
+}
+
+struct Result {
+	double mb_per_s;
+	std::uint32_t copied;
+	bool zerocopy;
+};
+
+static Result run(std::size_t size, bool zerocopy) {
+	auto [server, client] = loopback_pair();
+	auto out = std::make_shared<CoroClientSocket>(server);
+	auto in = std::make_shared<CoroClientSocket>(client);
+	Result result {};
+	result.zerocopy = zerocopy && out->set_zerocopy(size);
+
+	auto buffer = std::make_shared<const std::vector<char>>(size, 'z');
+	const std::size_t rounds = std::max<std::size_t>(1, BYTES_PER_RUN / size);
+	received = 0;
+	auto start = std::chrono::steady_clock::now();
+	Scheduler::spawn(drain(in));
+	Scheduler::spawn(send_repeatedly(out, buffer, rounds, result.zerocopy));
+	Scheduler::run();
+	auto cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (received != rounds * size)
+		std::printf("  short: %zu of %zu bytes\n", received, rounds * size);
+	result.mb_per_s = (double)received / (1024 * 1024) / cost;
+	result.copied = copied;
+	return result;
+}
+
+int main() {
+	std::printf("%zu MB per run over loopback TCP\n", BYTES_PER_RUN / (1024 * 1024));
+	std::printf("%10s %14s %14s %10s\n", "write", "send MB/s", "zerocopy MB/s", "copied");
+	for (std::size_t size : SIZES) {
+		Result plain = run(size, false);
+		Result zerocopy = run(size, true);
+		if (!zerocopy.zerocopy) {
+			std::printf("%8zuKB %14.0f %14s\n", size / 1024, plain.mb_per_s, "no SO_ZEROCOPY");
+			continue;
+		}
+		std::printf("%8zuKB %14.0f %14.0f %10u\n", size / 1024, plain.mb_per_s, zerocopy.mb_per_s, zerocopy.copied);
+	}
+	return 0;
+}
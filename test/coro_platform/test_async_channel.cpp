@@ -0,0 +1,95 @@
+#include "Task.hpp"
+#include "async_channel.hpp"
+#include "scheduler.hpp"
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static constexpr const int ITEMS = 1000;
+static std::size_t worst_depth = 0;
+
+Task<void> producer(AsyncChannel<int>& out) {
+	for (int i = 1; i <= ITEMS; i++) {
+		co_await out.send(i);
+		worst_depth = std::max(worst_depth, out.size());
+	}
+	out.close();
+}
+
+Task<void> doubler(AsyncChannel<int>& in, AsyncChannel<int>& out) {
+	while (auto value = co_await in.recv())
+		co_await out.send(*value * 2);
+	out.close();
+}
+
+static long long sum = 0;
+static int batches = 0;
+
+Task<void> consumer(AsyncChannel<int>& in) {
+	std::vector<int> batch;
+	while (co_await in.recv_many(batch, 16) > 0) {
+		for (int v : batch)
+			sum += v;
+		batch.clear();
+		batches++;
+	}
+}
+
+static bool blocked_send_result = true;
+
+Task<void> blocked_sender(AsyncChannel<int>& ch) {
+	co_await ch.send(1); // fills the only slot
+	blocked_send_result = co_await ch.send(2); // suspends until closed
+}
+
+Task<void> closer(AsyncChannel<int>& ch) {
+	ch.close();
+	co_return;
+}
+
+static long long cross_sum = 0;
+
+Task<void> cross_consumer(AsyncChannel<int>& in) {
+	while (auto value = co_await in.recv())
+		cross_sum += *value;
+}
+
+Task<void> cross_producer(AsyncChannel<int>& out) {
+	for (int i = 1; i <= ITEMS; i++)
+		co_await out.send(i);
+	out.close();
+}
+
+int main() {
+	AsyncChannel<int> first { 4 }, second { 4 };
+	Scheduler::spawn(consumer(second));
+	Scheduler::spawn(doubler(first, second));
+	Scheduler::spawn(producer(first));
+	Scheduler::run();
+	const long long expected = (long long)ITEMS * (ITEMS + 1);
+	bool pipeline_ok = sum == expected && worst_depth <= first.capacity();
+	std::cout << "pipeline (" << batches << " batches, depth <= " << worst_depth << "): "
+	          << (pipeline_ok ? "PASS" : "FAIL") << "\n";
+
+	AsyncChannel<int> single { 1 };
+	Scheduler::spawn(blocked_sender(single));
+	Scheduler::spawn(closer(single));
+	Scheduler::run();
+	auto left = single.try_recv();
+	bool close_ok = !blocked_send_result && left == 1 && !single.try_recv();
+	std::cout << "close wakes the blocked sender: " << (close_ok ? "PASS" : "FAIL") << "\n";
+
+	// the producer runs on another thread's loop
+	AsyncChannel<int> cross { 8 };
+	Scheduler::spawn(cross_consumer(cross));
+	std::thread other([&]() {
+		Scheduler::spawn(cross_producer(cross));
+		Scheduler::run();
+	});
+	Scheduler::run();
+	other.join();
+	bool cross_ok = cross_sum == expected / 2;
+	std::cout << "across loops: " << (cross_ok ? "PASS" : "FAIL") << "\n";
+
+	return pipeline_ok && close_ok && cross_ok ? 0 : 1;
+}
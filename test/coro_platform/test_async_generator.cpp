@@ -0,0 +1,130 @@
+#include "Task.hpp"
+#include "async_generator.hpp"
+#include "memory_stream.hpp"
+#include "scheduler.hpp"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+AsyncGenerator<int> ticks(int count) {
+	for (int i = 0; i < count; i++) {
+		co_await sleep(1ms); // suspends to the loop between two values
+		co_yield i;
+	}
+}
+
+static std::vector<int> ticked;
+
+Task<void> collect_ticks() {
+	auto gen = ticks(5);
+	while (auto value = co_await gen.next())
+		ticked.push_back(*value);
+}
+
+AsyncGenerator<int> broken() {
+	co_yield 1;
+	throw std::runtime_error("broken producer");
+}
+
+static std::string caught;
+static int before_throw = 0;
+
+Task<void> collect_broken() {
+	auto gen = broken();
+	try {
+		while (auto value = co_await gen.next())
+			before_throw += *value;
+	} catch (const std::runtime_error& e) {
+		caught = e.what();
+	}
+}
+
+static int alive = 0;
+
+struct Resource {
+	Resource() { alive++; }
+	~Resource() { alive--; }
+};
+
+AsyncGenerator<int> endless() {
+	Resource held;
+	for (int i = 0;; i++)
+		co_yield i;
+}
+
+static int taken_early = 0;
+static int alive_while_taking = 0;
+
+Task<void> take_three() {
+	{
+		auto gen = endless();
+		for (int i = 0; i < 3; i++)
+			taken_early += *co_await gen.next();
+		alive_while_taking = alive;
+	} // destroyed at a co_yield
+}
+
+// pieces of what is read, as the bytes come in
+AsyncGenerator<std::string> lines_of(std::shared_ptr<MemoryStream> in) {
+	std::string pending;
+	char buffer[5];
+	while (true) {
+		ssize_t n = co_await in->async_read(buffer, sizeof(buffer));
+		if (n <= 0)
+			break;
+		pending.append(buffer, (std::size_t)n);
+		std::size_t end;
+		while ((end = pending.find('\n')) != std::string::npos) {
+			std::string line = pending.substr(0, end);
+			pending.erase(0, end + 1);
+			co_yield std::move(line);
+		}
+	}
+}
+
+static std::vector<std::string> lines;
+
+Task<void> collect_lines(std::shared_ptr<MemoryStream> in) {
+	auto gen = lines_of(in);
+	while (auto line = co_await gen.next())
+		lines.push_back(std::move(*line));
+}
+
+Task<void> write_lines(std::shared_ptr<MemoryStream> out) {
+	for (const char* text : { "alpha\nbe", "ta\n", "gamma\n" }) {
+		co_await out->async_write(text, std::char_traits<char>::length(text));
+		co_await sleep(1ms);
+	}
+	out->close();
+}
+
+int main() {
+	Scheduler::spawn(collect_ticks());
+	Scheduler::run();
+	bool ticks_ok = ticked == std::vector<int> { 0, 1, 2, 3, 4 };
+	std::cout << "yields across sleeps: " << (ticks_ok ? "PASS" : "FAIL") << "\n";
+
+	Scheduler::spawn(collect_broken());
+	Scheduler::run();
+	bool throw_ok = before_throw == 1 && caught == "broken producer";
+	std::cout << "exception rethrown from next(): " << (throw_ok ? "PASS" : "FAIL") << "\n";
+
+	Scheduler::spawn(take_three());
+	Scheduler::run();
+	bool destroy_ok = taken_early == 3 && alive_while_taking == 1 && alive == 0;
+	std::cout << "destroyed at a co_yield: " << (destroy_ok ? "PASS" : "FAIL") << "\n";
+
+	auto [in, out] = MemoryStream::make_pair(16);
+	Scheduler::spawn(collect_lines(in));
+	Scheduler::spawn(write_lines(out));
+	Scheduler::run();
+	bool stream_ok = lines == std::vector<std::string> { "alpha", "beta", "gamma" };
+	std::cout << "lines from a stream: " << (stream_ok ? "PASS" : "FAIL") << "\n";
+
+	return ticks_ok && throw_ok && destroy_ok && stream_ok ? 0 : 1;
+}
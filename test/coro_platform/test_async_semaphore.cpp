@@ -0,0 +1,81 @@
+#include "Task.hpp"
+#include "async_semaphore.hpp"
+#include "scheduler.hpp"
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static constexpr const int WORKERS = 20;
+static constexpr const std::size_t LIMIT = 3;
+
+static std::size_t in_flight = 0, worst_in_flight = 0;
+static std::vector<int> order;
+
+Task<void> limited(AsyncSemaphore& semaphore, int id) {
+	auto permit = co_await semaphore.scoped();
+	order.push_back(id);
+	worst_in_flight = std::max(worst_in_flight, ++in_flight);
+	co_await sleep(std::chrono::milliseconds(2));
+	in_flight--;
+}
+
+static int counter = 0;
+static bool overlapped = false;
+
+Task<void> critical(AsyncMutex& mutex) {
+	for (int i = 0; i < 5; i++) {
+		co_await mutex.lock();
+		int seen = counter;
+		co_await sleep(std::chrono::milliseconds(1));
+		if (counter != seen)
+			overlapped = true;
+		counter = seen + 1;
+		mutex.unlock();
+	}
+}
+
+static std::atomic<int> shared_total { 0 };
+
+Task<void> cross(AsyncMutex& mutex) {
+	for (int i = 0; i < 1000; i++) {
+		auto guard = co_await mutex.scoped_lock();
+		// a plain read-modify-write, the mutex keeps the two loops apart
+		shared_total.store(shared_total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+}
+
+int main() {
+	AsyncSemaphore semaphore { LIMIT };
+	for (int i = 0; i < WORKERS; i++)
+		Scheduler::spawn(limited(semaphore, i));
+	Scheduler::run();
+	bool fifo = order.size() == WORKERS;
+	for (int i = 0; fifo && i < WORKERS; i++)
+		fifo = order[i] == i;
+	auto stats = semaphore.stats();
+	bool limit_ok = worst_in_flight == LIMIT && fifo && semaphore.available() == LIMIT
+	    && stats.acquired == WORKERS && stats.contended == WORKERS - LIMIT && stats.wait_ns.count == WORKERS - LIMIT;
+	std::cout << stats.to_string("upstream");
+	std::cout << "semaphore limit and FIFO: " << (limit_ok ? "PASS" : "FAIL") << "\n";
+
+	AsyncMutex mutex;
+	for (int i = 0; i < 4; i++)
+		Scheduler::spawn(critical(mutex));
+	Scheduler::run();
+	bool mutex_ok = !overlapped && counter == 20 && !mutex.locked();
+	std::cout << "mutex exclusion: " << (mutex_ok ? "PASS" : "FAIL") << "\n";
+
+	AsyncMutex shared;
+	Scheduler::spawn(cross(shared));
+	std::thread other([&]() {
+		Scheduler::spawn(cross(shared));
+		Scheduler::run();
+	});
+	Scheduler::run();
+	other.join();
+	bool cross_ok = shared_total.load() == 2000 && !shared.locked();
+	std::cout << "mutex across loops: " << (cross_ok ? "PASS" : "FAIL") << "\n";
+
+	return limit_ok && mutex_ok && cross_ok ? 0 : 1;
+}
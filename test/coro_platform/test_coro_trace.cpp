@@ -0,0 +1,93 @@
+#include "Task.hpp"
+#include "coro_trace.hpp"
+#include "scheduler.hpp"
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+static std::size_t count_of(const std::string& text, const std::string& what) {
+	std::size_t n = 0;
+	for (auto at = text.find(what); at != std::string::npos; at = text.find(what, at + what.size()))
+		n++;
+	return n;
+}
+
+Task<int> child() {
+	co_await sleep(1ms);
+	co_return 1;
+}
+
+Task<void> traced() {
+	co_await child();
+}
+
+// awaits a traced() in the frame a spawned one just gave back to the
+// pool, its own frame is bigger so it comes from another size class
+Task<void> reuses_frame() {
+	char kept[1024] = { 1 };
+	co_await traced();
+	volatile char sink = kept[0];
+	(void)sink;
+}
+
+int main() {
+	// the ring keeps the newest records
+	TraceRing ring { 8, 1 };
+	for (int i = 0; i < 20; i++)
+		ring.push(TraceRecord::Kind::IoWaitBegin, nullptr, i);
+	auto kept = ring.snapshot();
+	bool ring_ok = kept.size() == 8 && kept.front().fd == 12 && kept.back().fd == 19
+	    && ring.overwritten() == 12 && kept.back().kind == TraceRecord::Kind::IoWaitBegin;
+	ring.discard();
+	ring_ok = ring_ok && ring.snapshot().empty();
+	std::cout << "trace ring: " << (ring_ok ? "PASS" : "FAIL") << "\n";
+
+	// disabled, nothing is recorded
+	Scheduler::spawn(traced());
+	Scheduler::run();
+	bool off_ok = count_of(TraceRecorder::to_chrome_json(), "\"ph\":\"B\"") == 0;
+	std::cout << "disabled: " << (off_ok ? "PASS" : "FAIL") << "\n";
+
+	TraceRecorder::enable();
+	Scheduler::spawn(traced());
+	Scheduler::spawn(traced());
+	std::thread other([]() {
+		Scheduler::spawn(traced());
+		Scheduler::run();
+	});
+	Scheduler::run();
+	other.join();
+	TraceRecorder::disable();
+
+	std::string json = TraceRecorder::to_chrome_json();
+	const auto slices_begin = count_of(json, "\"ph\":\"B\""), slices_end = count_of(json, "\"ph\":\"E\"");
+	// the three spawned coroutines live as async spans, their children as instants
+	bool json_ok = json.starts_with("{\"traceEvents\":[") && json.ends_with("]}")
+	    && slices_begin > 0 && slices_begin == slices_end
+	    && count_of(json, "\"ph\":\"b\"") == 3 && count_of(json, "\"ph\":\"e\"") == 3
+	    && count_of(json, "\"name\":\"task done\"") == 3
+	    && count_of(json, "\"name\":\"thread_name\"") == 2;
+	std::cout << "chrome trace (" << json.size() << " bytes): " << (json_ok ? "PASS" : "FAIL") << "\n";
+
+	// the spans pair up by id, not by the reused frame address
+	TraceRecorder::clear();
+	TraceRecorder::enable();
+	Scheduler::spawn(traced());
+	Scheduler::run();
+	Scheduler::spawn(reuses_frame());
+	Scheduler::run();
+	TraceRecorder::disable();
+	json = TraceRecorder::to_chrome_json();
+	bool reuse_ok = count_of(json, "\"ph\":\"b\"") == 2 && count_of(json, "\"ph\":\"e\"") == 2
+	    && count_of(json, "\"name\":\"task done\"") == 3;
+	std::cout << "spans of reused frames: " << (reuse_ok ? "PASS" : "FAIL") << "\n";
+
+	TraceRecorder::clear();
+	bool clear_ok = count_of(TraceRecorder::to_chrome_json(), "\"ph\":\"B\"") == 0
+	    && count_of(TraceRecorder::to_chrome_json(), "\"name\":\"thread_name\"") == 1;
+	std::cout << "clear: " << (clear_ok ? "PASS" : "FAIL") << "\n";
+
+	return ring_ok && off_ok && json_ok && reuse_ok && clear_ok ? 0 : 1;
+}
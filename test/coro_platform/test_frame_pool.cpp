@@ -0,0 +1,44 @@
+#include "Task.hpp"
+#include "frame_pool.hpp"
+#include "scheduler.hpp"
+#include <iostream>
+
+static int leaf_calls = 0;
+
+Task<int> leaf(int v) {
+	leaf_calls++;
+	co_return v + 1;
+}
+
+Task<int> middle(int v) {
+	int r = co_await leaf(v);
+	co_return r * 2;
+}
+
+static long long total = 0;
+
+Task<void> driver(int rounds) {
+	for (int i = 0; i < rounds; i++)
+		total += co_await middle(i);
+}
+
+int main() {
+	static constexpr const int ROUNDS = 1000;
+	Scheduler::spawn(driver(ROUNDS));
+	Scheduler::run();
+
+	// the nested frames of every round reuse the blocks of the round before
+	auto stats = FramePool::stats();
+	bool values_ok = leaf_calls == ROUNDS && total == (long long)ROUNDS * (ROUNDS + 1);
+	bool reused = stats.hits >= 2 * (ROUNDS - 1) && stats.hit_rate() > 0.9;
+	std::cout << "nested task values: " << (values_ok ? "PASS" : "FAIL") << "\n";
+	std::cout << "frame pool hit rate " << stats.hit_rate() << ": " << (reused ? "PASS" : "FAIL") << "\n";
+
+	// too big for the pool, served by the heap
+	void* big = FramePool::allocate(FramePool::GRANULE * FramePool::SIZE_CLASSES + 1);
+	FramePool::deallocate(big, FramePool::GRANULE * FramePool::SIZE_CLASSES + 1);
+	bool oversized = FramePool::stats().oversized == stats.oversized + 1;
+	std::cout << "oversized frames: " << (oversized ? "PASS" : "FAIL") << "\n";
+
+	return values_ok && reused && oversized ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+#include "IOEventMonitor.h"
+#include "Task.hpp"
+#include "scheduler.hpp"
+#include <chrono>
+#include <iostream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+struct WaitFd {
+	int fd;
+	IOEventManager::Event events;
+	bool await_ready() { return false; }
+	bool await_suspend(std::coroutine_handle<> h) {
+		return IOEventManager::instance().add_waiter(fd, events, h);
+	}
+	void await_resume() { }
+};
+
+static bool reader_done = false, writer_done = false;
+
+Task<void> reader(int fd) {
+	char c;
+	while (::recv(fd, &c, 1, 0) < 0)
+		co_await WaitFd { fd, IOEventManager::Event::MONITOR_READ };
+	reader_done = true;
+}
+
+Task<void> writer(int fd) {
+	// fill the send buffer first, so the writer has to wait
+	static char chunk[4096] {};
+	while (::send(fd, chunk, sizeof(chunk), 0) > 0)
+		;
+	co_await WaitFd { fd, IOEventManager::Event::MONITOR_WRITE };
+	writer_done = true;
+}
+
+Task<void> peer(int fd) {
+	co_await sleep(20ms);
+	::send(fd, "x", 1, 0);
+	static char sink[1 << 16];
+	while (::recv(fd, sink, sizeof(sink), 0) > 0)
+		;
+}
+
+int main() {
+	int fds[2];
+	::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+	IOEventManager::instance().register_fd(fds[0]);
+
+	// a reader and a writer wait on the same fd at the same time
+	Scheduler::spawn(reader(fds[0]));
+	Scheduler::spawn(writer(fds[0]));
+	Scheduler::spawn(peer(fds[1]));
+	Scheduler::run();
+	bool both_ok = reader_done && writer_done;
+	std::cout << "read and write waiters on one fd: " << (both_ok ? "PASS" : "FAIL") << "\n";
+
+	// an edge that came while nobody waited is not lost
+	::send(fds[1], "y", 1, 0);
+	std::vector<std::coroutine_handle<>> woken;
+	IOEventManager::instance().poll(100, woken);
+	bool kept = woken.empty()
+	    && !IOEventManager::instance().add_waiter(fds[0], IOEventManager::Event::MONITOR_READ, nullptr);
+	std::cout << "edge without waiter: " << (kept ? "PASS" : "FAIL") << "\n";
+
+	IOEventManager::instance().deregister_fd(fds[0]);
+	::close(fds[0]);
+	::close(fds[1]);
+	return both_ok && kept ? 0 : 1;
+}
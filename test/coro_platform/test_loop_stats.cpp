@@ -0,0 +1,91 @@
+#include "IOEventMonitor.h"
+#include "Task.hpp"
+#include "loop_stats.hpp"
+#include "scheduler.hpp"
+#include <chrono>
+#include <iostream>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+static constexpr const int SLEEPERS = 8;
+
+Task<void> sleeper(int i) {
+	co_await sleep(std::chrono::milliseconds(5 + i));
+}
+
+struct WaitReadable {
+	int fd;
+	bool await_ready() { return false; }
+	bool await_suspend(std::coroutine_handle<> h) {
+		return IOEventManager::instance().add_waiter(fd, IOEventManager::Event::MONITOR_READ, h);
+	}
+	void await_resume() { }
+};
+
+Task<void> reader(int fd) {
+	char c;
+	while (::recv(fd, &c, 1, 0) < 0)
+		co_await WaitReadable { fd };
+}
+
+Task<void> peer(int fd) {
+	co_await sleep(10ms);
+	::send(fd, "x", 1, 0);
+}
+
+int main() {
+	HistogramSnapshot empty;
+	Histogram h;
+	for (std::uint64_t v : { 0, 1, 3, 100, 1000 })
+		h.record(v);
+	auto snap = h.snapshot();
+	bool histogram_ok = empty.percentile(0.5) == 0
+	    && snap.count == 5 && snap.sum == 1104 && snap.max == 1000
+	    && snap.percentile(0.5) == 3 // [2, 4) -> 3
+	    && snap.percentile(1.0) == 1000; // clamped by max
+	std::cout << "histogram: " << (histogram_ok ? "PASS" : "FAIL") << "\n";
+
+	int fds[2];
+	::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+	for (int i = 0; i < SLEEPERS; i++)
+		Scheduler::spawn(sleeper(i));
+	Scheduler::spawn(reader(fds[0]));
+	Scheduler::spawn(peer(fds[1]));
+	Scheduler::run();
+	::close(fds[0]);
+	::close(fds[1]);
+
+	auto stats = Scheduler::stats();
+	bool loop_ok = stats.iterations > 0
+	    && stats.resumed >= SLEEPERS + 2
+	    && stats.resumed_per_tick.sum == stats.resumed
+	    && stats.ready_depth.count > 0;
+	bool timers_ok = stats.timers_fired == SLEEPERS + 1
+	    && stats.sleeper_lateness_ns.count == SLEEPERS + 1;
+	bool poll_ok = stats.polls > 0
+	    && stats.events_per_poll.count == stats.polls
+	    && stats.events_per_poll.sum >= 1
+	    && stats.poll_blocked_ns.sum > 0
+	    && stats.ready_to_resume_ns.count >= SLEEPERS + 2;
+	std::cout << "loop counters: " << (loop_ok ? "PASS" : "FAIL") << "\n";
+	std::cout << "sleeper lateness: " << (timers_ok ? "PASS" : "FAIL") << "\n";
+	std::cout << "poll counters: " << (poll_ok ? "PASS" : "FAIL") << "\n";
+
+	// another loop joins the merged view while it is alive
+	LoopStatsSnapshot merged;
+	std::thread other([&]() {
+		Scheduler::spawn(sleeper(0));
+		Scheduler::run();
+		merged = Scheduler::stats_all();
+	});
+	other.join();
+	bool merged_ok = merged.loops == 2 && merged.timers_fired == stats.timers_fired + 1
+	    && merged.to_string().find("ready_to_resume_ns count=") != std::string::npos;
+	std::cout << "merged snapshot: " << (merged_ok ? "PASS" : "FAIL") << "\n";
+	std::cout << merged.to_string();
+
+	return histogram_ok && loop_ok && timers_ok && poll_ok && merged_ok ? 0 : 1;
+}
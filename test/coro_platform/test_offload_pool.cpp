@@ -0,0 +1,108 @@
+#include "Task.hpp"
+#include "offload_pool.hpp"
+#include "scheduler.hpp"
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+static int ticks = 0;
+static bool offloaded_done = false;
+
+Task<void> ticker() {
+	while (!offloaded_done) {
+		co_await sleep(1ms);
+		ticks++;
+	}
+}
+
+static int value = 0;
+static bool same_thread = false, void_ran = false, error_caught = false;
+static std::thread::id worker_thread;
+
+Task<void> handler(OffloadPool& pool) {
+	auto loop_thread = std::this_thread::get_id();
+	value = co_await pool.offload([]() {
+		worker_thread = std::this_thread::get_id();
+		std::this_thread::sleep_for(50ms); // a blocking call
+		return 42;
+	});
+	same_thread = std::this_thread::get_id() == loop_thread;
+
+	co_await pool.offload([]() { void_ran = true; });
+	try {
+		co_await pool.offload([]() -> int { throw std::runtime_error("boom"); });
+	} catch (const std::runtime_error&) {
+		error_caught = true;
+	}
+	offloaded_done = true;
+}
+
+static int blocker_results = 0, ran_on_loop = 0;
+
+Task<void> blocker(OffloadPool& pool) {
+	const auto loop_thread = std::this_thread::get_id();
+	blocker_results += co_await pool.offload([loop_thread]() {
+		if (std::this_thread::get_id() == loop_thread)
+			ran_on_loop++;
+		std::this_thread::sleep_for(20ms);
+		return 1;
+	});
+}
+
+Task<void> stop_ticking_after(int results) {
+	while (blocker_results < results)
+		co_await sleep(1ms);
+	offloaded_done = true;
+}
+
+int main() {
+	{
+		OffloadPool pool { 2 };
+		Scheduler::spawn(ticker());
+		Scheduler::spawn(handler(pool));
+		Scheduler::run();
+
+		bool result_ok = value == 42 && same_thread && worker_thread != std::this_thread::get_id();
+		bool loop_free = ticks >= 20; // the loop kept ticking during the 50ms call
+		bool rest_ok = void_ran && error_caught;
+		auto stats = pool.stats();
+		bool stats_ok = stats.submitted == 3 && stats.completed == 3 && stats.run_ns.count == 3
+		    && stats.run_ns.max >= (std::uint64_t)std::chrono::nanoseconds(50ms).count();
+		std::cout << "offloaded result on the loop thread: " << (result_ok ? "PASS" : "FAIL") << "\n";
+		std::cout << "loop not stalled (" << ticks << " ticks): " << (loop_free ? "PASS" : "FAIL") << "\n";
+		std::cout << "void calls and exceptions: " << (rest_ok ? "PASS" : "FAIL") << "\n";
+		std::cout << "pool stats: " << (stats_ok ? "PASS" : "FAIL") << "\n";
+		if (!(result_ok && loop_free && rest_ok && stats_ok))
+			return 1;
+	}
+
+	// one worker, one queued: the later calls park, the loop keeps ticking
+	OffloadPool small { 1, 1 };
+	offloaded_done = false;
+	ticks = 0;
+	Scheduler::spawn(ticker());
+	for (int i = 0; i < 4; i++)
+		Scheduler::spawn(blocker(small));
+	Scheduler::spawn(stop_ticking_after(4));
+	Scheduler::run();
+	auto stats = small.stats();
+	bool parked_ok = blocker_results == 4 && ran_on_loop == 0 && ticks >= 30 && stats.ran_inline == 0
+	    && stats.submitted == 4 && stats.overflowed >= 1 && stats.parked == 0 && stats.queue_depth.max == 1;
+	std::cout << "a full queue parks the calls off the loop (" << ticks << " ticks): "
+	          << (parked_ok ? "PASS" : "FAIL") << "\n";
+	std::cout << stats.to_string();
+
+	// asked for: the third call runs on the loop
+	OffloadPool caller_runs { 1, 1, OffloadPool::Overflow::CallerRuns };
+	blocker_results = ran_on_loop = 0;
+	for (int i = 0; i < 3; i++)
+		Scheduler::spawn(blocker(caller_runs));
+	Scheduler::run();
+	stats = caller_runs.stats();
+	bool caller_runs_ok = blocker_results == 3 && ran_on_loop == 1 && stats.ran_inline == 1 && stats.submitted == 2;
+	std::cout << "Overflow::CallerRuns runs inline: " << (caller_runs_ok ? "PASS" : "FAIL") << "\n";
+	return parked_ok && caller_runs_ok ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#include "Task.hpp"
+#include "scheduler.hpp"
+#include <iostream>
+
+static bool woke = false;
+
+Task<void> sleeper() {
+	co_await sleep(std::chrono::milliseconds(5));
+	woke = true;
+}
+
+static long spins = 0;
+
+// never blocks, the sleeper only fires because we yield
+Task<void> spinner() {
+	while (!woke && spins < 50'000'000) {
+		spins++;
+		co_await yield();
+	}
+}
+
+static int ran = 0;
+
+Task<void> tiny() {
+	ran++;
+	co_return;
+}
+
+Task<int> ready_at_once(int v) {
+	co_return v;
+}
+
+static long inline_rounds = 0;
+
+// every await completes inline, only the coop budget makes it yield
+Task<void> busy() {
+	while (!woke && inline_rounds < 50'000'000) {
+		inline_rounds += co_await ready_at_once(1);
+	}
+}
+
+int main() {
+	Scheduler::spawn(sleeper());
+	Scheduler::spawn(spinner());
+	Scheduler::run();
+	bool yield_ok = woke && spins < 50'000'000;
+	std::cout << "yield lets the timer fire (" << spins << " spins): " << (yield_ok ? "PASS" : "FAIL") << "\n";
+
+	Scheduler::set_resume_budget(100);
+	auto before = Scheduler::stats();
+	for (int i = 0; i < 1000; i++)
+		Scheduler::spawn(tiny());
+	Scheduler::run();
+	auto after = Scheduler::stats();
+	bool budget_ok = ran == 1000 && after.budget_exhausted - before.budget_exhausted == 9
+	    && after.resumed_per_tick.max <= 100;
+	std::cout << "resume budget splits the ticks: " << (budget_ok ? "PASS" : "FAIL") << "\n";
+	Scheduler::set_resume_budget(Scheduler::DEFAULT_RESUME_BUDGET);
+
+	woke = false;
+	Scheduler::set_coop_budget(16);
+	before = Scheduler::stats();
+	Scheduler::spawn(sleeper());
+	Scheduler::spawn(busy());
+	Scheduler::run();
+	after = Scheduler::stats();
+	bool coop_ok = woke && inline_rounds < 50'000'000 && after.yielded > before.yielded;
+	std::cout << "coop budget preempts the inline loop (" << inline_rounds << " rounds): "
+	          << (coop_ok ? "PASS" : "FAIL") << "\n";
+	Scheduler::set_coop_budget(0);
+
+	return yield_ok && budget_ok && coop_ok ? 0 : 1;
+}
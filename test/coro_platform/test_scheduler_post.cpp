@@ -0,0 +1,114 @@
+#include "Task.hpp"
+#include "scheduler.hpp"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using namespace std::chrono_literals;
+using clock_type = std::chrono::steady_clock;
+
+// suspends and lets a background thread resume it through post()
+struct ResumedByOtherThread {
+	Scheduler& loop;
+	std::jthread& worker;
+	bool await_ready() { return false; }
+	void await_suspend(std::coroutine_handle<> h) {
+		// nothing local wakes the coroutine, keep the loop until it is posted
+		worker = std::jthread([h, hold = LoopHold { loop }]() {
+			std::this_thread::sleep_for(20ms);
+			hold.scheduler().post(h);
+		});
+	}
+	void await_resume() { }
+};
+
+static std::thread::id resumed_on;
+
+Task<void> waits_for_worker(Scheduler& loop, std::jthread& worker) {
+	co_await ResumedByOtherThread { loop, worker };
+	resumed_on = std::this_thread::get_id();
+}
+
+static int posted_runs = 0;
+static std::atomic<long long> worst_wake_ns { 0 };
+
+Task<void> posted_task(clock_type::time_point posted_at) {
+	auto waited = std::chrono::nanoseconds(clock_type::now() - posted_at).count();
+	if (waited > worst_wake_ns.load())
+		worst_wake_ns.store(waited);
+	posted_runs++;
+	co_return;
+}
+
+static std::atomic<int> busy_done { 0 };
+
+Task<void> busy() {
+	auto until = clock_type::now() + 2ms;
+	while (clock_type::now() < until)
+		;
+	busy_done++;
+	co_return;
+}
+
+int main() {
+	Scheduler& loop = Scheduler::instance();
+
+	// a coroutine resumed from another thread, back on the loop thread
+	std::jthread worker;
+	Scheduler::spawn(waits_for_worker(loop, worker));
+	Scheduler::run();
+	bool resume_ok = resumed_on == std::this_thread::get_id();
+	std::cout << "post a handle from another thread: " << (resume_ok ? "PASS" : "FAIL") << "\n";
+
+	// the held loop blocks without a timeout, each post must wake it up
+	static constexpr const int POSTS = 100;
+	std::jthread poster;
+	{
+		LoopHold hold { loop };
+		poster = std::jthread([hold = std::move(hold)]() {
+			for (int i = 0; i < POSTS; i++) {
+				std::this_thread::sleep_for(1ms);
+				hold.scheduler().post(posted_task(clock_type::now()));
+			}
+		});
+	}
+	Scheduler::run();
+	bool post_ok = posted_runs == POSTS && worst_wake_ns.load() < std::chrono::nanoseconds(50ms).count();
+	std::cout << "posted tasks wake the blocked loop (worst "
+	          << worst_wake_ns.load() / 1000 << " us): " << (post_ok ? "PASS" : "FAIL") << "\n";
+
+	// a parked sibling is woken up to steal, instead of polling for works
+	static constexpr const int BUSY = 50;
+	WorkStealingGroup group { 2 };
+	std::atomic<Scheduler*> sibling { nullptr };
+	std::atomic<std::uint64_t> sibling_resumed { 0 };
+	std::jthread thief([&]() {
+		Scheduler::join_group(group);
+		// nothing to do on its own, it stays until released below
+		Scheduler::instance().hold();
+		sibling.store(&Scheduler::instance());
+		Scheduler::run();
+		sibling_resumed = Scheduler::stats().resumed;
+	});
+	while (!sibling.load())
+		std::this_thread::yield();
+	std::this_thread::sleep_for(20ms); // let it park
+	std::jthread owner([&]() {
+		Scheduler::join_group(group);
+		for (int i = 0; i < BUSY; i++)
+			Scheduler::spawn(busy());
+		Scheduler::run();
+	});
+	// the idle owner waits for the held sibling, the group leaves together
+	while (busy_done < BUSY)
+		std::this_thread::sleep_for(1ms);
+	sibling.load()->release();
+	owner.join();
+	thief.join();
+	bool steal_ok = busy_done == BUSY && sibling_resumed > 1;
+	std::cout << "parked sibling woken to steal (" << sibling_resumed << " resumed): "
+	          << (steal_ok ? "PASS" : "FAIL") << "\n";
+
+	return resume_ok && post_ok && steal_ok ? 0 : 1;
+}
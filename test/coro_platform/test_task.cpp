@@ -0,0 +1,56 @@
+#include "Task.hpp"
+#include "scheduler.hpp"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+static std::vector<char> order;
+
+Task<int> depth(int n) {
+	if (n == 0)
+		co_return 0;
+	co_return 1 + co_await depth(n - 1);
+}
+
+Task<void> nested_chain() {
+	int d = co_await depth(8);
+	if (d == 8)
+		order.push_back('A');
+}
+
+Task<void> sibling() {
+	order.push_back('B');
+	co_return;
+}
+
+Task<std::unique_ptr<int>> make_owned(int v) {
+	co_return std::make_unique<int>(v);
+}
+
+static long long sum = 0;
+static bool owned_ok = false;
+
+Task<void> many_awaits(int rounds) {
+	for (int i = 0; i < rounds; i++)
+		sum += co_await depth(1);
+	auto owned = co_await make_owned(42);
+	owned_ok = owned && *owned == 42;
+}
+
+int main() {
+	// the nested awaits run through without yielding to the sibling
+	Scheduler::spawn(nested_chain());
+	Scheduler::spawn(sibling());
+	Scheduler::run();
+	bool direct = order == std::vector<char> { 'A', 'B' };
+	std::cout << "symmetric transfer to the child and back: " << (direct ? "PASS" : "FAIL") << "\n";
+
+	// a long loop of awaits must not grow the stack
+	static constexpr const int ROUNDS = 1000000;
+	Scheduler::spawn(many_awaits(ROUNDS));
+	Scheduler::run();
+	bool looped = sum == ROUNDS && owned_ok;
+	std::cout << "million awaits and move-only results: " << (looped ? "PASS" : "FAIL") << "\n";
+
+	return direct && looped ? 0 : 1;
+}
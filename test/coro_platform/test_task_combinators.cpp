@@ -0,0 +1,110 @@
+#include "Task.hpp"
+#include "coro_sys_socket.h"
+#include "scheduler.hpp"
+#include "task_combinators.hpp"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+
+using namespace std::chrono_literals;
+using namespace CNetUtils;
+using clock_type = std::chrono::steady_clock;
+
+static auto elapsed_ms(clock_type::time_point since) {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(clock_type::now() - since).count();
+}
+
+Task<int> slow_value(int v, std::chrono::milliseconds delay) {
+	co_await sleep(delay);
+	co_return v;
+}
+
+Task<std::string> slow_text(std::chrono::milliseconds delay) {
+	co_await sleep(delay);
+	co_return std::string { "text" };
+}
+
+static int void_runs = 0;
+
+Task<void> slow_void(std::chrono::milliseconds delay) {
+	co_await sleep(delay);
+	void_runs++;
+}
+
+static bool pack_ok = false, range_ok = false, any_ok = false, loser_cancelled = false, any_void_ok = false;
+static long long pack_ms = 0, any_ms = 0;
+static clock_type::time_point loser_done;
+
+Task<int> loser(std::chrono::milliseconds delay) {
+	co_await sleep(delay); // woken early by the cancellation
+	loser_done = clock_type::now();
+	co_return -1;
+}
+
+static bool read_loser_ok = false, read_loser_done = false;
+
+// nothing comes: with io_uring the recv stays in the ring until its cancellation lands
+Task<int> pending_read(std::shared_ptr<CoroClientSocket> socket, char* buffer, std::size_t size) {
+	ssize_t n = co_await socket->async_read(buffer, size);
+	read_loser_done = true;
+	co_return (int)n;
+}
+
+// the buffer lives in this frame, so the read must be over once when_any returns
+Task<void> read_or_timeout(std::shared_ptr<CoroClientSocket> socket) {
+	char buffer[64];
+	auto first = co_await when_any(pending_read(socket, buffer, sizeof(buffer)), slow_value(0, 5ms));
+	read_loser_ok = first.index == 1 && read_loser_done;
+}
+
+Task<void> driver() {
+	auto start = clock_type::now();
+	auto [a, text, nothing] = co_await when_all(slow_value(1, 30ms), slow_text(30ms), slow_void(30ms));
+	pack_ms = elapsed_ms(start);
+	pack_ok = a == 1 && text == "text" && void_runs == 1 && pack_ms < 60;
+
+	std::vector<Task<int>> range;
+	for (int i = 0; i < 5; i++)
+		range.emplace_back(slow_value(i, std::chrono::milliseconds(5 * (5 - i))));
+	auto values = co_await when_all(std::move(range));
+	range_ok = values == std::vector<int> { 0, 1, 2, 3, 4 };
+
+	start = clock_type::now();
+	auto first = co_await when_any(loser(500ms), slow_value(7, 10ms));
+	any_ms = elapsed_ms(start);
+	any_ok = first.index == 1 && first.value == 7 && any_ms < 100;
+	co_await sleep(1ms); // let the cancelled loser finish
+	loser_cancelled = std::chrono::duration_cast<std::chrono::milliseconds>(loser_done - start).count() < 100;
+
+	std::vector<Task<void>> voids;
+	voids.emplace_back(slow_void(200ms));
+	voids.emplace_back(slow_void(5ms));
+	auto winner = co_await when_any(std::move(voids));
+	any_void_ok = winner.index == 1;
+
+	int fds[2];
+	::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+	auto socket = std::make_shared<CoroClientSocket>(fds[0]);
+	auto peer = std::make_shared<CoroClientSocket>(fds[1]);
+	co_await read_or_timeout(socket);
+	co_await peer->async_write("late", 4); // into no frame any more
+	socket->close();
+	peer->close();
+}
+
+int main() {
+	auto start = clock_type::now();
+	Scheduler::spawn(driver());
+	Scheduler::run();
+	bool losers_gone = elapsed_ms(start) < 300; // the 200ms / 500ms losers never ran out
+
+	std::cout << "when_all pack (" << pack_ms << " ms): " << (pack_ok ? "PASS" : "FAIL") << "\n";
+	std::cout << "when_all range: " << (range_ok ? "PASS" : "FAIL") << "\n";
+	std::cout << "when_any first wins (" << any_ms << " ms): " << (any_ok ? "PASS" : "FAIL") << "\n";
+	std::cout << "when_any cancels the losers: " << (loser_cancelled && losers_gone ? "PASS" : "FAIL") << "\n";
+	std::cout << "when_any over Task<void>: " << (any_void_ok ? "PASS" : "FAIL") << "\n";
+	std::cout << "when_any resumes once the pending read let go: " << (read_loser_ok ? "PASS" : "FAIL") << "\n";
+	return pack_ok && range_ok && any_ok && loser_cancelled && losers_gone && any_void_ok && read_loser_ok ? 0 : 1;
+}
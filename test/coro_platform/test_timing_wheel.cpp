@@ -0,0 +1,122 @@
+#include "Task.hpp"
+#include "scheduler.hpp"
+#include "timing_wheel.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+/**
+ * @brief drive a wheel with a fake clock, every timer must expire
+ *        not before its deadline and not later than one tick after it
+ */
+static bool random_wheel_test(std::chrono::nanoseconds tick, std::chrono::nanoseconds max_delay) {
+	const auto start = std::chrono::steady_clock::time_point {} + 1h;
+	TimingWheel wheel { start, tick };
+	std::mt19937_64 rng { 42 };
+
+	static constexpr const int TIMERS = 20000;
+	std::vector<TimerNode> nodes(TIMERS);
+	std::vector<bool> cancelled(TIMERS, false), fired(TIMERS, false);
+	for (auto& node : nodes) {
+		node.expire = start + std::chrono::nanoseconds(rng() % max_delay.count());
+		wheel.insert(node);
+	}
+	for (int i = 0; i < TIMERS; i += 7) {
+		wheel.cancel(nodes[i]);
+		cancelled[i] = true;
+	}
+
+	bool ok = true;
+	auto now = start;
+	while (!wheel.empty()) {
+		auto next = wheel.next_expiry();
+		if (!next.has_value() || *next < now - tick) {
+			std::cout << "next_expiry went backwards\n";
+			return false;
+		}
+		// sometimes step less than asked, like a loop woken by io
+		const auto last = now;
+		now = std::max(now, *next) + std::chrono::nanoseconds(rng() % (2 * tick.count()));
+		wheel.advance(now, [&](TimerNode& node) {
+			auto i = &node - nodes.data();
+			const bool early = node.expire > now;
+			const bool late = node.expire + tick <= last;
+			if (cancelled[i] || fired[i] || early || late) {
+				ok = false;
+			}
+			fired[i] = true;
+		});
+	}
+	for (int i = 0; i < TIMERS; i++)
+		ok = ok && (fired[i] != cancelled[i]);
+	return ok;
+}
+
+static std::vector<int> wake_order;
+
+Task<void> sleeper(int id, std::chrono::milliseconds how_long) {
+	co_await sleep(how_long);
+	wake_order.push_back(id);
+}
+
+static std::vector<std::chrono::nanoseconds> sub_ms_elapsed;
+
+Task<void> short_sleeps() {
+	for (int i = 0; i < 21; i++) {
+		auto before = std::chrono::steady_clock::now();
+		co_await sleep(300us);
+		sub_ms_elapsed.push_back(std::chrono::steady_clock::now() - before);
+	}
+}
+
+static std::chrono::steady_clock::time_point posted_ran;
+
+Task<void> posted_while_sleeping() {
+	posted_ran = std::chrono::steady_clock::now();
+	co_return;
+}
+
+int main() {
+	bool wheel_ms = random_wheel_test(1ms, std::chrono::nanoseconds(10min));
+	std::cout << "timing wheel (1ms tick): " << (wheel_ms ? "PASS" : "FAIL") << "\n";
+
+	// the 1ns tick overflows the top level and has to wrap around
+	bool wheel_wrap = random_wheel_test(1ns, std::chrono::nanoseconds(1h));
+	std::cout << "timing wheel (wrapping): " << (wheel_wrap ? "PASS" : "FAIL") << "\n";
+
+	Scheduler::spawn(sleeper(3, 30ms));
+	Scheduler::spawn(sleeper(1, 10ms));
+	Scheduler::spawn(sleeper(2, 20ms));
+	Scheduler::run();
+	bool sched_ok = wake_order == std::vector<int> { 1, 2, 3 };
+	std::cout << "scheduler sleep order: " << (sched_ok ? "PASS" : "FAIL") << "\n";
+
+	// a ms rounded poll never wakes before 1ms
+	Scheduler::spawn(short_sleeps());
+	Scheduler::run();
+	std::sort(sub_ms_elapsed.begin(), sub_ms_elapsed.end());
+	auto median = sub_ms_elapsed[sub_ms_elapsed.size() / 2];
+	bool sub_ms_ok = sub_ms_elapsed.front() >= 300us && median < 900us;
+	std::cout << "sub-ms sleep (median " << median.count() << "ns): " << (sub_ms_ok ? "PASS" : "FAIL") << "\n";
+
+	// the loop waits for the sleeper in its poll, so a post still gets in
+	Scheduler::spawn(sleeper(4, 200ms));
+	auto& loop = Scheduler::instance();
+	auto posted_at = std::chrono::steady_clock::now();
+	std::thread poster([&]() {
+		std::this_thread::sleep_for(20ms);
+		posted_at = std::chrono::steady_clock::now();
+		loop.post(posted_while_sleeping());
+	});
+	Scheduler::run();
+	poster.join();
+	bool no_block_ok = posted_ran - posted_at < 100ms;
+	std::cout << "post during a sleep: " << (no_block_ok ? "PASS" : "FAIL") << "\n";
+
+	return wheel_ms && wheel_wrap && sched_ok && sub_ms_ok && no_block_ok ? 0 : 1;
+}
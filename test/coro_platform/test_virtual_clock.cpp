@@ -0,0 +1,126 @@
+#include "Task.hpp"
+#include "loop_clock.hpp"
+#include "memory_stream.hpp"
+#include "scheduler.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+static LoopClock::time_point origin;
+static std::vector<std::pair<int, std::chrono::nanoseconds>> woke;
+
+Task<void> sleeper(int id, std::chrono::nanoseconds how_long) {
+	co_await sleep(how_long);
+	woke.emplace_back(id, LoopClock::now() - origin);
+}
+
+static std::string received;
+static bool eof_seen = false;
+
+Task<void> writer(std::shared_ptr<MemoryStream> out) {
+	std::string message;
+	for (int i = 0; i < 200; i++)
+		message += "line " + std::to_string(i) + "\n";
+	co_await out->async_write(message.data(), message.size());
+	out->close();
+}
+
+Task<void> reader(std::shared_ptr<MemoryStream> in) {
+	char buffer[7];
+	while (true) {
+		ssize_t n = co_await in->async_read(buffer, sizeof(buffer));
+		if (n <= 0) {
+			eof_seen = n == 0;
+			break;
+		}
+		received.append(buffer, (std::size_t)n);
+	}
+}
+
+static bool idle_timed_out = false;
+static std::chrono::nanoseconds idle_waited {};
+
+Task<void> idle_reader(std::shared_ptr<MemoryStream> in) {
+	char buffer[16];
+	auto before = LoopClock::now();
+	auto n = co_await with_timeout(in->async_read(buffer, sizeof(buffer)), 30s);
+	idle_timed_out = !n.has_value();
+	idle_waited = LoopClock::now() - before;
+}
+
+/**
+ * @brief a ping pong with a think time, the virtual timeline it leaves
+ *
+ */
+static std::vector<std::chrono::nanoseconds> timeline;
+
+Task<void> pinger(std::shared_ptr<MemoryStream> io) {
+	char byte = 'p';
+	for (int i = 0; i < 50; i++) {
+		co_await io->async_write(&byte, 1);
+		co_await io->async_read(&byte, 1);
+		timeline.push_back(LoopClock::now() - origin);
+	}
+	io->close();
+}
+
+Task<void> ponger(std::shared_ptr<MemoryStream> io) {
+	char byte;
+	while (co_await io->async_read(&byte, 1) == 1) {
+		co_await sleep(std::chrono::microseconds(150 + (timeline.size() % 7) * 50));
+		co_await io->async_write(&byte, 1);
+	}
+}
+
+static std::vector<std::chrono::nanoseconds> run_ping_pong() {
+	timeline.clear();
+	origin = LoopClock::now();
+	auto [a, b] = MemoryStream::make_pair(4);
+	Scheduler::spawn(pinger(a));
+	Scheduler::spawn(ponger(b));
+	Scheduler::run();
+	return timeline;
+}
+
+int main() {
+	Scheduler::simulate();
+	const auto real_start = std::chrono::steady_clock::now();
+
+	origin = LoopClock::now();
+	Scheduler::spawn(sleeper(3, 1h));
+	Scheduler::spawn(sleeper(1, 250us));
+	Scheduler::spawn(sleeper(2, 10min));
+	Scheduler::run();
+	bool clock_ok = woke.size() == 3 && woke[0] == std::pair { 1, std::chrono::nanoseconds(250us) }
+	    && woke[1] == std::pair { 2, std::chrono::nanoseconds(10min) }
+	    && woke[2] == std::pair { 3, std::chrono::nanoseconds(1h) };
+	std::cout << "virtual sleeps land exactly: " << (clock_ok ? "PASS" : "FAIL") << "\n";
+
+	auto [left, right] = MemoryStream::make_pair(16);
+	Scheduler::spawn(reader(right));
+	Scheduler::spawn(writer(left));
+	Scheduler::run();
+	bool stream_ok = eof_seen && received.size() > 16 && received.starts_with("line 0\n")
+	    && received.ends_with("line 199\n");
+	std::cout << "memory stream backpressure and eof: " << (stream_ok ? "PASS" : "FAIL") << "\n";
+
+	auto [idle, peer] = MemoryStream::make_pair();
+	Scheduler::spawn(idle_reader(idle));
+	Scheduler::run();
+	bool timeout_ok = idle_timed_out && idle_waited == 30s;
+	std::cout << "timeout on the virtual clock: " << (timeout_ok ? "PASS" : "FAIL") << "\n";
+
+	auto first = run_ping_pong(), second = run_ping_pong();
+	bool repeat_ok = first.size() == 50 && first == second;
+	std::cout << "repeatable timeline: " << (repeat_ok ? "PASS" : "FAIL") << "\n";
+
+	// more than an hour of virtual time
+	bool fast_ok = std::chrono::steady_clock::now() - real_start < 10s;
+	std::cout << "runs at full speed: " << (fast_ok ? "PASS" : "FAIL") << "\n";
+
+	return clock_ok && stream_ok && timeout_ok && repeat_ok && fast_ok ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+#include "work_stealing_deque.hpp"
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+int main() {
+	static constexpr const long long PUSHES = 1'000'000;
+	static constexpr const int THIEVES = 3;
+
+	// small capacity on purpose, so the ring grows under the thieves
+	WorkStealingDeque<long long> deque { 4 };
+	std::atomic<bool> producing { true };
+	std::atomic<long long> stolen_sum { 0 }, stolen_count { 0 };
+
+	std::vector<std::thread> thieves;
+	for (int i = 0; i < THIEVES; i++) {
+		thieves.emplace_back([&]() {
+			while (producing.load() || !deque.empty()) {
+				if (auto v = deque.steal()) {
+					stolen_sum += *v;
+					stolen_count++;
+				}
+			}
+		});
+	}
+
+	long long owner_sum = 0, owner_count = 0;
+	for (long long i = 1; i <= PUSHES; i++) {
+		deque.push(i);
+		// the owner takes from the same end as the thieves
+		if (i % 3 == 0) {
+			if (auto v = deque.steal()) {
+				owner_sum += *v;
+				owner_count++;
+			}
+		}
+	}
+	producing = false;
+	for (auto& t : thieves)
+		t.join();
+
+	const long long expect_sum = PUSHES * (PUSHES + 1) / 2;
+	const long long got_sum = owner_sum + stolen_sum;
+	const long long got_count = owner_count + stolen_count;
+	std::cout << "owner took: " << owner_count << ", thieves took: " << stolen_count << "\n";
+
+	bool ok = got_sum == expect_sum && got_count == PUSHES;
+	std::cout << "work stealing deque test: " << (ok ? "PASS" : "FAIL") << "\n";
+	return ok ? 0 : 1;
+}
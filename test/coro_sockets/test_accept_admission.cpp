@@ -0,0 +1,124 @@
+#include "IOEventMonitor.h"
+#include "Task.hpp"
+#include "coro_sys_socket.h"
+#include "scheduler.hpp"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+using namespace CNetUtils;
+
+static constexpr const netport_t LIMITED_PORT = 17381;
+static constexpr const netport_t SHEDDING_PORT = 17382;
+
+static std::atomic<int> accepted { 0 }, active { 0 }, peak { 0 };
+
+// holds the connection until the peer closes it
+Task<void> hold_until_eof(std::shared_ptr<CoroClientSocket> socket) {
+	accepted++;
+	int now = ++active;
+	int seen = peak.load();
+	while (now > seen && !peak.compare_exchange_weak(seen, now)) { }
+	char buffer[16];
+	while (co_await socket->async_read(buffer, sizeof(buffer)) > 0) { }
+	active--;
+	socket->close();
+}
+
+Task<void> say_ok(std::shared_ptr<CoroClientSocket> socket) {
+	co_await socket->async_write("ok", 2);
+	socket->close();
+}
+
+static int connect_to(netport_t port) {
+	int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	sockaddr_in addr {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	timeval timeout { 1, 0 };
+	::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void serve_in_background(netport_t port, CoroServerSocket::async_client_comming_callback_t callback,
+                                std::size_t limit, std::size_t resume_below) {
+	std::thread([=]() {
+		CoroServerSocket server { ServerAddress { port } };
+		server.set_connection_limit(limit, resume_below);
+		server.run_server(callback);
+	}).detach();
+	std::this_thread::sleep_for(100ms);
+}
+
+int main() {
+	// at most 2 at once, accepting resumes once 1 is left
+	serve_in_background(LIMITED_PORT, hold_until_eof, 2, 1);
+	std::vector<int> clients;
+	for (int i = 0; i < 5; i++)
+		clients.push_back(connect_to(LIMITED_PORT));
+	std::this_thread::sleep_for(200ms);
+	bool paused_ok = accepted == 2 && peak == 2;
+
+	// the listener is out of the poll: latecomers queue without waking the loop
+	std::uint64_t polls = Scheduler::stats_all().polls;
+	for (int i = 0; i < 2; i++)
+		clients.push_back(connect_to(LIMITED_PORT));
+	std::this_thread::sleep_for(100ms);
+	bool quiet_ok = Scheduler::stats_all().polls == polls && accepted == 2;
+	std::cout << "a paused listener does not wake the poll: " << (quiet_ok ? "PASS" : "FAIL") << "\n";
+
+	::close(clients[0]);
+	std::this_thread::sleep_for(200ms);
+	bool resumed_ok = accepted == 3 && peak == 2;
+
+	for (std::size_t i = 1; i < clients.size(); i++)
+		::close(clients[i]);
+	for (int i = 0; i < 50 && accepted < 7; i++)
+		std::this_thread::sleep_for(20ms);
+	bool drained_ok = accepted == 7 && peak == 2;
+	std::cout << "connection limit pauses and resumes accepting: "
+	          << (paused_ok && resumed_ok && drained_ok ? "PASS" : "FAIL") << "\n";
+
+	// no fd left for the server: the connection is shed, the loop goes on.
+	// The io_uring accept does not see a lowered RLIMIT_NOFILE, so on epoll
+	IOEventManager::prefer_backend(IOEventManager::Backend::Epoll);
+	serve_in_background(SHEDDING_PORT, say_ok, 0, 0);
+	rlimit original {};
+	::getrlimit(RLIMIT_NOFILE, &original);
+	int probe = connect_to(SHEDDING_PORT);
+	char buffer[4] {};
+	// served before the limit, and closed on the server side
+	while (::recv(probe, buffer, sizeof(buffer), 0) > 0) { }
+	int next_free = ::dup(0);
+	::close(next_free);
+	rlimit lowered = original;
+	lowered.rlim_cur = (rlim_t)next_free + 1; // the one client below
+	::setrlimit(RLIMIT_NOFILE, &lowered);
+	int victim = connect_to(SHEDDING_PORT);
+	ssize_t shed = victim >= 0 ? ::recv(victim, buffer, sizeof(buffer), 0) : -1;
+	::setrlimit(RLIMIT_NOFILE, &original);
+
+	int after = connect_to(SHEDDING_PORT);
+	ssize_t got = ::recv(after, buffer, sizeof(buffer), 0);
+	bool emfile_ok = victim >= 0 && shed <= 0 && got == 2;
+	std::cout << "EMFILE sheds the connection, accepting goes on: " << (emfile_ok ? "PASS" : "FAIL") << "\n";
+
+	::close(probe);
+	::close(victim);
+	::close(after);
+	return paused_ok && quiet_ok && resumed_ok && drained_ok && emfile_ok ? 0 : 1;
+}
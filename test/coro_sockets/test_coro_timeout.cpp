@@ -0,0 +1,112 @@
+#include "IOEventMonitor.h"
+#include "Task.hpp"
+#include "coro_sys_socket.h"
+#include "scheduler.hpp"
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+using namespace CNetUtils;
+
+static bool timed_out = false, read_in_time = false, read_errno_ok = false;
+static bool sleep_cut = false, outer_applies = false, outer_timed_out = false, cancelled_ok = false;
+
+Task<void> read_with_timeout(std::shared_ptr<CoroClientSocket> silent,
+                             std::shared_ptr<CoroClientSocket> talking) {
+	char buffer[16];
+
+	// the peer never writes: the read gives up and the waiter is removed
+	auto start = std::chrono::steady_clock::now();
+	auto r = co_await with_timeout(silent->async_read(buffer, sizeof(buffer)), 30ms);
+	auto spent = std::chrono::steady_clock::now() - start;
+	timed_out = !r.has_value() && spent >= 30ms && spent < 1s;
+
+	// the data comes before the timeout
+	auto ok = co_await with_timeout(talking->async_read(buffer, sizeof(buffer)), 1s);
+	read_in_time = ok.has_value() && *ok == 5;
+}
+
+Task<ssize_t> raw_read(std::shared_ptr<CoroClientSocket> socket) {
+	char buffer[16];
+	ssize_t n = co_await socket->async_read(buffer, sizeof(buffer));
+	read_errno_ok = n < 0 && errno == ETIMEDOUT;
+	co_return n;
+}
+
+Task<void> long_sleep() {
+	co_await sleep(10s);
+}
+
+Task<void> outer_timeout(std::shared_ptr<CoroClientSocket> silent) {
+	// the inner 10s timeout is cut by the outer 30ms one
+	auto inner = co_await with_timeout(raw_read(silent), 10s);
+	outer_applies = !inner.has_value() && read_errno_ok;
+}
+
+Task<void> sleepers(std::shared_ptr<CoroClientSocket> silent) {
+	sleep_cut = !co_await with_timeout(long_sleep(), 20ms);
+	// the outer deadline fired, so the outer with_timeout reports it
+	outer_timed_out = !co_await with_timeout(outer_timeout(silent), 30ms);
+}
+
+static CancellationToken* token = nullptr;
+
+Task<void> cancelled_read(std::shared_ptr<CoroClientSocket> silent) {
+	char buffer[16];
+	auto r = co_await with_cancellation(silent->async_read(buffer, sizeof(buffer)), *token);
+	cancelled_ok = !r.has_value() && token->reason() == CancellationToken::Reason::Cancelled;
+}
+
+Task<void> canceller() {
+	co_await sleep(10ms);
+	token->cancel();
+}
+
+static bool run_all() {
+	// one reader per socket at a time, the peers stay silent but one
+	int fds[4][2];
+	for (auto& pair : fds)
+		::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair);
+	auto silent = std::make_shared<CoroClientSocket>(fds[0][0]);
+	auto talking = std::make_shared<CoroClientSocket>(fds[1][0]);
+	auto silent_nested = std::make_shared<CoroClientSocket>(fds[2][0]);
+	auto silent_cancelled = std::make_shared<CoroClientSocket>(fds[3][0]);
+	::send(fds[1][1], "hello", 5, 0);
+
+	CancellationToken run_token;
+	token = &run_token;
+	timed_out = read_in_time = read_errno_ok = sleep_cut = outer_applies = outer_timed_out = cancelled_ok = false;
+	Scheduler::spawn(read_with_timeout(silent, talking));
+	Scheduler::spawn(sleepers(silent_nested));
+	Scheduler::spawn(cancelled_read(silent_cancelled));
+	Scheduler::spawn(canceller());
+	// returns only if every cancelled waiter was withdrawn
+	Scheduler::run();
+
+	for (auto& pair : fds)
+		::close(pair[1]);
+	return timed_out && read_in_time && sleep_cut && outer_applies && outer_timed_out && cancelled_ok;
+}
+
+int main() {
+	bool epoll_ok = run_all();
+	std::cout << "timeouts on epoll: " << (epoll_ok ? "PASS" : "FAIL") << "\n";
+
+	bool uring_ok = true;
+	std::thread([&] {
+		IOEventManager::prefer_backend(IOEventManager::Backend::IoUring);
+		if (!IOEventManager::instance().uring_enabled()) {
+			std::cout << "timeouts on io_uring: SKIP\n";
+			return;
+		}
+		uring_ok = run_all();
+		std::cout << "timeouts on io_uring: " << (uring_ok ? "PASS" : "FAIL") << "\n";
+	}).join();
+
+	return epoll_ok && uring_ok ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#include "Task.hpp"
+#include "async_generator.hpp"
+#include "coro_http/coro_http_reader.h"
+#include "coro_http/coro_http_writer.h"
+#include "coro_sys_socket.h"
+#include "http/http_response.hpp"
+#include "http/http_server_config.h"
+#include "loop_clock.hpp"
+#include "scheduler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace std::chrono_literals;
+using namespace CNetUtils;
+
+static constexpr const auto KEEP_ALIVE_TIMEOUT = 5s;
+
+static int served = 0;
+static std::chrono::nanoseconds idle_before_close {};
+
+// a keep-alive server loop, the idle connection is closed after the timeout
+Task<void> serve(std::shared_ptr<CoroClientSocket> sock) {
+	http::ServerConfig config = http::ServerConfigBuilder();
+	while (true) {
+		coro_http::HttpReader reader(sock, config);
+		auto idle_since = LoopClock::now();
+		auto req = co_await with_timeout(reader.read_request(), KEEP_ALIVE_TIMEOUT);
+		if (!req.has_value() || !req->has_value()) {
+			idle_before_close = LoopClock::now() - idle_since;
+			break;
+		}
+		http::Response resp;
+		resp.status = http::HttpStatus::OK;
+		resp.body = "hello " + (*req)->path;
+		resp.headers.set("connection", "keep-alive");
+		coro_http::HttpWriter writer(sock, config);
+		co_await writer.write_response(resp);
+		served++;
+	}
+	sock->close();
+}
+
+static std::string responses;
+static bool closed_by_server = false;
+
+Task<bool> read_response(std::shared_ptr<CoroClientSocket> sock, const std::string& body) {
+	char buffer[256];
+	std::string got;
+	while (got.find(body) == std::string::npos) {
+		ssize_t n = co_await sock->async_read(buffer, sizeof(buffer));
+		if (n <= 0)
+			co_return false;
+		got.append(buffer, (std::size_t)n);
+	}
+	responses += got;
+	co_return true;
+}
+
+Task<void> client(std::shared_ptr<CoroClientSocket> sock) {
+	for (std::string path : { "/a", "/b" }) {
+		std::string request = "GET " + path + " HTTP/1.1\r\nhost: memory\r\n\r\n";
+		co_await sock->async_write(request.data(), request.size());
+		if (!co_await read_response(sock, "hello " + path))
+			co_return;
+	}
+	// stay idle, the server gives up on us
+	char buffer[16];
+	closed_by_server = co_await sock->async_read(buffer, sizeof(buffer)) == 0;
+}
+
+static std::size_t biggest_piece = 0;
+
+AsyncGenerator<std::string> measured(AsyncGenerator<std::string> body) {
+	while (auto piece = co_await body.next()) {
+		biggest_piece = std::max(biggest_piece, piece->size());
+		co_yield std::move(*piece);
+	}
+}
+
+// streams the request body back, no side holds it whole
+Task<void> serve_echo(std::shared_ptr<CoroClientSocket> sock) {
+	http::ServerConfig config = http::ServerConfigBuilder();
+	coro_http::HttpReader reader(sock, config);
+	auto req = co_await reader.read_request_head();
+	if (req.has_value()) {
+		http::Response head;
+		head.status = http::HttpStatus::OK;
+		coro_http::HttpWriter writer(sock, config);
+		co_await writer.write_stream(head, measured(reader.body_stream(*req)));
+	}
+	sock->close();
+}
+
+static std::string echoed;
+
+Task<void> chunked_client(std::shared_ptr<CoroClientSocket> sock, std::string body) {
+	std::string request = "POST /echo HTTP/1.1\r\nhost: memory\r\ntransfer-encoding: chunked\r\n\r\n"
+	                      "5\r\nhello\r\n"
+	    + std::format("{:x}\r\n", body.size() - 5) + body.substr(5) + "\r\n0\r\n\r\n";
+	co_await sock->async_write(request.data(), request.size());
+
+	std::string got;
+	char buffer[1024];
+	while (true) {
+		ssize_t n = co_await sock->async_read(buffer, sizeof(buffer));
+		if (n <= 0)
+			break;
+		got.append(buffer, (std::size_t)n);
+	}
+	// decode the chunks of the response
+	std::size_t pos = got.find("\r\n\r\n");
+	if (pos == std::string::npos || got.find("transfer-encoding: chunked") == std::string::npos)
+		co_return;
+	pos += 4;
+	while (true) {
+		std::size_t line_end = got.find("\r\n", pos);
+		if (line_end == std::string::npos)
+			co_return;
+		std::size_t size = std::stoull(got.substr(pos, line_end - pos), nullptr, 16);
+		if (size == 0)
+			break;
+		echoed += got.substr(line_end + 2, size);
+		pos = line_end + 2 + size + 2;
+	}
+}
+
+int main() {
+	Scheduler::simulate();
+	auto real_start = std::chrono::steady_clock::now();
+
+	auto [server_end, client_end] = CoroClientSocket::memory_pair();
+	Scheduler::spawn(serve(server_end));
+	Scheduler::spawn(client(client_end));
+	Scheduler::run();
+
+	bool keep_alive_ok = served == 2 && responses.find("200") != std::string::npos;
+	std::cout << "keep-alive over memory: " << (keep_alive_ok ? "PASS" : "FAIL") << "\n";
+
+	bool timeout_ok = closed_by_server && idle_before_close == KEEP_ALIVE_TIMEOUT
+	    && std::chrono::steady_clock::now() - real_start < KEEP_ALIVE_TIMEOUT;
+	std::cout << "idle timeout on the virtual clock: " << (timeout_ok ? "PASS" : "FAIL") << "\n";
+
+	std::string body = "hello" + std::string(10000, 'x');
+	auto [echo_server, echo_client] = CoroClientSocket::memory_pair();
+	Scheduler::spawn(serve_echo(echo_server));
+	Scheduler::spawn(chunked_client(echo_client, body));
+	Scheduler::run();
+	bool stream_ok = echoed == body && biggest_piece > 0 && biggest_piece <= ((http::ServerConfig)http::ServerConfigBuilder()).read_block;
+	std::cout << "chunked body streamed back (pieces <= " << biggest_piece << "): "
+	          << (stream_ok ? "PASS" : "FAIL") << "\n";
+
+	return keep_alive_ok && timeout_ok && stream_ok ? 0 : 1;
+}
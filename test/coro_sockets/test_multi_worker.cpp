@@ -0,0 +1,99 @@
+#include "Task.hpp"
+#include "coro_sys_socket.h"
+#include "scheduler.hpp"
+#include "socket_exception.hpp"
+#include <arpa/inet.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <set>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+using namespace CNetUtils;
+
+static constexpr const std::size_t WORKERS = 3;
+static constexpr const int CLIENTS = 48;
+
+static std::mutex lock;
+static std::set<std::thread::id> serving_threads;
+
+Task<void> say_ok(std::shared_ptr<CoroClientSocket> socket) {
+	{
+		std::lock_guard guard { lock };
+		serving_threads.insert(std::this_thread::get_id());
+	}
+	co_await socket->async_write("ok", 2);
+	socket->close();
+}
+
+// a port the kernel just handed out, free once the probe is closed
+static netport_t ephemeral_port() {
+	ServerSocket probe { ServerAddress { 0 } };
+	probe.listen(Sync::Sync);
+	netport_t port = probe.dump_address().port;
+	probe.close();
+	return port;
+}
+
+static bool ask_ok(netport_t port) {
+	int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	sockaddr_in addr {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	timeval timeout { 2, 0 };
+	::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	std::string seen;
+	if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+		char buffer[16];
+		ssize_t n;
+		while ((n = ::read(fd, buffer, sizeof(buffer))) > 0)
+			seen.append(buffer, (std::size_t)n);
+	}
+	::close(fd);
+	return seen == "ok";
+}
+
+static bool serves_everyone(ExecutorMode mode) {
+	serving_threads.clear();
+	const netport_t port = ephemeral_port();
+	std::thread([port, mode]() {
+		CoroServerSocket server { ServerAddress { port } };
+		server.run_server(say_ok, WORKERS, mode);
+	}).detach();
+	std::this_thread::sleep_for(200ms);
+
+	int served = 0;
+	for (int i = 0; i < CLIENTS; i++)
+		served += ask_ok(port);
+	std::lock_guard guard { lock };
+	// SO_REUSEPORT hashes the clients over the listeners, more than one serves
+	return served == CLIENTS && serving_threads.size() > 1;
+}
+
+int main() {
+	bool per_core_ok = serves_everyone(ExecutorMode::ThreadPerCore);
+	std::cout << "every client served by the thread per core workers: " << (per_core_ok ? "PASS" : "FAIL") << "\n";
+
+	bool stealing_ok = serves_everyone(ExecutorMode::WorkStealing);
+	std::cout << "every client served by the work stealing workers: " << (stealing_ok ? "PASS" : "FAIL") << "\n";
+
+	// the port is taken by a listener without SO_REUSEPORT
+	ServerSocket taken { ServerAddress { 0 } };
+	taken.listen(Sync::Sync);
+	bool bind_error_ok = false;
+	try {
+		CoroServerSocket server { ServerAddress { taken.dump_address().port } };
+		server.run_server(say_ok, WORKERS);
+	} catch (const BindError&) {
+		bind_error_ok = true;
+	}
+	std::cout << "bind errors reach the caller: " << (bind_error_ok ? "PASS" : "FAIL") << "\n";
+
+	return per_core_ok && stealing_ok && bind_error_ok ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#include "Task.hpp"
+#include "coro_sys_socket.h"
+#include "scheduler.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+using namespace CNetUtils;
+
+static constexpr const int PIECES = 300; // more than one sendmsg window
+
+static std::string expected;
+static std::vector<std::string> pieces;
+static std::vector<iovec> iov;
+
+// pieces of odd sizes, empty ones between, far more than the socket buffer
+static void make_pieces() {
+	for (int i = 0; i < PIECES; i++) {
+		std::string piece = i % 7 == 3 ? "" : std::string(1 + (i * 977) % 9000, (char)('a' + i % 26));
+		expected += piece;
+		pieces.push_back(std::move(piece));
+	}
+	for (auto& piece : pieces)
+		iov.push_back({ piece.data(), piece.size() });
+}
+
+static ssize_t written = 0;
+static std::string received;
+
+Task<void> writer(std::shared_ptr<CoroClientSocket> socket) {
+	written = co_await socket->async_writev(iov.data(), (int)iov.size());
+	socket->close();
+}
+
+// reads with readv into two small buffers at a time
+Task<void> reader(std::shared_ptr<CoroClientSocket> socket) {
+	char head[100], tail[333];
+	iovec parts[2] = { { head, sizeof(head) }, { tail, sizeof(tail) } };
+	while (true) {
+		ssize_t n = co_await socket->async_readv(parts, 2);
+		if (n <= 0)
+			break;
+		std::size_t in_head = std::min((std::size_t)n, sizeof(head));
+		received.append(head, in_head);
+		received.append(tail, (std::size_t)n - in_head);
+	}
+	socket->close();
+}
+
+static bool run_pair(std::shared_ptr<CoroClientSocket> out, std::shared_ptr<CoroClientSocket> in) {
+	written = 0;
+	received.clear();
+	Scheduler::spawn(reader(in));
+	Scheduler::spawn(writer(out));
+	Scheduler::run();
+	return written == (ssize_t)expected.size() && received == expected;
+}
+
+int main() {
+	make_pieces();
+
+	int fds[2];
+	::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+	int small = 4096; // many partial writes
+	::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+	bool socket_ok = run_pair(std::make_shared<CoroClientSocket>(fds[0]), std::make_shared<CoroClientSocket>(fds[1]));
+	std::cout << "writev / readv over a socket, partial writes: " << (socket_ok ? "PASS" : "FAIL") << "\n";
+
+	auto [one, other] = CoroClientSocket::memory_pair(1024);
+	bool memory_ok = run_pair(one, other);
+	std::cout << "writev / readv over memory: " << (memory_ok ? "PASS" : "FAIL") << "\n";
+
+	return socket_ok && memory_ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+#include "Task.hpp"
+#include "coro_http/coro_http_writer.h"
+#include "coro_sys_socket.h"
+#include "http/http_response.hpp"
+#include "http/http_server_config.h"
+#include "scheduler.hpp"
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace CNetUtils;
+
+static constexpr const off_t SKIPPED = 1000;
+
+static std::string content;
+
+static int make_file() {
+	for (int i = 0; content.size() < 1024 * 1024; i++)
+		content += "block " + std::to_string(i) + "\n";
+	char name[] = "/tmp/cnetutils_sendfile_XXXXXX";
+	int fd = ::mkstemp(name);
+	::unlink(name);
+	::write(fd, content.data(), content.size());
+	return fd;
+}
+
+static std::string received;
+
+Task<void> drain(std::shared_ptr<CoroClientSocket> socket) {
+	char buffer[4096];
+	ssize_t n;
+	while ((n = co_await socket->async_read(buffer, sizeof(buffer))) > 0)
+		received.append(buffer, (std::size_t)n);
+	socket->close();
+}
+
+static ssize_t sent = 0;
+
+Task<void> send_file(std::shared_ptr<CoroClientSocket> socket, int file_fd) {
+	// asks for more than there is: short, not an error
+	sent = co_await socket->async_sendfile(file_fd, SKIPPED, content.size());
+	socket->close();
+}
+
+static ssize_t proxied = 0;
+
+// socket -> pipe -> socket, the bytes never come up to user space
+Task<void> proxy(std::shared_ptr<CoroClientSocket> from, std::shared_ptr<CoroClientSocket> to) {
+	int pipe_fds[2];
+	::pipe2(pipe_fds, O_NONBLOCK | O_CLOEXEC);
+	while (true) {
+		ssize_t n = co_await from->async_splice_to(pipe_fds[1], 64 * 1024);
+		if (n <= 0)
+			break;
+		if (co_await to->async_splice_from(pipe_fds[0], (size_t)n) != n)
+			break;
+		proxied += n;
+	}
+	::close(pipe_fds[0]);
+	::close(pipe_fds[1]);
+	to->close();
+}
+
+Task<void> write_all(std::shared_ptr<CoroClientSocket> socket) {
+	co_await socket->async_write(content.data(), content.size());
+	socket->close();
+}
+
+static bool response_ok = false;
+
+Task<void> serve_file(std::shared_ptr<CoroClientSocket> socket, int file_fd) {
+	http::ServerConfig config = http::ServerConfigBuilder();
+	coro_http::HttpWriter writer(socket, config);
+	http::Response head;
+	head.headers.set("connection", "close");
+	response_ok = co_await writer.write_file(head, file_fd, 0, content.size());
+	socket->close();
+}
+
+static std::pair<std::shared_ptr<CoroClientSocket>, std::shared_ptr<CoroClientSocket>> socket_pair() {
+	int fds[2];
+	::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+	int small = 8192; // the socket fills up, EAGAIN on the way
+	::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+	return { std::make_shared<CoroClientSocket>(fds[0]), std::make_shared<CoroClientSocket>(fds[1]) };
+}
+
+int main() {
+	int file_fd = make_file();
+
+	auto [out, in] = socket_pair();
+	Scheduler::spawn(drain(in));
+	Scheduler::spawn(send_file(out, file_fd));
+	Scheduler::run();
+	bool sendfile_ok = sent == (ssize_t)content.size() - SKIPPED && received == content.substr(SKIPPED);
+	std::cout << "sendfile from an offset: " << (sendfile_ok ? "PASS" : "FAIL") << "\n";
+
+	received.clear();
+	auto [source, proxy_in] = socket_pair();
+	auto [proxy_out, sink] = socket_pair();
+	Scheduler::spawn(drain(sink));
+	Scheduler::spawn(proxy(proxy_in, proxy_out));
+	Scheduler::spawn(write_all(source));
+	Scheduler::run();
+	bool splice_ok = proxied == (ssize_t)content.size() && received == content;
+	std::cout << "splice through a pipe: " << (splice_ok ? "PASS" : "FAIL") << "\n";
+
+	received.clear();
+	auto [server, client] = CoroClientSocket::memory_pair();
+	Scheduler::spawn(drain(client));
+	Scheduler::spawn(serve_file(server, file_fd));
+	Scheduler::run();
+	auto body_at = received.find("\r\n\r\n");
+	bool http_ok = response_ok && received.find("Content-Length") == std::string::npos
+	    && received.find("content-length: " + std::to_string(content.size())) != std::string::npos
+	    && body_at != std::string::npos && received.substr(body_at + 4) == content;
+	std::cout << "HttpWriter::write_file: " << (http_ok ? "PASS" : "FAIL") << "\n";
+
+	::close(file_fd);
+	return sendfile_ok && splice_ok && http_ok ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+#include "Task.hpp"
+#include "coro_sys_socket.h"
+#include "scheduler.hpp"
+#include "socket_address.h"
+#include <cerrno>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+using namespace CNetUtils;
+
+static constexpr const netport_t IPV6_PORT = 17391;
+
+// tells the peer how it was seen
+Task<void> tell_peer(std::shared_ptr<CoroClientSocket> socket) {
+	std::string seen = socket->dump_self().dump_self();
+	co_await socket->async_write(seen.data(), seen.size());
+	socket->close();
+}
+
+static void serve_in_background(ServerAddress addr) {
+	std::thread([addr]() {
+		CoroServerSocket server { addr };
+		server.run_server(tell_peer);
+	}).detach();
+	std::this_thread::sleep_for(100ms);
+}
+
+static bool ipv6_available() {
+	int fd = ::socket(AF_INET6, SOCK_STREAM, 0);
+	if (fd < 0)
+		return false;
+	sockaddr_in6 addr {};
+	addr.sin6_family = AF_INET6;
+	addr.sin6_addr = in6addr_loopback;
+	bool ok = ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+	::close(fd);
+	return ok;
+}
+
+Task<void> ask(FullAddress peer, std::string& seen, int& error) {
+	auto socket = co_await CoroClientSocket::async_connect(peer);
+	if (!socket) {
+		error = errno;
+		co_return;
+	}
+	char buffer[128];
+	ssize_t n;
+	while ((n = co_await socket->async_read(buffer, sizeof(buffer))) > 0)
+		seen.append(buffer, (std::size_t)n);
+	socket->close();
+}
+
+static std::string ask_sync(const FullAddress& peer, int& error) {
+	std::string seen;
+	Scheduler::spawn(ask(peer, seen, error));
+	Scheduler::run();
+	return seen;
+}
+
+int main() {
+	int error = 0;
+
+	const std::string path = std::format("/tmp/cnetutils_test_{}.sock", ::getpid());
+	serve_in_background(ServerAddress::unix_socket(path));
+	std::string seen = ask_sync(FullAddress::unix_socket(path), error);
+	struct stat st {};
+	bool unix_ok = seen.starts_with("[unix: ") && ::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode);
+	std::cout << "unix socket on a path: " << (unix_ok ? "PASS" : "FAIL") << "\n";
+	::unlink(path.c_str());
+
+	const std::string name = std::format("@cnetutils_test_{}", ::getpid());
+	serve_in_background(ServerAddress::unix_socket(name));
+	seen = ask_sync(FullAddress::unix_socket(name), error);
+	bool abstract_ok = seen.starts_with("[unix: ") && ::stat(name.c_str(), &st) != 0;
+	std::cout << "unix socket in the abstract namespace: " << (abstract_ok ? "PASS" : "FAIL") << "\n";
+
+	error = 0;
+	seen = ask_sync(FullAddress::unix_socket("/tmp/cnetutils_nobody_listens.sock"), error);
+	bool refused_ok = seen.empty() && error == ENOENT;
+	std::cout << "connect to a missing path fails: " << (refused_ok ? "PASS" : "FAIL") << "\n";
+
+	bool ipv6_ok = true;
+	if (ipv6_available()) {
+		serve_in_background(ServerAddress::ipv6(IPV6_PORT));
+		seen = ask_sync(FullAddress { "::1", IPV6_PORT }, error);
+		bool v6 = seen.starts_with("[[::1]: ");
+		seen = ask_sync(FullAddress { "127.0.0.1", IPV6_PORT }, error);
+		bool dual = seen.starts_with("[[::ffff:127.0.0.1]: ");
+		ipv6_ok = v6 && dual;
+		std::cout << "ipv6 dual stack: " << (ipv6_ok ? "PASS" : "FAIL") << "\n";
+	} else {
+		std::cout << "ipv6 dual stack: SKIPPED, no ipv6 here\n";
+	}
+
+	sockaddr_storage out {};
+	bool parse_ok = FullAddress { "not an ip", 80 }.to_sockaddr(out) == 0
+	    && FullAddress { "::1", 80 }.family == AddressFamily::IPv6
+	    && ServerAddress::unix_socket(std::string(200, 'x')).to_sockaddr(out) == 0;
+	std::cout << "bad addresses are refused: " << (parse_ok ? "PASS" : "FAIL") << "\n";
+
+	return unix_ok && abstract_ok && refused_ok && ipv6_ok && parse_ok ? 0 : 1;
+}
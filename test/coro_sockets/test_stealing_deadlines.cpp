@@ -0,0 +1,114 @@
+#include "Task.hpp"
+#include "coro_sys_socket.h"
+#include "scheduler.hpp"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using namespace CNetUtils;
+
+static constexpr const int WORKERS = 4;
+static constexpr const int PAIRS = 64;
+static constexpr const int ROUNDS = 200;
+static constexpr const int SILENT = 16;
+
+static std::atomic<int> timed_waits { 0 }, moved_while_armed { 0 }, failures { 0 };
+static std::atomic<int> migrations { 0 }, timed_out { 0 };
+
+// a read with a deadline: it must come back on the loop which armed it
+Task<ssize_t> timed_read(std::shared_ptr<CoroClientSocket> socket, char* buffer, std::size_t size,
+                         std::chrono::milliseconds timeout) {
+	auto before = std::this_thread::get_id();
+	auto r = co_await with_timeout(socket->async_read(buffer, size), timeout);
+	timed_waits++;
+	if (std::this_thread::get_id() != before)
+		moved_while_armed++;
+	co_return r.has_value() ? *r : -1;
+}
+
+// some cpu between the waits, so the loops have something to steal
+static void spin() {
+	volatile unsigned sink = 0;
+	for (unsigned i = 0; i < 2000; i++)
+		sink = sink + i;
+}
+
+Task<void> pinger(std::shared_ptr<CoroClientSocket> socket) {
+	char buffer[8];
+	for (int i = 0; i < ROUNDS; i++) {
+		spin();
+		if (co_await socket->async_write("ping", 4) != 4 || co_await timed_read(socket, buffer, 4, 5s) != 4)
+			failures++;
+		auto before = std::this_thread::get_id();
+		co_await yield(); // no deadline here, free to move
+		if (std::this_thread::get_id() != before)
+			migrations++;
+	}
+	socket->close();
+}
+
+Task<void> ponger(std::shared_ptr<CoroClientSocket> socket) {
+	char buffer[8];
+	for (int i = 0; i < ROUNDS; i++) {
+		if (co_await timed_read(socket, buffer, 4, 5s) != 4)
+			failures++;
+		spin();
+		if (co_await socket->async_write("pong", 4) != 4)
+			failures++;
+	}
+	socket->close();
+}
+
+// the peer never writes, the deadline fires on the loop which armed it
+Task<void> silent_reader(std::shared_ptr<CoroClientSocket> socket) {
+	char buffer[8];
+	if (co_await timed_read(socket, buffer, sizeof(buffer), 20ms) < 0)
+		timed_out++;
+	socket->close();
+}
+
+int main() {
+	std::vector<std::shared_ptr<CoroClientSocket>> sockets;
+	auto pair = [&]() {
+		int fds[2];
+		::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+		sockets.push_back(std::make_shared<CoroClientSocket>(fds[0]));
+		sockets.push_back(std::make_shared<CoroClientSocket>(fds[1]));
+	};
+
+	WorkStealingGroup group { WORKERS };
+	std::vector<std::jthread> thieves;
+	for (int i = 1; i < WORKERS; i++) {
+		thieves.emplace_back([&group]() {
+			Scheduler::join_group(group);
+			Scheduler::run();
+		});
+	}
+
+	// all spawned on one loop, the others take their share by stealing
+	Scheduler::join_group(group);
+	for (int i = 0; i < PAIRS; i++) {
+		pair();
+		Scheduler::spawn(pinger(sockets[sockets.size() - 2]));
+		Scheduler::spawn(ponger(sockets.back()));
+	}
+	for (int i = 0; i < SILENT; i++) {
+		pair();
+		Scheduler::spawn(silent_reader(sockets[sockets.size() - 2]));
+	}
+	Scheduler::run();
+	thieves.clear();
+
+	bool pinned_ok = moved_while_armed == 0 && failures == 0 && timed_waits == 2 * PAIRS * ROUNDS + SILENT
+	    && timed_out == SILENT;
+	std::cout << "timed waits resume on the loop of their deadline (" << migrations
+	          << " free migrations): " << (pinned_ok ? "PASS" : "FAIL") << "\n";
+	bool stealing_ok = migrations > 0;
+	std::cout << "the loops stole the untimed ones: " << (stealing_ok ? "PASS" : "FAIL") << "\n";
+	return pinned_ok && stealing_ok ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+#include "IOEventMonitor.h"
+#include "Task.hpp"
+#include "coro_sys_socket.h"
+#include "scheduler.hpp"
+#include "socket_address.h"
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace std::chrono_literals;
+using namespace CNetUtils;
+
+static constexpr const int CLIENTS = 32;
+
+// sends back what it reads until the peer closes
+Task<void> echo(std::shared_ptr<CoroClientSocket> socket) {
+	char buffer[256];
+	ssize_t n;
+	while ((n = co_await socket->async_read(buffer, sizeof(buffer))) > 0)
+		if (co_await socket->async_write(buffer, (size_t)n) != n)
+			break;
+	socket->close();
+}
+
+// a port the kernel just handed out, free once the probe is closed
+static netport_t ephemeral_port() {
+	ServerSocket probe { ServerAddress { 0 } };
+	probe.listen(Sync::Sync);
+	netport_t port = probe.dump_address().port;
+	probe.close();
+	return port;
+}
+
+Task<bool> round_trip(netport_t port, int index) {
+	auto socket = co_await CoroClientSocket::async_connect(FullAddress { "127.0.0.1", port });
+	if (!socket)
+		co_return false;
+	const std::string sent = std::format("round trip {}", index);
+	if (co_await socket->async_write(sent.data(), sent.size()) != (ssize_t)sent.size())
+		co_return false;
+	std::string seen;
+	char buffer[64];
+	ssize_t n;
+	while ((n = co_await socket->async_read(buffer, sizeof(buffer))) > 0) {
+		seen.append(buffer, (std::size_t)n);
+		if (seen.size() >= sent.size())
+			break;
+	}
+	socket->close();
+	co_return seen == sent;
+}
+
+Task<void> timed_round_trip(netport_t port, int index, int& echoed) {
+	// a listener that stopped accepting leaves the client waiting on its read
+	auto ok = co_await with_timeout(round_trip(port, index), 2s);
+	echoed += ok && *ok;
+}
+
+static bool serves_everyone() {
+	const netport_t port = ephemeral_port();
+	std::thread([port]() {
+		CoroServerSocket server { ServerAddress { port } };
+		server.run_server(echo);
+	}).detach();
+	std::this_thread::sleep_for(200ms);
+
+	int echoed = 0;
+	for (int i = 0; i < CLIENTS; i++)
+		Scheduler::spawn(timed_round_trip(port, i, echoed));
+	Scheduler::run();
+	return echoed == CLIENTS;
+}
+
+int main() {
+	// the listeners' threads and this one (the clients) both get a ring
+	IOEventManager::prefer_backend(IOEventManager::Backend::IoUring);
+	if (!IOEventManager::instance().uring_enabled()) {
+		std::cout << "round trips on io_uring: SKIP\n";
+		return 0;
+	}
+
+	bool multishot_ok = serves_everyone();
+	std::cout << "round trips on io_uring with multishot accepts: " << (multishot_ok ? "PASS" : "FAIL") << "\n";
+
+	// the -EINVAL of an older kernel, the listener goes on with single shot accepts
+	IOEventManager::refuse_multishot_accept(true);
+	bool fallback_ok = serves_everyone();
+	IOEventManager::refuse_multishot_accept(false);
+	std::cout << "round trips on io_uring after the multishot accept is refused: " << (fallback_ok ? "PASS" : "FAIL") << "\n";
+
+	return multishot_ok && fallback_ok ? 0 : 1;
+}
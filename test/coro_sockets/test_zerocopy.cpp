@@ -0,0 +1,177 @@
+#include "Task.hpp"
+#include "coro_http/coro_http_writer.h"
+#include "coro_sys_socket.h"
+#include "http/http_server_config.h"
+#include "scheduler.hpp"
+#include <arpa/inet.h>
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+using namespace CNetUtils;
+
+static constexpr const std::size_t BODY = 4 * 1024 * 1024;
+static constexpr const std::size_t LINGER_BODY = 128 * 1024;
+
+// a small receive buffer keeps the data unacknowledged while the peer does not read
+static std::pair<int, int> loopback_pair(int receive_buffer = 0) {
+	int listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	sockaddr_in addr {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	::bind(listener, reinterpret_cast<sockaddr*>(&addr), len);
+	::listen(listener, 1);
+	::getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len);
+
+	int client = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (receive_buffer)
+		::setsockopt(client, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+	::connect(client, reinterpret_cast<sockaddr*>(&addr), len);
+	int server = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	::close(listener);
+	::fcntl(client, F_SETFL, ::fcntl(client, F_GETFL) | O_NONBLOCK);
+	return { server, client };
+}
+
+static std::string received, expected;
+static bool writes_ok = true, released_ok = false, copied_ok = false;
+
+// tells the writer once the owned buffers arrived whole
+Task<void> drain(std::shared_ptr<CoroClientSocket> socket) {
+	char buffer[64 * 1024];
+	ssize_t n;
+	bool told = false;
+	while ((n = co_await socket->async_read(buffer, sizeof(buffer))) > 0) {
+		received.append(buffer, (std::size_t)n);
+		if (!told && received.size() >= 3 * BODY) {
+			co_await socket->async_write("done", 4);
+			told = true;
+		}
+	}
+	socket->close();
+}
+
+Task<void> write_owned(std::shared_ptr<CoroClientSocket> socket) {
+	// handed over, the socket keeps them until the kernel let them go
+	std::vector<std::weak_ptr<std::string>> sent;
+	for (char fill : { 'a', 'b', 'c' }) {
+		auto owner = std::make_shared<std::string>(BODY, fill);
+		expected += *owner;
+		sent.push_back(owner);
+		const char* data = owner->data();
+		writes_ok &= co_await socket->async_write_zerocopy(std::move(owner), data, BODY) == (ssize_t)BODY;
+	}
+
+	// the peer read them all, so the kernel reported them: the next write reaps
+	char reply[4];
+	writes_ok &= co_await socket->async_read(reply, sizeof(reply)) == 4;
+	auto last = std::make_shared<std::string>(BODY, 'd');
+	expected += *last;
+	const char* data = last->data();
+	writes_ok &= co_await socket->async_write_zerocopy(std::move(last), data, BODY) == (ssize_t)BODY;
+	released_ok = true;
+	for (auto& owner : sent)
+		released_ok &= owner.expired();
+
+	// below the threshold it is copied, the owner is let go at once
+	auto small = std::make_shared<std::string>("below the threshold");
+	std::weak_ptr<std::string> small_sent = small;
+	expected += *small;
+	iovec iov { small->data(), small->size() };
+	writes_ok &= co_await socket->async_writev_zerocopy(std::move(small), &iov, 1) == (ssize_t)iov.iov_len;
+	copied_ok = small_sent.expired();
+
+	// async_write copies whatever the size, the buffer is free right after
+	std::string reused(BODY, 'e');
+	expected += reused;
+	writes_ok &= co_await socket->async_write(reused.data(), reused.size()) == (ssize_t)BODY;
+	reused.assign(BODY, 'x');
+
+	socket->close();
+}
+
+static bool linger_write_ok = false, held_after_close = false;
+static std::weak_ptr<std::string> lingering;
+
+// the peer reads only once the writer closed, the kernel has not sent it all yet
+Task<void> write_then_close(std::shared_ptr<CoroClientSocket> socket, std::shared_ptr<CoroClientSocket> peer) {
+	auto owner = std::make_shared<std::string>(LINGER_BODY, 'l');
+	lingering = owner;
+	const char* data = owner->data();
+	auto n = co_await with_timeout(socket->async_write_zerocopy(std::move(owner), data, LINGER_BODY), 2s);
+	linger_write_ok = n.has_value() && *n == (ssize_t)LINGER_BODY;
+	socket->close();
+	held_after_close = !lingering.expired();
+	Scheduler::spawn(drain(peer));
+}
+
+static std::string http_body;
+
+// the response is moved into the writer, which hands it to the socket
+Task<void> respond(std::shared_ptr<CoroClientSocket> socket) {
+	http::ServerConfig config = http::ServerConfigBuilder().setZerocopyThreshold(64 * 1024);
+	coro_http::HttpWriter writer(socket, config);
+	http::Response resp;
+	resp.body = http_body;
+	co_await writer.write_response(std::move(resp));
+	socket->close();
+}
+
+int main() {
+	auto [server, client] = loopback_pair();
+	auto out = std::make_shared<CoroClientSocket>(server);
+	auto in = std::make_shared<CoroClientSocket>(client);
+	if (!out->set_zerocopy(64 * 1024)) {
+		std::cout << "zero-copy writes: SKIPPED, no SO_ZEROCOPY here\n";
+		return 0;
+	}
+	Scheduler::spawn(drain(in));
+	Scheduler::spawn(write_owned(out));
+	Scheduler::run();
+	bool zerocopy_ok = writes_ok && received == expected;
+	std::cout << "zero-copy writes of handed over buffers: " << (zerocopy_ok ? "PASS" : "FAIL") << "\n";
+	bool owners_ok = released_ok && copied_ok;
+	std::cout << "the owners are let go once the kernel is done: " << (owners_ok ? "PASS" : "FAIL") << "\n";
+
+	auto [linger_server, linger_client] = loopback_pair(4096);
+	int send_buffer = 1024 * 1024;
+	::setsockopt(linger_server, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+	auto closing = std::make_shared<CoroClientSocket>(linger_server);
+	closing->set_zerocopy(64 * 1024);
+	received.clear();
+	Scheduler::spawn(write_then_close(closing, std::make_shared<CoroClientSocket>(linger_client)));
+	Scheduler::run();
+	bool linger_ok = linger_write_ok && held_after_close && lingering.expired()
+	    && received == std::string(LINGER_BODY, 'l');
+	std::cout << "close keeps the owners until the kernel is done: " << (linger_ok ? "PASS" : "FAIL") << "\n";
+
+	auto [http_server, http_client] = loopback_pair();
+	http_body.assign(BODY, 'h');
+	received.clear();
+	Scheduler::spawn(drain(std::make_shared<CoroClientSocket>(http_client)));
+	Scheduler::spawn(respond(std::make_shared<CoroClientSocket>(http_server)));
+	Scheduler::run();
+	std::size_t head_end = received.find("\r\n\r\n");
+	bool http_ok = received.starts_with("HTTP/1.1 200") && head_end != std::string::npos
+	    && received.substr(head_end + 4) == http_body;
+	std::cout << "a moved response is sent zero-copy: " << (http_ok ? "PASS" : "FAIL") << "\n";
+
+	auto [one, other] = CoroClientSocket::memory_pair();
+	int fds[2];
+	::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+	CoroClientSocket unix_socket { fds[0] };
+	::close(fds[1]);
+	bool refused_ok = !one->set_zerocopy(1) && !unix_socket.set_zerocopy(1) && one->set_zerocopy(0);
+	std::cout << "memory and unix sockets refuse it: " << (refused_ok ? "PASS" : "FAIL") << "\n";
+
+	return zerocopy_ok && owners_ok && linger_ok && http_ok && refused_ok ? 0 : 1;
+}